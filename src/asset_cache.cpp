@@ -0,0 +1,361 @@
+#include "asset_cache.h"
+#include "fs_linux.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rigel {
+
+constexpr static u32 ASSET_CACHE_ALIGN = 16;
+
+static char asset_cache_dir[256] = ASSET_CACHE_DIR;
+
+// what follows an anim entry's frames, one per animation. The names all go
+// after these, null terminated.
+struct CachedAnimation
+{
+    Animation animation;
+    u32 name_offset;
+};
+
+u64
+asset_cache_hash(const void* data, usize n_bytes)
+{
+    // FNV-1a a word at a time, with a final mix since xor-multiply alone
+    // leaves the high bits weak. Plenty for telling files apart, it's not
+    // meant to stand up to anyone trying to collide it.
+    const ubyte* bytes = reinterpret_cast<const ubyte*>(data);
+    u64 hash = 0xcbf29ce484222325ull ^ n_bytes;
+
+    usize i = 0;
+    for (; i + 8 <= n_bytes; i += 8)
+    {
+        u64 word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32;
+    }
+    for (; i < n_bytes; i++)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void
+asset_cache_set_dir(const char* dir)
+{
+    snprintf(asset_cache_dir, sizeof(asset_cache_dir), "%s", dir);
+}
+
+static void
+entry_path(char* out, usize out_size, u64 source_hash, AssetCacheKind kind)
+{
+    snprintf(out, out_size, "%s/%016llx.%s", asset_cache_dir,
+             (unsigned long long)source_hash, kind == AssetCacheKind_Image ? "img" : "anim");
+}
+
+static u32
+align_entry(u32 offset)
+{
+    return (offset + ASSET_CACHE_ALIGN - 1) & ~(ASSET_CACHE_ALIGN - 1);
+}
+
+// Maps the entry and checks its header. Anything that doesn't look right is
+// a miss, it'll get written over with a good one.
+static b32
+map_entry(u64 source_hash, AssetCacheKind kind, MappedFile* file, AssetCacheHeader* header)
+{
+    char path[512];
+    entry_path(path, sizeof(path), source_hash, kind);
+    if (!map_file(path, file))
+    {
+        return false;
+    }
+
+    b32 ok = file->size >= sizeof(AssetCacheHeader);
+    if (ok)
+    {
+        memcpy(header, file->data, sizeof(AssetCacheHeader));
+        ok = header->magic == ASSET_CACHE_MAGIC
+          && header->version == ASSET_CACHE_VERSION
+          && header->kind == (u32)kind
+          && header->source_hash == source_hash
+          && header->file_size == file->size;
+    }
+    for (u32 i = 0; ok && i < 3; i++)
+    {
+        ok = header->offsets[i] >= sizeof(AssetCacheHeader) && header->offsets[i] <= header->file_size;
+    }
+
+    if (!ok)
+    {
+        unmap_file(file);
+    }
+    return ok;
+}
+
+static b32
+write_entry(u64 source_hash, AssetCacheKind kind, const FileChunk* chunks, u32 n_chunks)
+{
+    // fine if it's already there
+    mkdir(asset_cache_dir, 0755);
+
+    // Entries that were hit stay mapped for the rest of the run, and
+    // truncating a mapped file SIGBUSes whoever's reading it. So write
+    // somewhere no one else is writing, then rename it over the entry:
+    // anyone with the old one mapped keeps the old inode.
+    static std::atomic<u32> next_temp_id;
+    char path[512];
+    char temp_path[sizeof(path) + 32];
+    entry_path(path, sizeof(path), source_hash, kind);
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.%u.tmp", path, (i32)getpid(), next_temp_id.fetch_add(1));
+
+    if (!dump_chunks_to_file(temp_path, chunks, n_chunks) || rename(temp_path, path) != 0)
+    {
+        unlink(temp_path);
+        std::cerr << "Couldn't write asset cache entry '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+b32
+asset_cache_map_image(u64 source_hash, CachedImage* out)
+{
+    MappedFile file;
+    AssetCacheHeader header;
+    if (!map_entry(source_hash, AssetCacheKind_Image, &file, &header))
+    {
+        return false;
+    }
+
+    u32 width = header.counts[0];
+    u32 height = header.counts[1];
+    u64 n_bytes = (u64)width * height * 4;
+    if (n_bytes > header.file_size - header.offsets[0])
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    out->width = width;
+    out->height = height;
+    out->pixels = file.data + header.offsets[0];
+    return true;
+}
+
+b32
+asset_cache_store_image(u64 source_hash, u32 width, u32 height, const ubyte* pixels)
+{
+    usize n_pixel_bytes = (usize)width * height * 4;
+
+    AssetCacheHeader header = {};
+    header.magic = ASSET_CACHE_MAGIC;
+    header.version = ASSET_CACHE_VERSION;
+    header.kind = AssetCacheKind_Image;
+    header.source_hash = source_hash;
+    header.counts[0] = width;
+    header.counts[1] = height;
+    header.offsets[0] = align_entry(sizeof(AssetCacheHeader));
+    header.offsets[1] = header.offsets[0];
+    header.offsets[2] = header.offsets[0];
+    header.file_size = header.offsets[0] + n_pixel_bytes;
+
+    // the pixels go straight from the caller to the file, an image can be
+    // bigger than any scratch that'd be around to copy it into
+    ubyte header_bytes[sizeof(AssetCacheHeader) + ASSET_CACHE_ALIGN] = {};
+    assert(header.offsets[0] <= sizeof(header_bytes));
+    memcpy(header_bytes, &header, sizeof(AssetCacheHeader));
+
+    FileChunk chunks[2] = {
+        { header_bytes, header.offsets[0] },
+        { pixels, n_pixel_bytes },
+    };
+    return write_entry(source_hash, AssetCacheKind_Image, chunks, 2);
+}
+
+b32
+asset_cache_map_anim(u64 source_hash, AnimationResource* resource)
+{
+    MappedFile file;
+    AssetCacheHeader header;
+    if (!map_entry(source_hash, AssetCacheKind_Anim, &file, &header))
+    {
+        return false;
+    }
+
+    u32 n_frames = header.counts[0];
+    u32 n_animations = header.counts[1];
+    b32 ok = n_animations < MAX_ANIMATIONS - 1
+          && (u64)n_frames * sizeof(Frame) <= header.file_size - header.offsets[0]
+          && (u64)n_animations * sizeof(CachedAnimation) <= header.file_size - header.offsets[1];
+
+    auto animations = reinterpret_cast<CachedAnimation*>(file.data + header.offsets[1]);
+    for (u32 i = 0; ok && i < n_animations; i++)
+    {
+        // names have to end inside the file
+        u32 name_offset = header.offsets[2] + animations[i].name_offset;
+        ok = name_offset < header.file_size
+          && memchr(file.data + name_offset, 0, header.file_size - name_offset);
+    }
+    if (!ok)
+    {
+        unmap_file(&file);
+        return false;
+    }
+
+    resource->n_frames = n_frames;
+    resource->frames = reinterpret_cast<Frame*>(file.data + header.offsets[0]);
+    for (u32 i = 0; i < n_animations; i++)
+    {
+        const char* name = reinterpret_cast<const char*>(file.data + header.offsets[2] + animations[i].name_offset);
+        resource->animations.add(name, animations[i].animation);
+    }
+    return true;
+}
+
+b32
+asset_cache_store_anim(mem::Arena* scratch_arena, u64 source_hash, const AnimationResource* resource)
+{
+    u32 n_animations = 0;
+    u32 names_size = 0;
+    for (usize i = 0; i < MAX_ANIMATIONS; i++)
+    {
+        if (resource->animations.map[i].key)
+        {
+            n_animations++;
+            names_size += strlen(resource->animations.map[i].key) + 1;
+        }
+    }
+
+    AssetCacheHeader header = {};
+    header.magic = ASSET_CACHE_MAGIC;
+    header.version = ASSET_CACHE_VERSION;
+    header.kind = AssetCacheKind_Anim;
+    header.source_hash = source_hash;
+    header.counts[0] = resource->n_frames;
+    header.counts[1] = n_animations;
+    header.offsets[0] = align_entry(sizeof(AssetCacheHeader));
+    header.offsets[1] = align_entry(header.offsets[0] + resource->n_frames * sizeof(Frame));
+    header.offsets[2] = align_entry(header.offsets[1] + n_animations * sizeof(CachedAnimation));
+    header.file_size = header.offsets[2] + names_size;
+
+    auto checkpoint = scratch_arena->checkpoint();
+    ubyte* out = scratch_arena->alloc_array<ubyte>(header.file_size);
+    memset(out, 0, header.file_size);
+    memcpy(out, &header, sizeof(AssetCacheHeader));
+    if (resource->n_frames)
+    {
+        memcpy(out + header.offsets[0], resource->frames, resource->n_frames * sizeof(Frame));
+    }
+
+    auto animations = reinterpret_cast<CachedAnimation*>(out + header.offsets[1]);
+    u32 name_offset = 0;
+    for (usize i = 0; i < MAX_ANIMATIONS; i++)
+    {
+        const char* key = resource->animations.map[i].key;
+        if (!key)
+        {
+            continue;
+        }
+
+        usize key_size = strlen(key) + 1;
+        memcpy(out + header.offsets[2] + name_offset, key, key_size);
+        animations->animation = resource->animations.map[i].value;
+        animations->name_offset = name_offset;
+        animations++;
+        name_offset += key_size;
+    }
+
+    FileChunk chunk = { out, header.file_size };
+    b32 result = write_entry(source_hash, AssetCacheKind_Anim, &chunk, 1);
+    scratch_arena->restore(checkpoint);
+    return result;
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+namespace rigel {
+
+TEST_CASE("asset cache entries come back the way they went in")
+{
+    static ubyte backing[64 * ONE_KB];
+    mem::Arena arena(backing, sizeof(backing));
+
+    asset_cache_set_dir("/tmp/rigel_asset_cache_test");
+
+    const char* source = "pretend this is a png";
+    u64 hash = asset_cache_hash(source, strlen(source));
+    CHECK(hash != asset_cache_hash(source, strlen(source) - 1));
+    CHECK(hash != asset_cache_hash("pretend this is a pnh", strlen(source)));
+
+    ubyte pixels[3 * 2 * 4];
+    for (usize i = 0; i < sizeof(pixels); i++)
+    {
+        pixels[i] = (ubyte)(i * 11);
+    }
+    REQUIRE(asset_cache_store_image(hash, 3, 2, pixels));
+
+    CachedImage image;
+    REQUIRE(asset_cache_map_image(hash, &image));
+    CHECK(image.width == 3);
+    CHECK(image.height == 2);
+    CHECK(memcmp(image.pixels, pixels, sizeof(pixels)) == 0);
+    CHECK(((uintptr_t)image.pixels % 16) == 0);
+
+    // rewriting an entry someone has mapped leaves their mapping alone
+    ubyte other_pixels[sizeof(pixels)] = {};
+    REQUIRE(asset_cache_store_image(hash, 3, 2, other_pixels));
+    CHECK(memcmp(image.pixels, pixels, sizeof(pixels)) == 0);
+    CachedImage rewritten;
+    REQUIRE(asset_cache_map_image(hash, &rewritten));
+    CHECK(memcmp(rewritten.pixels, other_pixels, sizeof(other_pixels)) == 0);
+
+    // the same hash as an anim, or a hash nothing was stored under, misses
+    static AnimationResource anim;
+    anim = {};
+    CHECK_FALSE(asset_cache_map_anim(hash, &anim));
+    CHECK_FALSE(asset_cache_map_image(hash + 1, &image));
+
+    Frame frames[3] = {
+        { { 0, 0 }, { 16, 20 }, 100 },
+        { { 16, 0 }, { 32, 20 }, 100 },
+        { { 32, 0 }, { 48, 20 }, 150 },
+    };
+    anim.n_frames = 3;
+    anim.frames = frames;
+    Animation idle = { "idle", 0, 1 };
+    Animation run = { "run", 1, 3 };
+    anim.animations.add("idle", idle);
+    anim.animations.add("run", run);
+
+    u64 anim_hash = asset_cache_hash("pretend this is some json", 25);
+    REQUIRE(asset_cache_store_anim(&arena, anim_hash, &anim));
+
+    static AnimationResource cached;
+    cached = {};
+    REQUIRE(asset_cache_map_anim(anim_hash, &cached));
+    REQUIRE(cached.n_frames == 3);
+    CHECK(cached.frames[2].duration_ms == 150);
+    CHECK(cached.frames[1].spritesheet_min.x == 16);
+    Animation* cached_run = cached.animations.get("run");
+    REQUIRE(cached_run);
+    CHECK(cached_run->start_frame == 1);
+    CHECK(cached_run->end_frame == 3);
+    CHECK(strcmp(cached_run->name, "run") == 0);
+
+    asset_cache_set_dir(ASSET_CACHE_DIR);
+}
+
+} // namespace rigel
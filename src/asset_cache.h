@@ -0,0 +1,74 @@
+#ifndef RIGEL_ASSET_CACHE_H
+#define RIGEL_ASSET_CACHE_H
+
+#include "rigel.h"
+#include "mem.h"
+#include "resource.h"
+
+namespace rigel {
+
+// On-disk cache of decoded assets, so a launch where nothing changed maps
+// the results of the last one instead of decoding PNGs and parsing sprite
+// info again.
+//
+// Entries are keyed by a hash of the source file's contents, so editing an
+// asset misses the cache on its own, and the same asset under two paths
+// shares an entry. Each entry is a header and then the data exactly as the
+// resource tables use it, so a hit just points the resource at the mapping.
+// It's a local cache and not something to ship: it's written in the
+// machine's layout, and ASSET_CACHE_VERSION has to go up whenever Frame,
+// Animation or the layout of an entry changes. Deleting the directory is
+// always safe.
+
+#define ASSET_CACHE_DIR ".asset_cache"
+
+constexpr static u32 ASSET_CACHE_MAGIC = 0x48434152; // "RACH"
+constexpr static u32 ASSET_CACHE_VERSION = 1;
+
+enum AssetCacheKind
+{
+    AssetCacheKind_Image = 1,
+    AssetCacheKind_Anim = 2,
+};
+
+struct AssetCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u32 kind;
+    u32 file_size;
+    u64 source_hash;
+
+    // images: width, height. anims: n_frames, n_animations
+    u32 counts[2];
+    // images: pixels. anims: frames, animations, names
+    u32 offsets[3];
+    u32 reserved;
+};
+
+struct CachedImage
+{
+    u32 width;
+    u32 height;
+    // RGBA, in the mapping
+    ubyte* pixels;
+};
+
+u64 asset_cache_hash(const void* data, usize n_bytes);
+
+// defaults to ASSET_CACHE_DIR, relative to the working directory like the
+// resource paths are
+void asset_cache_set_dir(const char* dir);
+
+// A hit stays mapped for the rest of the run, the same as anything else
+// that's been loaded into the resource tables.
+b32 asset_cache_map_image(u64 source_hash, CachedImage* out);
+b32 asset_cache_store_image(u64 source_hash, u32 width, u32 height, const ubyte* pixels);
+
+// Fills in the frames and animations of a fresh AnimationResource.
+b32 asset_cache_map_anim(u64 source_hash, AnimationResource* resource);
+b32 asset_cache_store_anim(mem::Arena* scratch_arena, u64 source_hash, const AnimationResource* resource);
+
+} // namespace rigel
+
+#endif // RIGEL_ASSET_CACHE_H
@@ -5,40 +5,81 @@
 #include "rigelmath.h"
 
 #include <cstring>
+#include <cmath>
 
 namespace rigel {
 
 void
-entity_set_animation(Entity* entity, const char* anim_name)
+entity_set_animation(Entity* entity, PlayingAnimation* playing, const char* anim_name)
 {
     auto animations = get_anim_resource(entity->animations_id);
     auto animation = animations->animations.get(anim_name);
 
-    entity->animation.start_frame = animation->start_frame;
-    entity->animation.current_frame = animation->start_frame;
-    entity->animation.end_frame = animation->end_frame;
-    entity->animation.timer = 0.0f;
-    entity->animation.threshold = animations->frames[0].duration_ms / 1000.0f;
+    playing->start_frame = animation->start_frame;
+    playing->current_frame = animation->start_frame;
+    playing->end_frame = animation->end_frame;
+    playing->timer = 0.0f;
+    playing->threshold = animations->frames[0].duration_ms / 1000.0f;
 
     entity->current_animation = anim_name;
 }
 void
-entity_update_animation(Entity* entity, const char* anim_name)
+entity_update_animation(Entity* entity, PlayingAnimation* playing, const char* anim_name)
 {
     if (strcmp(entity->current_animation, anim_name) != 0)
     {
-        entity_set_animation(entity, anim_name);
+        entity_set_animation(entity, playing, anim_name);
     }
 }
 
-AABB
-entity_get_collider(Entity* entity)
+EntityComponents
+make_entity_components(mem::Arena* arena, usize capacity)
 {
-    AABB result = entity->colliders->aabbs[0];
-    result.center = entity->position + result.extents;
+    EntityComponents result;
+    result.count = 0;
+    result.capacity = capacity;
+    result.state = arena->alloc_array<EntityState>(capacity);
+    result.position = arena->alloc_array<m::Vec3>(capacity);
+    result.display_position = arena->alloc_array<m::Vec3>(capacity);
+    result.velocity = arena->alloc_array<m::Vec3>(capacity);
+    result.acceleration = arena->alloc_array<m::Vec3>(capacity);
+    result.old_accel = arena->alloc_array<m::Vec3>(capacity);
+    result.animation = arena->alloc_array<PlayingAnimation>(capacity);
     return result;
 }
 
+usize
+entity_components_push(EntityComponents* components)
+{
+    assert(components->count < components->capacity && "too many entity components!");
+    usize idx = components->count;
+    components->count++;
+
+    components->state[idx] = STATE_FALLING;
+    components->position[idx] = m::Vec3 {0};
+    components->display_position[idx] = m::Vec3 {0};
+    components->velocity[idx] = m::Vec3 {0};
+    components->acceleration[idx] = m::Vec3 {0};
+    components->old_accel[idx] = m::Vec3 {0};
+    components->animation[idx] = PlayingAnimation {};
+    return idx;
+}
+
+void
+entity_components_swap_remove(EntityComponents* components, usize idx)
+{
+    assert(idx < components->count && "bad component index");
+    usize last = components->count - 1;
+    components->state[idx] = components->state[last];
+    components->position[idx] = components->position[last];
+    components->display_position[idx] = components->display_position[last];
+    components->velocity[idx] = components->velocity[last];
+    components->acceleration[idx] = components->acceleration[last];
+    components->old_accel[idx] = components->old_accel[last];
+    components->animation[idx] = components->animation[last];
+    components->count--;
+}
+
 m::Vec3
 get_dda_step(m::Vec3 displacement)
 {
@@ -115,12 +156,122 @@ collides_with_level(AABB aabb, TileMap* tile_map, m::Vec3 entity_start_position)
 }
 
 
+// fudge for float error on positions that were clamped to a tile edge
+constexpr static f32 SWEEP_EDGE_EPS = 0.001f;
+
+static bool
+tile_blocks_sweep(TileMap* tile_map, i32 world_col, i32 world_row, m::Vec3 entity_start_position)
+{
+    if (world_col < 0 ||
+        world_col >= WORLD_WIDTH_TILES ||
+        world_row < 0 ||
+        world_row >= WORLD_HEIGHT_TILES)
+    {
+        return false;
+    }
+
+    // world rows count up from the bottom, tile rows count down from the top
+    i32 tile_y = WORLD_HEIGHT_TILES - world_row - 1;
+    TileType tile = tile_map->tiles[tile_to_index(world_col, tile_y)];
+    if (tile == TileType::EMPTY)
+    {
+        return false;
+    }
+
+    f32 tile_top = (world_row + 1) * TILE_HEIGHT_PIXELS;
+    if (tile == TileType::VERTICAL_ONEWAY && entity_start_position.y < tile_top)
+    {
+        return false;
+    }
+    return true;
+}
+
+// Sweeps the box [box_min, box_max] by `delta` along `axis` (0 = x, 1 = y) and
+// returns how far it can go before it would overlap a blocking tile. Walks the
+// grid one row/column at a time starting at the leading edge, so the cost is
+// proportional to the tiles crossed rather than the pixels moved.
+static f32
+sweep_box_against_level(m::Vec3 box_min,
+                        m::Vec3 box_max,
+                        i32 axis,
+                        f32 delta,
+                        TileMap* tile_map,
+                        m::Vec3 entity_start_position)
+{
+    if (delta == 0)
+    {
+        return 0;
+    }
+
+    const f32 tile_dim = TILE_WIDTH_PIXELS;
+    const i32 other_axis = 1 - axis;
+    const i32 n_lines = (axis == 0) ? WORLD_WIDTH_TILES : WORLD_HEIGHT_TILES;
+    const i32 n_lanes = (axis == 0) ? WORLD_HEIGHT_TILES : WORLD_WIDTH_TILES;
+
+    // the lanes the box covers on the other axis. Merely touching a lane doesn't count.
+    i32 lane_min = (i32)std::floor((box_min[other_axis] + SWEEP_EDGE_EPS) / tile_dim);
+    i32 lane_max = (i32)std::ceil((box_max[other_axis] - SWEEP_EDGE_EPS) / tile_dim) - 1;
+    lane_min = (lane_min < 0) ? 0 : lane_min;
+    lane_max = (lane_max >= n_lanes) ? n_lanes - 1 : lane_max;
+
+    auto blocks = [&](i32 line, i32 lane)
+    {
+        return (axis == 0)
+            ? tile_blocks_sweep(tile_map, line, lane, entity_start_position)
+            : tile_blocks_sweep(tile_map, lane, line, entity_start_position);
+    };
+
+    if (delta > 0)
+    {
+        f32 lead = box_max[axis];
+        i32 first = (i32)std::ceil((lead - SWEEP_EDGE_EPS) / tile_dim);
+        i32 last = (i32)std::ceil((lead + delta) / tile_dim) - 1;
+        first = (first < 0) ? 0 : first;
+        last = (last >= n_lines) ? n_lines - 1 : last;
+
+        for (i32 line = first; line <= last; line++)
+        {
+            for (i32 lane = lane_min; lane <= lane_max; lane++)
+            {
+                if (blocks(line, lane))
+                {
+                    return (line * tile_dim) - lead;
+                }
+            }
+        }
+    }
+    else
+    {
+        f32 lead = box_min[axis];
+        i32 first = (i32)std::floor((lead + SWEEP_EDGE_EPS) / tile_dim) - 1;
+        i32 last = (i32)std::floor((lead + delta) / tile_dim);
+        first = (first >= n_lines) ? n_lines - 1 : first;
+        last = (last < 0) ? 0 : last;
+
+        for (i32 line = first; line >= last; line--)
+        {
+            for (i32 lane = lane_min; lane <= lane_max; lane++)
+            {
+                if (blocks(line, lane))
+                {
+                    return ((line + 1) * tile_dim) - lead;
+                }
+            }
+        }
+    }
+
+    return delta;
+}
+
 EntityMoveResult
-move_entity(Entity* entity, TileMap* tile_map, f32 dt, f32 top_speed)
+move_entity(EntityComponents* components, usize idx, AABB collider, TileMap* tile_map, f32 dt, f32 top_speed)
 {
+    m::Vec3& position = components->position[idx];
+    m::Vec3& velocity = components->velocity[idx];
+
 #if 1
     // semi-implicit euler
-    m::Vec3 new_vel = entity->velocity + entity->acceleration * dt;
+    m::Vec3 new_vel = velocity + components->acceleration[idx] * dt;
     if (m::abs(new_vel.x) > top_speed)
     {
         new_vel.x = top_speed * m::signof(new_vel.x);
@@ -131,14 +282,14 @@ move_entity(Entity* entity, TileMap* tile_map, f32 dt, f32 top_speed)
         new_vel.x = 0;
     }
 
-    m::Vec3 new_pos = entity->position + new_vel * dt;
+    m::Vec3 new_pos = position + new_vel * dt;
 #else
     // velocity verlet
     f32 dt2 = dt*dt;
-    m::Vec3 new_pos = entity->position + (entity->velocity * dt) + (entity->old_accel*dt2*0.5f);
-    m::Vec3 new_acc = entity->acceleration;
-    m::Vec3 new_vel = entity->velocity + ((entity->old_accel + new_acc) * dt * 0.5f);
-    entity->old_accel = new_acc;
+    m::Vec3 new_pos = position + (velocity * dt) + (components->old_accel[idx]*dt2*0.5f);
+    m::Vec3 new_acc = components->acceleration[idx];
+    m::Vec3 new_vel = velocity + ((components->old_accel[idx] + new_acc) * dt * 0.5f);
+    components->old_accel[idx] = new_acc;
     if (m::abs(new_vel.x) > top_speed)
     {
         new_vel.x = top_speed * m::signof(new_vel.x);
@@ -152,110 +303,59 @@ move_entity(Entity* entity, TileMap* tile_map, f32 dt, f32 top_speed)
 
 
 
-    CollisionResult min_collision_result;
-
-    m::Vec3 dest_pixel = m::floor(new_pos);
-    m::Vec3 dest_fract = m::fract(new_pos);
-
-    m::Vec3 entity_pixel_position = m::floor(entity->position);// + m::Vec3{0.5f, 0.5f, 0.0f};
-
-    AABB entity_aabb = entity_get_collider(entity);
-    b32 we_found_one = false;
-    b32 collided[9] = {0};
+    // sweep x first, then y. Each sweep only visits the tile rows/columns the
+    // leading edge of the box crosses on its way to the destination.
+    AABB entity_aabb = collider;
+    entity_aabb.center = position + entity_aabb.extents;
     EntityMoveResult move_result{};
     move_result.collision_happened = false;
-    f32 sqdist_to_dest;
-
-    while (true) // TODO: we should really limit this
-    {
-        m::Vec3 current_displacement = new_pos - (entity_pixel_position);
-        sqdist_to_dest = m::dot(current_displacement, current_displacement);
-        m::Vec3 best_so_far = entity_pixel_position;
-        we_found_one = false;
-
-        for (i32 y = -1; y < 2; y++)
-        {
-            for (i32 x = -1; x < 2; x++)
-            {
-                m::Vec3 offset {(f32)x, (f32)y, 0.0f};
-                m::Vec3 test_center = entity_pixel_position + offset;
-
-                entity_aabb.center = test_center + entity_aabb.extents;
-
-                m::Vec3 test_displacement = new_pos - test_center;
-                f32 test_sqdist = m::dot(test_displacement, test_displacement);
 
-                i32 i = ((2 - (y + 1)) * 3) + (x + 1);
-                collided[i] = collides_with_level(entity_aabb, tile_map, entity->position);
+    m::Vec3 displacement = new_pos - position;
+    m::Vec3 box_min = position;
+    m::Vec3 box_max = position + (entity_aabb.extents * 2.0f);
 
-                bool contains_dest = test_center.x == dest_pixel.x && test_center.y == dest_pixel.y;
-
-                if (contains_dest || test_sqdist <= sqdist_to_dest)
-                {
-                    if (!collided[i])
-                    {
-                        sqdist_to_dest = contains_dest ? 0 : test_sqdist;
-                        best_so_far = test_center;
-                        we_found_one = !(x == 0 && y == 0);
-                    }
-                    else
-                    {
-                        move_result.collision_happened = true;
-                        // TODO(spencer): bouncing would go here
-                    }
-                }
-                move_result.collided[i] = collided[i];
-            }
-        }
-
-        entity_pixel_position = best_so_far;
-        if (!we_found_one)
-        {
-            new_pos = entity_pixel_position;
-            break;
-        }
-
-        for (i32 i = 0; i < 9; i++)
-        {
-            collided[i] = false;
-        }
+    f32 moved_x = sweep_box_against_level(box_min, box_max, 0, displacement.x, tile_map, position);
+    if (moved_x != displacement.x)
+    {
+        move_result.collision_happened = true;
+        new_vel.x = 0;
     }
+    box_min.x += moved_x;
+    box_max.x += moved_x;
 
-    // check if we can add the fractional part to velocity
-    // NOTE: this is sufficient as long as the level colliders are all pixel-aligned.
-    // If that ever changes then we will need a more sophisticated refinement step.
-    new_pos = m::floor(new_pos);
-    if (new_vel.x != 0) {
-        i32 x_check = new_vel.x > 0 ? 5 : 3;
-        if (collided[x_check])
-        {
-            std::cout << "hit it, x_check is " << x_check << std::endl;
-            dest_fract.x = 0;
-            new_vel.x = 0;
-        }
-        i32 y_check = new_vel.y > 0 ? 1 : 7;
-        if (collided[y_check])
-        {
-            dest_fract.y = 0;
-            new_vel.y = 0;
-        }
+    f32 moved_y = sweep_box_against_level(box_min, box_max, 1, displacement.y, tile_map, position);
+    if (moved_y != displacement.y)
+    {
+        move_result.collision_happened = true;
+        new_vel.y = 0;
     }
 
-    entity_aabb.center = new_pos + entity_aabb.extents + dest_fract;
+    new_pos.x = position.x + moved_x;
+    new_pos.y = position.y + moved_y;
 
-    if (sqdist_to_dest == 0 && !collides_with_level(entity_aabb, tile_map, entity->position))
+    // probe the pixels around where we ended up so callers can tell what
+    // we're touching (ground below, walls to either side, etc.)
+    m::Vec3 entity_pixel_position = m::floor(new_pos);
+    for (i32 y = -1; y < 2; y++)
     {
-        new_pos = new_pos + dest_fract;
+        for (i32 x = -1; x < 2; x++)
+        {
+            m::Vec3 offset {(f32)x, (f32)y, 0.0f};
+            entity_aabb.center = entity_pixel_position + offset + entity_aabb.extents;
+
+            i32 i = ((2 - (y + 1)) * 3) + (x + 1);
+            move_result.collided[i] = collides_with_level(entity_aabb, tile_map, position);
+        }
     }
 
 #define MOVE_ALONG_DDA_LINE 0
 #if MOVE_ALONG_DDA_LINE
-    m::Vec3 new_displacement = entity_aabb.center - entity->position;
+    m::Vec3 new_displacement = entity_aabb.center - position;
 
     if ((m::abs(new_displacement.x) >= 1 || m::abs(new_displacement.y) >= 1) ||
         (new_displacement.x == 0 && new_displacement.y == 0))
     {
-        entity->display_position = new_pos;
+        components->display_position[idx] = new_pos;
     } 
     else 
     {
@@ -276,43 +376,77 @@ move_entity(Entity* entity, TileMap* tile_map, f32 dt, f32 top_speed)
         dx = dx / step;
         dy = dy / step;
 
-        m::Vec3 extrapolated = m::floor(entity->position + m::Vec3 {dx, dy, 0});
+        m::Vec3 extrapolated = m::floor(position + m::Vec3 {dx, dy, 0});
         m::Vec3 target = m::floor(new_pos);
         target.z = 0;
 
         if (extrapolated == target) {
-            entity->display_position = m::round(new_pos);
+            components->display_position[idx] = m::round(new_pos);
         }
         else
         {
-            entity->display_position = m::floor(entity->position);
+            components->display_position[idx] = m::floor(position);
         }
     }
     // finally we can update the position.
-    entity->position = new_pos;
+    position = new_pos;
 #else
-    entity->position = new_pos;
-    entity->display_position = m::floor(new_pos);
+    position = new_pos;
+    components->display_position[idx] = m::floor(new_pos);
 #endif
 
-    /*
-    if (sqdist_to_dest != 0)
-    {
-        m::Vec3 to_dest = dest_pixel - new_pos;
-        i32 x_idx = (to_dest.x > 0) ? 5 : 3;
-        i32 y_idx = (to_dest.y > 0) ? 1 : 7;
-
-        if (to_dest.x != 0 && collided[x_idx]) {
-            new_vel.x = 0;
-        }
-        if (to_dest.y != 0 && collided[y_idx]) {
-            new_vel.y = 0;
-        }
-    }
-    */
-    entity->velocity = new_vel;
+    velocity = new_vel;
 
     return move_result;
 }
 
 }
+
+#include "doctest.h"
+
+TEST_CASE("move_entity lands fast fallers on the ground and lets them up through one-way tiles")
+{
+    using namespace rigel;
+
+    static TileType tiles[WORLD_SIZE_TILES];
+    static TileMap map;
+    map.tiles = tiles;
+    for (usize i = 0; i < WORLD_SIZE_TILES; i++)
+    {
+        map.tiles[i] = TileType::EMPTY;
+    }
+    // solid floor on the bottom row, a one-way platform 10 tiles up
+    for (usize x = 0; x < WORLD_WIDTH_TILES; x++)
+    {
+        map.tiles[tile_to_index(x, WORLD_HEIGHT_TILES - 1)] = TileType::WALL;
+        map.tiles[tile_to_index(x, WORLD_HEIGHT_TILES - 11)] = TileType::VERTICAL_ONEWAY;
+    }
+
+    AABB collider = aabb_from_rect(Rectangle { 0, 0, 8, 16 });
+
+    static ubyte backing[ONE_PAGE];
+    mem::Arena arena(backing, ONE_PAGE);
+    EntityComponents components = make_entity_components(&arena, 1);
+    usize e = entity_components_push(&components);
+    components.position[e] = m::Vec3 { 20, 60, 0 };
+    components.velocity[e] = m::Vec3 { 0, -5000, 0 };
+
+    auto result = move_entity(&components, e, collider, &map, 1.0f / 60.0f);
+
+    CHECK(components.position[e].y == TILE_HEIGHT_PIXELS);
+    CHECK(components.velocity[e].y == 0);
+    CHECK(result.collided[7]);
+    CHECK(!result.collided[3]);
+    CHECK(!result.collided[5]);
+
+    // jump up through the platform...
+    components.velocity[e] = m::Vec3 { 0, 6000, 0 };
+    move_entity(&components, e, collider, &map, 1.0f / 60.0f);
+    CHECK(components.position[e].y > 11 * TILE_HEIGHT_PIXELS);
+
+    // ...and land on top of it on the way back down
+    components.velocity[e] = m::Vec3 { 0, -6000, 0 };
+    result = move_entity(&components, e, collider, &map, 1.0f / 60.0f);
+    CHECK(components.position[e].y == 11 * TILE_HEIGHT_PIXELS);
+    CHECK(result.collided[7]);
+}
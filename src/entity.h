@@ -79,6 +79,8 @@ struct PlayingAnimation
     f32 threshold;
 };
 
+// The cold half of an entity. The fields the simulation touches every tick
+// live in EntityComponents.
 struct Entity
 {
     EntityId id;
@@ -86,23 +88,43 @@ struct Entity
     ResourceId sprite_id;
     i32 new_sprite_id;
 
-    EntityState state;
-
-    m::Vec3 position;
-    m::Vec3 display_position;
-    m::Vec3 velocity;
-    m::Vec3 acceleration;
-    m::Vec3 old_accel;
-
     ZeroCrossTrigger facing_dir;
     ResourceId animations_id;
     const char* current_animation;
-    PlayingAnimation animation;
 
     // TODO: this should just be a rectangle. No multiple colliders.
     ColliderSet* colliders;
 };
 
+// Hot per-entity fields, one array per component so a pass that only needs
+// one or two of them streams through just those. Packed: [0, count) are the
+// live entities, in the same order as their chunk's live_entities list.
+struct EntityComponents
+{
+    usize count;
+    usize capacity;
+
+    EntityState* state;
+    m::Vec3* position;
+    m::Vec3* display_position;
+    m::Vec3* velocity;
+    m::Vec3* acceleration;
+    m::Vec3* old_accel;
+    PlayingAnimation* animation;
+};
+
+EntityComponents
+make_entity_components(mem::Arena* arena, usize capacity);
+
+// appends a zeroed entry and returns its index
+usize
+entity_components_push(EntityComponents* components);
+
+// moves the last entry into idx, so the caller has to fix up whatever
+// pointed at the last entry
+void
+entity_components_swap_remove(EntityComponents* components, usize idx);
+
 struct EntityMoveResult
 {
     bool collision_happened;
@@ -110,47 +132,47 @@ struct EntityMoveResult
 };
 
 EntityMoveResult
-move_entity(Entity* entity, TileMap* tile_map, f32 dt, f32 top_speed = 120);
+move_entity(EntityComponents* components, usize idx, AABB collider, TileMap* tile_map, f32 dt, f32 top_speed = 120);
 bool
 collides_with_level(AABB aabb, TileMap* tile_map, m::Vec3 displacement);
 void
-entity_set_animation(Entity* entity, const char* anim_name);
+entity_set_animation(Entity* entity, PlayingAnimation* animation, const char* anim_name);
 void
-entity_update_animation(Entity* entity, const char* anim_name);
+entity_update_animation(Entity* entity, PlayingAnimation* animation, const char* anim_name);
 
-inline bool state_transition_air_to_land(Entity* e)
+inline bool state_transition_air_to_land(EntityState* state)
 {
-    if (e->state == STATE_JUMPING || e->state == STATE_FALLING)
+    if (*state == STATE_JUMPING || *state == STATE_FALLING)
     {
-        e->state = STATE_ON_LAND;
+        *state = STATE_ON_LAND;
         return true;
     }
     return false;
 }
 
-inline bool state_transition_land_to_jump(Entity* e)
+inline bool state_transition_land_to_jump(EntityState* state)
 {
-    if (e->state == STATE_ON_LAND)
+    if (*state == STATE_ON_LAND)
     {
-        e->state = STATE_JUMPING;
+        *state = STATE_JUMPING;
         return true;
     }
     return false;
 }
 
-inline bool state_transition_land_to_fall(Entity* e)
+inline bool state_transition_land_to_fall(EntityState* state)
 {
-    if (e->state == STATE_ON_LAND)
+    if (*state == STATE_ON_LAND)
     {
-        e->state = STATE_FALLING;
+        *state = STATE_FALLING;
         return true;
     }
     return false;
 }
 
-inline bool state_transition_fall_exclusive(Entity* e)
+inline bool state_transition_fall_exclusive(EntityState* state)
 {
-    e->state = STATE_FALLING;
+    *state = STATE_FALLING;
     return true;
 }
 
@@ -2,10 +2,12 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace rigel {
 
-ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name)
+ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name, usize* out_size)
 {
     int fd = open(file_name, O_RDONLY);
     if (fd < 0) {
@@ -19,7 +21,9 @@ ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name)
     }
     lseek(fd, 0, SEEK_SET);
 
-    ubyte* buffer = dest->alloc_array<ubyte>(size_in_bytes);
+    // one extra for a terminator so text can be parsed straight out of the
+    // buffer. It isn't counted in out_size.
+    ubyte* buffer = dest->alloc_array<ubyte>(size_in_bytes + 1);
     i32 n_read = 0;
     while (n_read < size_in_bytes) {
         i32 this_read = read(fd, buffer + n_read, size_in_bytes - n_read);
@@ -29,10 +33,91 @@ ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name)
         n_read += this_read;
     }
     close(fd);
+    buffer[n_read] = 0;
+
+    if (out_size) {
+        *out_size = n_read;
+    }
 
     return buffer;
 }
 
+b32 dump_to_file(const char* file_name, const void* data, usize n_bytes)
+{
+    FileChunk chunk = { data, n_bytes };
+    return dump_chunks_to_file(file_name, &chunk, 1);
+}
+
+b32 dump_chunks_to_file(const char* file_name, const FileChunk* chunks, u32 n_chunks)
+{
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    b32 ok = true;
+    for (u32 c = 0; ok && c < n_chunks; c++) {
+        const ubyte* bytes = reinterpret_cast<const ubyte*>(chunks[c].data);
+        usize n_bytes = chunks[c].n_bytes;
+        usize n_written = 0;
+        while (n_written < n_bytes) {
+            i32 this_write = write(fd, bytes + n_written, n_bytes - n_written);
+            if (this_write <= 0) {
+                break;
+            }
+            n_written += this_write;
+        }
+        ok = n_written == n_bytes;
+    }
+    close(fd);
+
+    return ok;
+}
+
+b32 map_file(const char* file_name, MappedFile* out)
+{
+    *out = MappedFile { nullptr, 0 };
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    out->data = reinterpret_cast<ubyte*>(data);
+    out->size = info.st_size;
+    return true;
+}
+
+void unmap_file(MappedFile* file)
+{
+    if (file->data) {
+        munmap(file->data, file->size);
+    }
+    *file = MappedFile { nullptr, 0 };
+}
+
+i64 file_mtime_ns(const char* file_name)
+{
+    struct stat info;
+    if (stat(file_name, &info) < 0) {
+        return -1;
+    }
+    return ((i64)info.st_mtim.tv_sec * 1000000000) + info.st_mtim.tv_nsec;
+}
+
 namespace fs
 {
 
@@ -11,7 +11,32 @@
 
 namespace rigel {
 
-ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name);
+ubyte* slurp_into_mem(mem::Arena* dest, const char* file_name, usize* out_size = nullptr);
+b32 dump_to_file(const char* file_name, const void* data, usize n_bytes);
+
+// Writes the chunks one after the other, as if they were one buffer, so
+// they don't have to be copied together first.
+struct FileChunk
+{
+    const void* data;
+    usize n_bytes;
+};
+
+b32 dump_chunks_to_file(const char* file_name, const FileChunk* chunks, u32 n_chunks);
+
+// A private, copy-on-write mapping of a whole file. Writes through it never
+// make it back to the file.
+struct MappedFile
+{
+    ubyte* data;
+    usize size;
+};
+
+b32 map_file(const char* file_name, MappedFile* out);
+void unmap_file(MappedFile* file);
+
+// modification time in ns, or -1 if the file doesn't exist
+i64 file_mtime_ns(const char* file_name);
 
 namespace fs
 {
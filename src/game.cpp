@@ -7,6 +7,7 @@
 #include "debug.h"
 #include "input.h"
 #include "world.h"
+#include "spatial_grid.h"
 
 namespace rigel {
 
@@ -14,9 +15,14 @@ namespace rigel {
 // zonetrigger: does the player overlap with the zone?
 TEST_TRIGGER_FN(ZoneTrigger)
 {
-    auto player = game_state->active_world_chunk->entities + game_state->active_world_chunk->player_id;
+    auto chunk = game_state->active_world_chunk;
+    auto player = get_player(chunk);
+    if (!player)
+    {
+        return false;
+    }
     auto player_aabb = player->colliders->aabbs[0];
-    player_aabb.center = player->position + player_aabb.extents;
+    player_aabb.center = chunk->components.position[chunk->component_idx(player)] + player_aabb.extents;
 
     auto zone_aabb = aabb_from_rect(data->rect);
 
@@ -36,7 +42,7 @@ EFFECT_FN(SpawnEntity)
 EntityPrototype entity_prototypes[EntityType_NumberOfTypes];
 
 Direction
-check_for_level_change(Entity* player)
+check_for_level_change(Entity* player, m::Vec3 player_position)
 {
     // TODO(spencer): looking at center pos isn't the best because we may end up
     // letting the player move further than they would otherwise be allowed to causing
@@ -44,7 +50,7 @@ check_for_level_change(Entity* player)
     // Ideally the player shouldn't be too concerned with off-screen walls and the level
     // design should make sure they don't have to be, but we should also be robust enough
     // to handle it.
-    auto player_center = player->position + player->colliders->aabbs[0].extents;
+    auto player_center = player_position + player->colliders->aabbs[0].extents;
 
     if (player_center.x < 0)
     {
@@ -65,48 +71,116 @@ check_for_level_change(Entity* player)
     return Direction_Stay;
 }
 
+// what the prototypes file says about one entity type. The strings point into
+// the text resource, which sticks around.
+struct PrototypeInfo
+{
+    JsonString sprite_info;
+    JsonString spritesheet;
+    f32 collider_width;
+    f32 collider_height;
+};
+
 // TODO(spencer): prototypes are a resource
 void
 load_entity_prototypes(mem::GameMem& memory, const char* filepath)
 {
     TextResource entity_protos = load_text_resource(filepath);
-    auto root_v = parse_json_string(&memory.frame_temp_arena, entity_protos.text);
-    assert(root_v->type == JSON_OBJECT && "couldn't parse entity protos");
-    auto root = root_v->object;
-    char path_buf[256];
 
-    // load entity prototypes
+    // The file is keyed by entity type, but the prototypes are set up in type
+    // order so the anim and image resources get loaded in a stable order.
+    PrototypeInfo infos[EntityType_NumberOfTypes] = {};
+
+    JsonReader reader;
+    json_reader_init(&reader, &memory.frame_temp_arena, entity_protos.text, entity_protos.length);
+    json_read_object_begin(&reader);
+    assert(!reader.error && "couldn't parse entity protos");
+
+    JsonString type_key;
+    while (json_next_key(&reader, &type_key))
+    {
+        char type_buf[64];
+        json_str_copy(type_buf, &type_key, sizeof(type_buf));
+        EntityType type = get_entity_type_for_str(type_buf);
+        if (type == EntityType_NumberOfTypes)
+        {
+            json_skip_value(&reader);
+            continue;
+        }
+
+        auto info = infos + type;
+        JsonString key;
+        json_read_object_begin(&reader);
+        while (json_next_key(&reader, &key))
+        {
+            if (json_str_equals(key, "sprite_info", 11))
+            {
+                info->sprite_info = json_read_string(&reader);
+            }
+            else if (json_str_equals(key, "spritesheet", 11))
+            {
+                info->spritesheet = json_read_string(&reader);
+            }
+            else if (json_str_equals(key, "collider_width", 14))
+            {
+                info->collider_width = json_read_number(&reader);
+            }
+            else if (json_str_equals(key, "collider_height", 15))
+            {
+                info->collider_height = json_read_number(&reader);
+            }
+            else
+            {
+                json_skip_value(&reader);
+            }
+        }
+    }
+    assert(!reader.error && "couldn't parse entity protos");
+
+    // anims first, they say how many frames each sprite sheet has
+    AnimationResource* anims[EntityType_NumberOfTypes];
+    char spritesheet_paths[EntityType_NumberOfTypes][256];
+    ImageLoadRequest images[EntityType_NumberOfTypes + 1];
+
     for (usize type = 0;
          type < EntityType_NumberOfTypes;
          type++)
     {
-        const char* key = get_str_for_entity_type((EntityType)type);
-
-        auto jsonv = jsonobj_get(root, key, strlen(key));
-        auto obj = jsonv->object;
-
-        auto entity_proto = entity_prototypes + type;
+        auto info = infos + type;
+        assert(info->sprite_info.start && info->spritesheet.start && "entity type has no prototype");
 
         char sprite_info_buf[256];
-        auto entity_sprite_info = jsonobj_get(obj, "sprite_info", 11);
-        json_str_copy(sprite_info_buf, entity_sprite_info->string);
+        json_str_copy(sprite_info_buf, &info->sprite_info, sizeof(sprite_info_buf));
 
         auto checkpoint = memory.frame_temp_arena.checkpoint();
         auto arena = memory.frame_temp_arena.alloc_sub_arena(64 * ONE_PAGE);
         std::cout << "Loading info from '" << sprite_info_buf << "'" << std::endl;
-        auto anim = get_or_load_anim_resource(&arena, sprite_info_buf);
+        anims[type] = get_or_load_anim_resource(&arena, sprite_info_buf);
 
         memory.frame_temp_arena.restore_zeroed(checkpoint);
 
-        auto entity_sprite = jsonobj_get(obj, "spritesheet", 11);
-        json_str_copy(path_buf, entity_sprite->string);
+        json_str_copy(spritesheet_paths[type], &info->spritesheet, sizeof(spritesheet_paths[type]));
+        images[type] = ImageLoadRequest { spritesheet_paths[type], anims[type]->n_frames };
+    }
+
+    // The tile sheet isn't ours, but it's the biggest image by far, so it
+    // decodes alongside the sprite sheets rather than on its own when the
+    // first chunk loads.
+    images[EntityType_NumberOfTypes] = ImageLoadRequest { TILE_SHEET_PATH, 1 };
+    load_image_resources(images, EntityType_NumberOfTypes + 1);
+
+    // load entity prototypes
+    for (usize type = 0;
+         type < EntityType_NumberOfTypes;
+         type++)
+    {
+        auto info = infos + type;
+        auto entity_proto = entity_prototypes + type;
+        auto anim = anims[type];
 
-        auto collider_width = jsonobj_get(obj, "collider_width", 14)->number->value;
-        auto collider_height = jsonobj_get(obj, "collider_height", 15)->number->value;
-        Rectangle entity_collider { 0, 0, collider_width, collider_height };
+        Rectangle entity_collider { 0, 0, info->collider_width, info->collider_height };
 
-        // TODO
-        auto resource = get_or_load_image_resource(path_buf, anim->n_frames);
+        auto resource = get_image_resource(spritesheet_paths[type]);
         entity_proto->spritesheet = resource;
         entity_proto->animation_id = anim->id;
         entity_proto->collider_dims = entity_collider;
@@ -114,18 +188,107 @@ load_entity_prototypes(mem::GameMem& memory, const char* filepath)
     }
 }
 
-WorldChunk* load_all_world_chunks(mem::GameMem& memory)
+// holds a chunk's WorldChunk, entity storage and tilemaps
+constexpr static usize CHUNK_ARENA_BYTES = ONE_MB;
+
+static WorldChunk*
+load_overworld_chunk(mem::GameMem& memory, GameState* state, u32 grid_idx, mem::Arena* chunk_arena)
 {
-    // TODO: we should be getting chunk indexes from a resource
-    // archive of some sort. We're nearing the point where we're
-    // ready to start crafting a format for that.
-    WorldChunk* starting_chunk = load_world_chunk(memory, "resource/map/testoutdoor.tmj");
-    starting_chunk->level_index = 0;
+    const char* file_path = state->overworld_files.items[grid_idx];
+    assert(file_path && "no level in that overworld cell");
+
+    u32 grid_width = state->overworld_dims.x;
+    m::Vec2 coord { (f32)(grid_idx % grid_width), (f32)(grid_idx / grid_width) };
 
-    WorldChunk* other_chunk = load_world_chunk(memory, "resource/map/next.tmj");
-    other_chunk->level_index = 1;
+    std::cout << "Loading " << file_path << " at " << coord << std::endl;
+    WorldChunk* chunk = load_world_chunk(memory, chunk_arena, file_path);
+    chunk->overworld_coords = coord;
 
-    return starting_chunk;
+    auto map = chunk->active_map;
+    tilemap_set_up_and_buffer(map, &memory.frame_temp_arena);
+    tilemap_set_up_and_buffer(map->background, &memory.frame_temp_arena);
+    tilemap_set_up_and_buffer(map->decoration, &memory.frame_temp_arena);
+
+    state->overworld_grid.items[grid_idx] = chunk;
+    return chunk;
+}
+
+// Makes the chunk at center_idx and its 4-neighbourhood resident, dropping
+// whatever else was loaded to make room.
+static void
+stream_world_chunks(mem::GameMem& memory, GameState* state, u32 center_idx)
+{
+    i32 grid_width = state->overworld_dims.x;
+    i32 grid_height = state->overworld_dims.y;
+    i32 center_x = center_idx % grid_width;
+    i32 center_y = center_idx / grid_width;
+
+    i32 wanted[MAX_RESIDENT_CHUNKS];
+    i32 n_wanted = 0;
+    Direction dirs[] = { Direction_Stay, Direction_Up, Direction_Right, Direction_Down, Direction_Left };
+    for (Direction dir : dirs)
+    {
+        m::Vec2 offset = dir_to_vec(dir);
+        i32 x = center_x + (i32)offset.x;
+        i32 y = center_y + (i32)offset.y;
+        if (x < 0 || y < 0 || x >= grid_width || y >= grid_height)
+        {
+            continue;
+        }
+
+        i32 idx = (y * grid_width) + x;
+        if (state->overworld_files.items[idx])
+        {
+            wanted[n_wanted++] = idx;
+        }
+    }
+
+    for (i32 s = 0; s < MAX_RESIDENT_CHUNKS; s++)
+    {
+        ChunkSlot* slot = state->chunk_slots + s;
+        if (slot->grid_idx < 0)
+        {
+            continue;
+        }
+
+        b32 keep = false;
+        for (i32 w = 0; w < n_wanted; w++)
+        {
+            keep = keep || (wanted[w] == slot->grid_idx);
+        }
+        if (keep)
+        {
+            continue;
+        }
+
+        std::cout << "Releasing " << state->overworld_files.items[slot->grid_idx] << std::endl;
+        release_world_chunk(state->overworld_grid.items[slot->grid_idx]);
+        state->overworld_grid.items[slot->grid_idx] = nullptr;
+        // chunks expect to be loaded into zeroed memory
+        slot->arena.reinit_zeroed();
+        slot->grid_idx = -1;
+    }
+
+    for (i32 w = 0; w < n_wanted; w++)
+    {
+        if (state->overworld_grid.items[wanted[w]])
+        {
+            continue;
+        }
+
+        ChunkSlot* free_slot = nullptr;
+        for (i32 s = 0; s < MAX_RESIDENT_CHUNKS && !free_slot; s++)
+        {
+            if (state->chunk_slots[s].grid_idx < 0)
+            {
+                free_slot = state->chunk_slots + s;
+            }
+        }
+        assert(free_slot && "out of chunk slots");
+
+        free_slot->grid_idx = wanted[w];
+        load_overworld_chunk(memory, state, wanted[w], &free_slot->arena);
+    }
 }
 
 // TODO(spencer): This is half-baked.
@@ -138,48 +301,62 @@ void switch_world_chunk(mem::GameMem& mem, GameState* state, Direction dir)
     u32 next_chunk_idx = (new_coord.y * overworld_dims.x) + new_coord.x;
     assert(next_chunk_idx < state->overworld_grid.length && "Overflow overworld");
     auto next_chunk = state->overworld_grid.items[next_chunk_idx];
+    assert(next_chunk && "switching to a chunk that isn't loaded");
 
-    auto player = active_chunk->entities + active_chunk->player_id;
-    if (next_chunk->player_id == ENTITY_ID_NONE)
+    auto player = get_player(active_chunk);
+    auto from = &active_chunk->components;
+    usize from_idx = active_chunk->component_idx(player);
+    if (!get_player(next_chunk))
     {
-        next_chunk->player_id = next_chunk->add_entity(mem, player->type, player->position);
+        next_chunk->player_id = next_chunk->add_entity(mem, player->type, from->position[from_idx]);
     }
 
-    auto other_player = next_chunk->entities + next_chunk->player_id;
-    other_player->state = player->state;
-    other_player->position = player->position;
-    other_player->velocity = player->velocity;
-    other_player->acceleration = player->acceleration;
+    auto other_player = get_player(next_chunk);
+    auto to = &next_chunk->components;
+    usize to_idx = next_chunk->component_idx(other_player);
+    to->state[to_idx] = from->state[from_idx];
+    to->position[to_idx] = from->position[from_idx];
+    to->velocity[to_idx] = from->velocity[from_idx];
+    to->acceleration[to_idx] = from->acceleration[from_idx];
     other_player->facing_dir = player->facing_dir;
 
+    m::Vec3* other_player_position = to->position + to_idx;
+
     switch (dir)
     {
         case Direction_Up:
         {
-            other_player->position.y = other_player->position.y - (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS);
+            other_player_position->y = other_player_position->y - (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS);
         } break;
         case Direction_Right:
         {
-            other_player->position.x = other_player->position.x - (WORLD_WIDTH_TILES * TILE_WIDTH_PIXELS);
+            other_player_position->x = other_player_position->x - (WORLD_WIDTH_TILES * TILE_WIDTH_PIXELS);
         } break;
         case Direction_Down:
         {
-            other_player->position.y = other_player->position.y + (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS);
+            other_player_position->y = other_player_position->y + (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS);
         } break;
         case Direction_Left:
         {
-            other_player->position.x = other_player->position.x + (WORLD_WIDTH_TILES * TILE_WIDTH_PIXELS);
+            other_player_position->x = other_player_position->x + (WORLD_WIDTH_TILES * TILE_WIDTH_PIXELS);
         } break;
         default:
             break;
     }
     //????
-    if (other_player->position.x < 0)
+    if (other_player_position->x < 0)
     {
-        other_player->position.x = 0;
+        other_player_position->x = 0;
     }
 
     state->active_world_chunk = next_chunk;
+
+    if (state->stream_chunks)
+    {
+        // the chunk we just left is one of the new neighbours, so it sticks
+        // around for the rest of this tick
+        stream_world_chunks(mem, state, next_chunk_idx);
+    }
 }
 
 struct OverworldLevel
@@ -242,10 +419,23 @@ load_stage(mem::GameMem& memory, const char* stage_dir, GameState* state)
     }
 
     m::Vec2 overworld_dims {x_range.y - x_range.x + 1, y_range.y - y_range.x + 1};
+    usize n_cells = overworld_dims.x * overworld_dims.y;
 
-    auto overworld = mem::make_simple_list<WorldChunk*>(overworld_dims.x * overworld_dims.y, &memory.stage_arena);
+    auto overworld = mem::make_simple_list<WorldChunk*>(n_cells, &memory.stage_arena);
+    auto overworld_files = mem::make_simple_list<char*>(n_cells, &memory.stage_arena);
+    overworld.length = n_cells;
+    overworld_files.length = n_cells;
+    for (usize i = 0; i < n_cells; i++)
+    {
+        overworld.items[i] = nullptr;
+        overworld_files.items[i] = nullptr;
+    }
 
-    WorldChunk* first_world_chunk = nullptr;
+    state->overworld_dims = overworld_dims;
+    state->overworld_grid = overworld;
+    state->overworld_files = overworld_files;
+
+    u32 first_level_idx = 0;
     for (u32 i = 0; i < level_list.length; i++)
     {
         auto level = level_list.items + i;
@@ -256,37 +446,52 @@ load_stage(mem::GameMem& memory, const char* stage_dir, GameState* state)
         auto n_printed = snprintf(filepath_buf, 256, "%s/", stage_dir);
         json_str_copy(filepath_buf + n_printed, level->file_name);
 
-        std::cout << "Loading " << filepath_buf << " at " << level_coord << std::endl;
-        overworld.items[level_idx] = load_world_chunk(memory, filepath_buf);
-        overworld.items[level_idx]->overworld_coords = level_coord;
+        usize path_len = strlen(filepath_buf);
+        char* path = memory.stage_arena.alloc_array<char>(path_len + 1);
+        memcpy(path, filepath_buf, path_len + 1);
+        overworld_files.items[level_idx] = path;
+
         if (level->x == 0 && level->y == 0)
         {
-            first_world_chunk = overworld.items[level_idx];
+            first_level_idx = level_idx;
         }
+    }
 
-        auto map = overworld.items[level_idx]->active_map;
-        tilemap_set_up_and_buffer(map, &memory.frame_temp_arena);
-        tilemap_set_up_and_buffer(map->background, &memory.frame_temp_arena);
-        tilemap_set_up_and_buffer(map->decoration, &memory.frame_temp_arena);
+    if (state->stream_chunks)
+    {
+        for (i32 i = 0; i < MAX_RESIDENT_CHUNKS; i++)
+        {
+            state->chunk_slots[i].arena = memory.stage_arena.reserve_sub_arena(CHUNK_ARENA_BYTES);
+            state->chunk_slots[i].grid_idx = -1;
+        }
+
+        stream_world_chunks(memory, state, first_level_idx);
+    }
+    else
+    {
+        for (u32 i = 0; i < n_cells; i++)
+        {
+            if (overworld_files.items[i])
+            {
+                mem::Arena chunk_arena = memory.stage_arena.reserve_sub_arena(CHUNK_ARENA_BYTES);
+                load_overworld_chunk(memory, state, i, &chunk_arena);
+            }
+        }
     }
 
-    overworld.length = overworld.capacity; // lmao bad choice
-    state->overworld_dims = overworld_dims;
-    state->overworld_grid = overworld;
-    state->first_world_chunk = first_world_chunk;
-    state->active_world_chunk = first_world_chunk;
+    state->first_world_chunk = overworld.items[first_level_idx];
+    state->active_world_chunk = state->first_world_chunk;
 }
 
 GameState*
-load_game(mem::GameMem& memory)
+load_game(mem::GameMem& memory, b32 stream_chunks)
 {
     GameState* result = initialize_game_state(memory);
+    result->stream_chunks = stream_chunks;
 
     load_entity_prototypes(memory, "resource/entity/entities.json");
 
     load_stage(memory, "resource/tiled/stage_1", result);
-    //result->first_world_chunk = load_all_world_chunks(memory);
-    //result->active_world_chunk = result->first_world_chunk;
 
     return result;
 }
@@ -300,27 +505,49 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
     auto world_chunk = game_state->active_world_chunk;
 
     // TODO: use game_state->player_id
-    auto player = game_state->active_world_chunk->entities + game_state->active_world_chunk->player_id;
+    auto player = get_player(game_state->active_world_chunk);
 
-    auto dir = check_for_level_change(player);
-    if (dir != Direction_Stay)
+    if (player)
     {
-        switch_world_chunk(memory, game_state, dir);
+        auto player_position = world_chunk->components.position[world_chunk->component_idx(player)];
+        auto dir = check_for_level_change(player, player_position);
+        if (dir != Direction_Stay)
+        {
+            switch_world_chunk(memory, game_state, dir);
+        }
     }
 
-    auto trigger = world_chunk->zone_triggers + 0;
+    SpatialGrid* grid = build_spatial_grid(world_chunk, &memory.frame_temp_arena);
 
-    if (trigger->id > 0)
+    for (i32 t = 0; t < MAX_ZONE_TRIGGERS; t++)
     {
-        debug::push_rect_outline(trigger->rect, {0.0, 1.0, 0.0});
-        if (test_ZoneTrigger(game_state, trigger))
+        if (world_chunk->zone_triggers[t].id > 0)
         {
-        auto effect_map = global_effects_map[trigger->target_effect];
-        effect_map.fn(&memory, game_state, trigger->target_id, trigger->effect_data);
+            debug::push_rect_outline(world_chunk->zone_triggers[t].rect, {0.0, 1.0, 0.0});
+        }
+    }
+
+    if (player)
+    {
+        AABB player_aabb = player->colliders->aabbs[0];
+        player_aabb.center = world_chunk->components.position[world_chunk->component_idx(player)] + player_aabb.extents;
+
+        // only triggers, so there's always room for every one of them
+        SpatialItem* hits[MAX_ZONE_TRIGGERS];
+        usize n_hits = spatial_grid_query(grid, player_aabb, SPATIAL_ITEM_MASK(SpatialItem_ZoneTrigger), hits, MAX_ZONE_TRIGGERS);
+        for (usize h = 0; h < n_hits; h++)
+        {
+            auto trigger = world_chunk->zone_triggers + hits[h]->index;
+            if (test_ZoneTrigger(game_state, trigger))
+            {
+                auto effect_map = global_effects_map[trigger->target_effect];
+                effect_map.fn(&memory, game_state, trigger->target_id, trigger->effect_data);
+            }
         }
     }
 
     EntityIterator entity_iter(world_chunk);
+    EntityComponents* components = &world_chunk->components;
 
     TileMap* active_map = game_state->active_world_chunk->active_map;
 
@@ -328,6 +555,7 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
          entity != entity_iter.end();
          entity = entity_iter.next())
     {
+        usize ci = entity_iter.component_idx();
         // TODO(spencer): entity type? Or do we want concepts of controllers/brains that we can
         // attach to an entity? That sounds kinda nice, tbh.
         switch (entity->type)
@@ -337,13 +565,13 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
                 m::Vec3 new_acc = {0};
 
                 f32 gravity = -1000; // TODO: grav
-                if (entity->state == STATE_ON_LAND)
+                if (components->state[ci] == STATE_ON_LAND)
                 {
                     gravity = 0;
                 }
                 new_acc.y += gravity;
 
-                const auto is_in_air = entity->state == STATE_FALLING || entity->state == STATE_JUMPING;
+                const auto is_in_air = components->state[ci] == STATE_FALLING || components->state[ci] == STATE_JUMPING;
                 const auto player_speed = is_in_air ? 400 : 700;
                 if (g_input_state.move_left_requested)
                 {
@@ -356,32 +584,32 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
                 }
 
                 bool is_requesting_move = g_input_state.move_left_requested || g_input_state.move_right_requested;
-                if (m::abs(entity->velocity.x) > 0 && !is_requesting_move)
+                if (m::abs(components->velocity[ci].x) > 0 && !is_requesting_move)
                 {
-                    new_acc.x -= m::signof(entity->velocity.x) * player_speed;
+                    new_acc.x -= m::signof(components->velocity[ci].x) * player_speed;
 
-                    if (m::abs(new_acc.x * dt) > m::abs(entity->velocity.x))
+                    if (m::abs(new_acc.x * dt) > m::abs(components->velocity[ci].x))
                     {
                         new_acc.x = 0;
-                        entity->velocity.x = 0;
+                        components->velocity[ci].x = 0;
                     }
                 }
 
                 if (g_input_state.jump_requested)
                 {
-                    if (state_transition_land_to_jump(entity))
+                    if (state_transition_land_to_jump(components->state + ci))
                     {
-                        entity_set_animation(entity, "jump");
+                        entity_set_animation(entity, components->animation + ci, "jump");
                     }
                     g_input_state.jump_requested = false;
-                    entity->velocity.y = 230;
+                    components->velocity[ci].y = 230;
                 }
 
-                entity->acceleration = new_acc;
+                components->acceleration[ci] = new_acc;
 
-                auto move_result = move_entity(entity, active_map, dt, 140);
+                auto move_result = move_entity(components, ci, entity->colliders->aabbs[0], active_map, dt, 140);
 
-                if (entity->velocity.y <= 0)
+                if (components->velocity[ci].y <= 0)
                 {
                     i32 down_row = 2 * 3;
                     i32 down_col = 1;
@@ -390,40 +618,40 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
 
                     if (ground_below)
                     {
-                        if (state_transition_air_to_land(entity))
+                        if (state_transition_air_to_land(components->state + ci))
                         {
-                            entity_set_animation(entity, "idle");
+                            entity_set_animation(entity, components->animation + ci, "idle");
                         }
                     }
                     else
                     {
-                        if (state_transition_fall_exclusive(entity))
+                        if (state_transition_fall_exclusive(components->state + ci))
                         {
-                            entity_set_animation(entity, "jump");
+                            entity_set_animation(entity, components->animation + ci, "jump");
                         }
                     }
                 }
 
-                if (entity->state == STATE_ON_LAND)
+                if (components->state[ci] == STATE_ON_LAND)
                 {
-                    if (m::abs(entity->velocity.x) > 0.3) // ????
+                    if (m::abs(components->velocity[ci].x) > 0.3) // ????
                     {
-                        entity_update_animation(entity, "walk");
+                        entity_update_animation(entity, components->animation + ci, "walk");
                     }
                     else
                     {
-                        entity_update_animation(entity, "idle");
+                        entity_update_animation(entity, components->animation + ci, "idle");
                     }
                 }
 
-                update_zero_cross_trigger(&entity->facing_dir, entity->velocity.x);
+                update_zero_cross_trigger(&entity->facing_dir, components->velocity[ci].x);
 
                 auto animation = get_anim_resource(entity->animations_id);
-                auto current_frame = entity->animation.current_frame;
+                auto current_frame = components->animation[ci].current_frame;
                 auto frame = animation->frames + current_frame;
 
                 auto player_sprite = render::push_render_item<render::SpriteItem>(entity_batch_buffer);
-                player_sprite->position = entity->display_position;
+                player_sprite->position = components->display_position[ci];
                 player_sprite->sprite_id = entity->new_sprite_id;
                 player_sprite->color_and_strength = {0, 0, 0, 0};
                 player_sprite->sprite_segment_min = frame->spritesheet_min;
@@ -442,7 +670,7 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
             {
                 m::Vec3 new_accel;
                 f32 grav = -600;
-                if (entity->state == STATE_ON_LAND)
+                if (components->state[ci] == STATE_ON_LAND)
                 {
                     grav = 0;
                 }
@@ -456,10 +684,10 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
                 // accelerate effectively instantly
                 new_accel.x = 1500 * dir;
 
-                entity->acceleration = new_accel;
-                auto move_result = move_entity(entity, active_map, dt, 20);
+                components->acceleration[ci] = new_accel;
+                auto move_result = move_entity(components, ci, entity->colliders->aabbs[0], active_map, dt, 20);
 
-                if (entity->velocity.y <= 0)
+                if (components->velocity[ci].y <= 0)
                 {
                     i32 down_row = 2 * 3;
                     i32 down_col = 1;
@@ -468,28 +696,28 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
 
                     if (ground_below)
                     {
-                        if (state_transition_air_to_land(entity))
+                        if (state_transition_air_to_land(components->state + ci))
                         {
-                            entity_set_animation(entity, "idle");
+                            entity_set_animation(entity, components->animation + ci, "idle");
                         }
                     }
                     else
                     {
-                        if (state_transition_fall_exclusive(entity))
+                        if (state_transition_fall_exclusive(components->state + ci))
                         {
-                            entity_set_animation(entity, "jump");
+                            entity_set_animation(entity, components->animation + ci, "jump");
                         }
                     }
                 }
-                if (entity->state == STATE_ON_LAND)
+                if (components->state[ci] == STATE_ON_LAND)
                 {
-                    if (m::abs(entity->velocity.x) > 0.2)
+                    if (m::abs(components->velocity[ci].x) > 0.2)
                     {
-                        entity_update_animation(entity, "walk");
+                        entity_update_animation(entity, components->animation + ci, "walk");
                     }
                     else
                     {
-                        entity_update_animation(entity, "idle");
+                        entity_update_animation(entity, components->animation + ci, "idle");
                     }
                 }
 
@@ -497,7 +725,7 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
                 if (move_result.collided[leftright])
                 {
                     update_zero_cross_trigger(&entity->facing_dir, -dir);
-                    entity->velocity.x = 0;
+                    components->velocity[ci].x = 0;
                 }
 
             } break;
@@ -514,19 +742,19 @@ simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::B
 void
 update_animations(WorldChunk* active_chunk, f32 dt)
 {
-    for (i32 eid = 0;
-         eid < active_chunk->next_free_entity_idx;
-         eid++)
+    // only needs the animation stream, so walk it directly
+    auto components = &active_chunk->components;
+    for (usize i = 0; i < components->count; i++)
     {
-        auto e = active_chunk->entities + eid;
-        e->animation.timer += dt;
-        if (e->animation.timer >= e->animation.threshold)
+        PlayingAnimation* animation = components->animation + i;
+        animation->timer += dt;
+        if (animation->timer >= animation->threshold)
         {
-            e->animation.timer = 0;
-            e->animation.current_frame++;
-            if (e->animation.current_frame >= e->animation.end_frame)
+            animation->timer = 0;
+            animation->current_frame++;
+            if (animation->current_frame >= animation->end_frame)
             {
-                e->animation.current_frame = e->animation.start_frame;
+                animation->current_frame = animation->start_frame;
             }
         }
     }
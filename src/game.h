@@ -31,11 +31,31 @@ dir_to_vec(Direction d)
 }
 
 struct WorldChunk;
+
+// the active chunk plus its 4-neighbourhood
+#define MAX_RESIDENT_CHUNKS 5
+
+// Backing memory for one resident chunk when streaming. grid_idx is the
+// overworld cell loaded into it, or -1 if it's free.
+struct ChunkSlot
+{
+    mem::Arena arena;
+    i32 grid_idx;
+};
+
 // TODO: what is this and where does it go
 struct GameState
 {
     m::Vec2 overworld_dims;
+    // chunks that aren't resident are nullptr
     mem::SimpleList<WorldChunk*> overworld_grid;
+    // path of the level in each overworld cell, nullptr if there isn't one
+    mem::SimpleList<char*> overworld_files;
+
+    // When streaming, only the active chunk and its neighbours are loaded
+    // and the rest get loaded as the player approaches them.
+    b32 stream_chunks;
+    ChunkSlot chunk_slots[MAX_RESIDENT_CHUNKS];
 
     WorldChunk* first_world_chunk;
     WorldChunk* active_world_chunk;
@@ -44,12 +64,12 @@ struct GameState
 extern EntityPrototype entity_prototypes[EntityType_NumberOfTypes];
 
 GameState*
-load_game(mem::GameMem& memory);
+load_game(mem::GameMem& memory, b32 stream_chunks = true);
 
 void
 switch_world_chunk(mem::GameMem& mem, GameState* state, Direction dir);
 Direction
-check_for_level_change(Entity* player);
+check_for_level_change(Entity* player, m::Vec3 player_position);
 void
 simulate_one_tick(mem::GameMem& memory, GameState* game_state, f32 dt, render::BatchBuffer* entity_batch_buffer);
 void
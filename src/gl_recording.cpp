@@ -0,0 +1,332 @@
+#include "gl_recording.h"
+
+#include <glad/glad.h>
+#include <cstring>
+
+namespace rigel {
+namespace render {
+
+// the stubs are plain function pointers, there's nowhere else to keep it
+static GLRecording* recording;
+
+static void
+record_draw(GLDrawKind kind, GLenum mode, GLsizei count, GLsizei n_instances, GLint base_vertex)
+{
+    recording->n_draw_calls++;
+    recording->n_vertices += (u64)count * n_instances;
+
+    u32 draw_idx = recording->n_draw_calls - 1;
+    if (draw_idx >= GL_RECORDING_MAX_DRAWS)
+    {
+        return;
+    }
+
+    GLRecordedDraw* draw = recording->draws + draw_idx;
+    draw->kind = kind;
+    draw->mode = mode;
+    draw->count = count;
+    draw->n_instances = n_instances;
+    draw->base_vertex = base_vertex;
+    draw->program = recording->program;
+    draw->vao = recording->vao;
+    draw->framebuffer = recording->framebuffer;
+    memcpy(draw->textures, recording->textures, sizeof(draw->textures));
+}
+
+static void
+record_upload(u64 n_bytes, const void* data)
+{
+    if (data)
+    {
+        recording->n_uploads++;
+        recording->bytes_uploaded += n_bytes;
+    }
+}
+
+static void
+record_texture_upload(GLenum target, u64 n_bytes, const void* data)
+{
+    record_upload(n_bytes, data);
+    u32* bound = target == GL_TEXTURE_2D_ARRAY ? recording->array_textures : recording->textures;
+    recording->uploaded_texture = bound[recording->active_texture_slot];
+}
+
+static u64
+texel_bytes(GLenum format, GLenum type)
+{
+    u64 components = 4;
+    switch (format)
+    {
+        case GL_RED:
+        case GL_DEPTH_COMPONENT: components = 1; break;
+        case GL_RG: components = 2; break;
+        case GL_RGB: components = 3; break;
+    }
+
+    return type == GL_UNSIGNED_BYTE ? components : components * 4;
+}
+
+static void
+gen_names(GLsizei n, GLuint* names)
+{
+    recording->n_calls++;
+    for (GLsizei i = 0; i < n; i++)
+    {
+        names[i] = ++recording->next_name;
+    }
+}
+
+static void
+ignore_names(GLsizei, const GLuint*)
+{
+    recording->n_calls++;
+}
+
+static void
+set_uniform_v(GLint, GLsizei, const GLfloat*)
+{
+    recording->n_calls++;
+    recording->n_uniform_sets++;
+}
+
+GLRecording*
+gl_recording_install(mem::Arena* arena)
+{
+    recording = arena->alloc_simple<GLRecording>();
+    memset(recording, 0, sizeof(GLRecording));
+    recording->mapped = arena->alloc_bytes(GL_RECORDING_MAP_BYTES, 16);
+
+    // state
+    glEnable = [](GLenum) { recording->n_calls++; };
+    glBlendFunc = [](GLenum, GLenum) { recording->n_calls++; };
+    glViewport = [](GLint, GLint, GLsizei, GLsizei) { recording->n_calls++; };
+    glClearColor = [](GLfloat, GLfloat, GLfloat, GLfloat) { recording->n_calls++; };
+    glClear = [](GLbitfield)
+    {
+        recording->n_calls++;
+        recording->n_clears++;
+    };
+
+    // shaders
+    glCreateShader = [](GLenum) -> GLuint
+    {
+        recording->n_calls++;
+        return ++recording->next_name;
+    };
+    glCreateProgram = []() -> GLuint
+    {
+        recording->n_calls++;
+        return ++recording->next_name;
+    };
+    glShaderSource = [](GLuint, GLsizei, const GLchar* const*, const GLint*) { recording->n_calls++; };
+    glCompileShader = [](GLuint) { recording->n_calls++; };
+    glAttachShader = [](GLuint, GLuint) { recording->n_calls++; };
+    glLinkProgram = [](GLuint) { recording->n_calls++; };
+    glGetShaderiv = [](GLuint, GLenum, GLint* params)
+    {
+        recording->n_calls++;
+        *params = GL_TRUE;
+    };
+    glGetProgramiv = [](GLuint, GLenum, GLint* params)
+    {
+        recording->n_calls++;
+        *params = GL_TRUE;
+    };
+    glGetShaderInfoLog = [](GLuint, GLsizei buf_size, GLsizei* length, GLchar* log)
+    {
+        recording->n_calls++;
+        if (length) *length = 0;
+        if (buf_size > 0) log[0] = '\0';
+    };
+    glGetProgramInfoLog = [](GLuint, GLsizei buf_size, GLsizei* length, GLchar* log)
+    {
+        recording->n_calls++;
+        if (length) *length = 0;
+        if (buf_size > 0) log[0] = '\0';
+    };
+    glUseProgram = [](GLuint program)
+    {
+        recording->n_calls++;
+        recording->n_program_binds++;
+        recording->program = program;
+    };
+
+    // uniforms. Every uniform gets a location so that setting it is recorded.
+    glGetUniformLocation = [](GLuint, const GLchar*) -> GLint
+    {
+        recording->n_calls++;
+        return 0;
+    };
+    glGetUniformBlockIndex = [](GLuint, const GLchar*) -> GLuint
+    {
+        recording->n_calls++;
+        return 0;
+    };
+    glUniformBlockBinding = [](GLuint, GLuint, GLuint) { recording->n_calls++; };
+    glUniform1i = [](GLint, GLint)
+    {
+        recording->n_calls++;
+        recording->n_uniform_sets++;
+    };
+    glUniform2fv = set_uniform_v;
+    glUniformMatrix4fv = [](GLint, GLsizei, GLboolean, const GLfloat*)
+    {
+        recording->n_calls++;
+        recording->n_uniform_sets++;
+    };
+
+    // buffers
+    glGenBuffers = gen_names;
+    glDeleteBuffers = ignore_names;
+    glBindBuffer = [](GLenum target, GLuint buffer)
+    {
+        recording->n_calls++;
+        if (target == GL_ARRAY_BUFFER) recording->array_buffer = buffer;
+        if (target == GL_ELEMENT_ARRAY_BUFFER) recording->element_buffer = buffer;
+    };
+    glBindBufferBase = [](GLenum, GLuint, GLuint) { recording->n_calls++; };
+    glBufferData = [](GLenum, GLsizeiptr size, const void* data, GLenum)
+    {
+        recording->n_calls++;
+        record_upload(size, data);
+    };
+    glBufferSubData = [](GLenum, GLintptr, GLsizeiptr size, const void* data)
+    {
+        recording->n_calls++;
+        record_upload(size, data);
+    };
+    glMapBufferRange = [](GLenum, GLintptr, GLsizeiptr length, GLbitfield) -> void*
+    {
+        recording->n_calls++;
+        assert(length <= GL_RECORDING_MAP_BYTES && "Mapped more than the recording can hold");
+        recording->mapped_bytes = length;
+        return recording->mapped;
+    };
+    glUnmapBuffer = [](GLenum) -> GLboolean
+    {
+        recording->n_calls++;
+        record_upload(recording->mapped_bytes, recording->mapped);
+        recording->mapped_bytes = 0;
+        return GL_TRUE;
+    };
+
+    // vertex arrays
+    glGenVertexArrays = gen_names;
+    glDeleteVertexArrays = ignore_names;
+    glBindVertexArray = [](GLuint vao)
+    {
+        recording->n_calls++;
+        recording->n_vao_binds++;
+        recording->vao = vao;
+    };
+    glVertexAttribPointer = [](GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) { recording->n_calls++; };
+    glEnableVertexAttribArray = [](GLuint) { recording->n_calls++; };
+    glVertexAttribDivisor = [](GLuint, GLuint) { recording->n_calls++; };
+
+    // textures
+    glGenTextures = gen_names;
+    glActiveTexture = [](GLenum texture)
+    {
+        recording->n_calls++;
+        assert(texture - GL_TEXTURE0 < GL_RECORDING_TEXTURE_SLOTS && "Bad texture slot");
+        recording->active_texture_slot = texture - GL_TEXTURE0;
+    };
+    glBindTexture = [](GLenum target, GLuint texture)
+    {
+        recording->n_calls++;
+        recording->n_texture_binds++;
+        u32* bound = target == GL_TEXTURE_2D_ARRAY ? recording->array_textures : recording->textures;
+        bound[recording->active_texture_slot] = texture;
+    };
+    glTexParameteri = [](GLenum, GLenum, GLint) { recording->n_calls++; };
+    glTexImage2D = [](GLenum target, GLint, GLint, GLsizei w, GLsizei h, GLint, GLenum format, GLenum type, const void* pixels)
+    {
+        recording->n_calls++;
+        record_texture_upload(target, w * h * texel_bytes(format, type), pixels);
+    };
+    glTexImage3D = [](GLenum target, GLint, GLint, GLsizei w, GLsizei h, GLsizei d, GLint, GLenum format, GLenum type, const void* pixels)
+    {
+        recording->n_calls++;
+        record_texture_upload(target, w * h * d * texel_bytes(format, type), pixels);
+    };
+    glTexSubImage2D = [](GLenum target, GLint, GLint, GLint, GLsizei w, GLsizei h, GLenum format, GLenum type, const void* pixels)
+    {
+        recording->n_calls++;
+        record_texture_upload(target, w * h * texel_bytes(format, type), pixels);
+    };
+    glGenerateMipmap = [](GLenum) { recording->n_calls++; };
+
+    // framebuffers
+    glGenFramebuffers = gen_names;
+    glBindFramebuffer = [](GLenum, GLuint framebuffer)
+    {
+        recording->n_calls++;
+        recording->n_framebuffer_binds++;
+        recording->framebuffer = framebuffer;
+    };
+    glFramebufferTexture = [](GLenum, GLenum, GLuint, GLint) { recording->n_calls++; };
+    glFramebufferTexture2D = [](GLenum, GLenum, GLenum, GLuint, GLint) { recording->n_calls++; };
+    glCheckFramebufferStatus = [](GLenum) -> GLenum
+    {
+        recording->n_calls++;
+        return GL_FRAMEBUFFER_COMPLETE;
+    };
+
+    // sync. Nothing is ever in flight, so every fence has already passed.
+    glFenceSync = [](GLenum, GLbitfield) -> GLsync
+    {
+        recording->n_calls++;
+        return reinterpret_cast<GLsync>(static_cast<uintptr_t>(++recording->next_name));
+    };
+    glClientWaitSync = [](GLsync, GLbitfield, GLuint64) -> GLenum
+    {
+        recording->n_calls++;
+        return GL_ALREADY_SIGNALED;
+    };
+    glDeleteSync = [](GLsync) { recording->n_calls++; };
+
+    // draws
+    glDrawArrays = [](GLenum mode, GLint, GLsizei count)
+    {
+        recording->n_calls++;
+        record_draw(GLDrawKind_Arrays, mode, count, 1, 0);
+    };
+    glDrawArraysInstanced = [](GLenum mode, GLint, GLsizei count, GLsizei n_instances)
+    {
+        recording->n_calls++;
+        record_draw(GLDrawKind_ArraysInstanced, mode, count, n_instances, 0);
+    };
+    glDrawElements = [](GLenum mode, GLsizei count, GLenum, const void*)
+    {
+        recording->n_calls++;
+        record_draw(GLDrawKind_Elements, mode, count, 1, 0);
+    };
+    glDrawElementsBaseVertex = [](GLenum mode, GLsizei count, GLenum, const void*, GLint base_vertex)
+    {
+        recording->n_calls++;
+        record_draw(GLDrawKind_ElementsBaseVertex, mode, count, 1, base_vertex);
+    };
+
+    return recording;
+}
+
+void
+gl_recording_reset(GLRecording* recording)
+{
+    recording->n_calls = 0;
+    recording->n_draw_calls = 0;
+    recording->n_vertices = 0;
+    recording->n_program_binds = 0;
+    recording->n_vao_binds = 0;
+    recording->n_texture_binds = 0;
+    recording->n_framebuffer_binds = 0;
+    recording->n_uniform_sets = 0;
+    recording->n_clears = 0;
+    recording->n_uploads = 0;
+    recording->bytes_uploaded = 0;
+    recording->uploaded_texture = 0;
+    memset(recording->draws, 0, sizeof(recording->draws));
+}
+
+} // namespace render
+} // namespace rigel
@@ -0,0 +1,109 @@
+#ifndef RIGEL_GL_RECORDING_H
+#define RIGEL_GL_RECORDING_H
+
+#include "rigel.h"
+#include "mem.h"
+
+namespace rigel {
+namespace render {
+
+// A GL backend that records instead of drawing. glad calls GL through
+// function pointers, so installing it is a matter of pointing the ones the
+// renderer uses at stubs that keep track of what was asked for. Nothing
+// else in the renderer has to know, and everything in render.cpp can run
+// without a context: in rigel_tests, in rigel_bench, on a machine with no
+// GPU at all.
+//
+// Only the GL calls render.cpp makes have stubs. Anything else is left as
+// glad had it, which without a context is null, so calling something new
+// crashes straight away instead of quietly doing nothing.
+
+#define GL_RECORDING_MAX_DRAWS 1024
+#define GL_RECORDING_TEXTURE_SLOTS 16
+// the most the renderer maps in one go, see STREAM_BUFFER_FRAME_BYTES
+#define GL_RECORDING_MAP_BYTES (4 * ONE_MB)
+
+enum GLDrawKind
+{
+    GLDrawKind_Arrays,
+    GLDrawKind_ArraysInstanced,
+    GLDrawKind_Elements,
+    GLDrawKind_ElementsBaseVertex
+};
+
+struct GLRecordedDraw
+{
+    GLDrawKind kind;
+    u32 mode;
+    u32 count;
+    u32 n_instances;
+    i32 base_vertex;
+
+    // what was bound when it was drawn
+    u32 program;
+    u32 vao;
+    u32 framebuffer;
+    u32 textures[GL_RECORDING_TEXTURE_SLOTS];
+};
+
+struct GLRecording
+{
+    // every call that reached the backend
+    u32 n_calls;
+
+    u32 n_draw_calls;
+    // vertices over all instances of every draw
+    u64 n_vertices;
+    // the first GL_RECORDING_MAX_DRAWS draws, in order. The rest are only
+    // counted.
+    GLRecordedDraw draws[GL_RECORDING_MAX_DRAWS];
+
+    u32 n_program_binds;
+    u32 n_vao_binds;
+    u32 n_texture_binds;
+    u32 n_framebuffer_binds;
+    u32 n_uniform_sets;
+    u32 n_clears;
+
+    // what was handed to GL through glBufferData, glBufferSubData, mapped
+    // ranges and texture uploads. Allocations with no data don't count.
+    u32 n_uploads;
+    u64 bytes_uploaded;
+    // what was bound to the upload's target on the active slot at the last
+    // texture upload
+    u32 uploaded_texture;
+
+    // bound right now
+    u32 program;
+    u32 vao;
+    u32 array_buffer;
+    u32 element_buffer;
+    u32 framebuffer;
+    u32 active_texture_slot;
+    u32 textures[GL_RECORDING_TEXTURE_SLOTS];
+    u32 array_textures[GL_RECORDING_TEXTURE_SLOTS];
+
+    // handed out by glGen* and glCreate*, never reused
+    u32 next_name;
+
+    // glMapBufferRange hands this out, what's written there is counted as
+    // uploaded on glUnmapBuffer
+    ubyte* mapped;
+    u32 mapped_bytes;
+};
+
+// Points glad at the recording stubs. The recording, and the memory the
+// stubs hand out for mapped buffers, come out of arena. Replaces whatever
+// was recording before.
+GLRecording*
+gl_recording_install(mem::Arena* arena);
+
+// Zeroes the counters and forgets the recorded draws. What's bound is kept,
+// it's still bound as far as the renderer's concerned.
+void
+gl_recording_reset(GLRecording* recording);
+
+} // namespace render
+} // namespace rigel
+
+#endif // RIGEL_GL_RECORDING_H
@@ -0,0 +1,168 @@
+#include "input_journal.h"
+#include "fs_linux.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace rigel {
+
+InputJournal
+make_input_journal(mem::Arena* arena, u32 capacity, i64 tick_ns)
+{
+    InputJournal result;
+    result.tick_ns = tick_ns;
+    result.n_ticks = 0;
+    result.capacity = capacity;
+    result.cursor = 0;
+    result.ticks = arena->alloc_array<ubyte>(capacity);
+    return result;
+}
+
+b32
+input_journal_record(InputJournal* journal, const InputState& state)
+{
+    if (journal->n_ticks >= journal->capacity)
+    {
+        return false;
+    }
+    journal->ticks[journal->n_ticks] = pack_input_state(state);
+    journal->n_ticks++;
+    return true;
+}
+
+b32
+input_journal_replay_next(InputJournal* journal, InputState* state)
+{
+    if (journal->cursor >= journal->n_ticks)
+    {
+        return false;
+    }
+    *state = unpack_input_state(journal->ticks[journal->cursor]);
+    journal->cursor++;
+    return true;
+}
+
+b32
+input_journal_save(InputJournal* journal, const char* file_path)
+{
+    InputJournalHeader header = {0};
+    header.magic = INPUT_JOURNAL_MAGIC;
+    header.version = INPUT_JOURNAL_VERSION;
+    header.tick_ns = journal->tick_ns;
+    header.n_ticks = journal->n_ticks;
+
+    // header and ticks go out in one write so a journal is never half-written
+    usize n_bytes = sizeof(InputJournalHeader) + journal->n_ticks;
+    ubyte* out = new ubyte[n_bytes];
+    memcpy(out, &header, sizeof(InputJournalHeader));
+    memcpy(out + sizeof(InputJournalHeader), journal->ticks, journal->n_ticks);
+
+    b32 result = dump_to_file(file_path, out, n_bytes);
+    delete[] out;
+
+    return result;
+}
+
+b32
+input_journal_load(InputJournal* journal, mem::Arena* arena, const char* file_path)
+{
+    usize n_bytes = 0;
+    ubyte* data = slurp_into_mem(arena, file_path, &n_bytes);
+    if (!data || n_bytes < sizeof(InputJournalHeader))
+    {
+        std::cerr << "Couldn't read input journal '" << file_path << "'" << std::endl;
+        return false;
+    }
+
+    InputJournalHeader header;
+    memcpy(&header, data, sizeof(InputJournalHeader));
+    if (header.magic != INPUT_JOURNAL_MAGIC || header.version != INPUT_JOURNAL_VERSION)
+    {
+        std::cerr << "'" << file_path << "' is not a v" << INPUT_JOURNAL_VERSION << " input journal" << std::endl;
+        return false;
+    }
+    if (n_bytes - sizeof(InputJournalHeader) < header.n_ticks)
+    {
+        std::cerr << "Input journal '" << file_path << "' is truncated" << std::endl;
+        return false;
+    }
+
+    journal->tick_ns = header.tick_ns;
+    journal->n_ticks = header.n_ticks;
+    journal->capacity = header.n_ticks;
+    journal->cursor = 0;
+    journal->ticks = data + sizeof(InputJournalHeader);
+    return true;
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+TEST_CASE("input journals replay what they recorded and reject bad files")
+{
+    using namespace rigel;
+
+    static ubyte backing[64 * ONE_KB];
+    mem::Arena arena(backing, sizeof(backing));
+
+    InputState states[6] = {
+        { false, false, false },
+        { true, false, false },
+        { true, false, true },
+        { false, true, false },
+        { false, true, true },
+        { true, true, true }
+    };
+    InputJournal journal = make_input_journal(&arena, 6, 12345678);
+    for (u32 i = 0; i < 6; i++)
+    {
+        CHECK(input_journal_record(&journal, states[i]));
+    }
+    CHECK(!input_journal_record(&journal, states[0]));
+
+    const char* path = "/tmp/rigel_input_journal_test.rij";
+    REQUIRE(input_journal_save(&journal, path));
+
+    InputJournal loaded;
+    REQUIRE(input_journal_load(&loaded, &arena, path));
+    CHECK(loaded.tick_ns == 12345678);
+    CHECK(loaded.n_ticks == 6);
+
+    InputState state;
+    for (u32 i = 0; i < 6; i++)
+    {
+        REQUIRE(input_journal_replay_next(&loaded, &state));
+        CHECK(state.move_right_requested == states[i].move_right_requested);
+        CHECK(state.move_left_requested == states[i].move_left_requested);
+        CHECK(state.jump_requested == states[i].jump_requested);
+    }
+    CHECK(!input_journal_replay_next(&loaded, &state));
+
+    usize n_bytes = 0;
+    ubyte* file = slurp_into_mem(&arena, path, &n_bytes);
+    REQUIRE(n_bytes == sizeof(InputJournalHeader) + 6);
+    InputJournalHeader header;
+    memcpy(&header, file, sizeof(header));
+
+    // missing ticks, and too short to hold a header
+    const char* bad_path = "/tmp/rigel_input_journal_test_bad.rij";
+    REQUIRE(dump_to_file(bad_path, file, n_bytes - 1));
+    CHECK(!input_journal_load(&loaded, &arena, bad_path));
+    REQUIRE(dump_to_file(bad_path, file, sizeof(InputJournalHeader) - 1));
+    CHECK(!input_journal_load(&loaded, &arena, bad_path));
+
+    InputJournalHeader bad_header = header;
+    bad_header.magic = 0x12345678;
+    memcpy(file, &bad_header, sizeof(bad_header));
+    REQUIRE(dump_to_file(bad_path, file, n_bytes));
+    CHECK(!input_journal_load(&loaded, &arena, bad_path));
+
+    bad_header = header;
+    bad_header.version = INPUT_JOURNAL_VERSION + 1;
+    memcpy(file, &bad_header, sizeof(bad_header));
+    REQUIRE(dump_to_file(bad_path, file, n_bytes));
+    CHECK(!input_journal_load(&loaded, &arena, bad_path));
+
+    CHECK(!input_journal_load(&loaded, &arena, "/tmp/rigel_input_journal_no_such_file.rij"));
+}
@@ -0,0 +1,77 @@
+#ifndef RIGEL_INPUT_JOURNAL_H
+#define RIGEL_INPUT_JOURNAL_H
+
+#include "rigel.h"
+#include "mem.h"
+#include "input.h"
+
+namespace rigel {
+
+// Records the InputState the game saw at the start of every tick so a play
+// session can be fed back through simulate_one_tick exactly, e.g. to compare
+// tick and frame timings between builds.
+//
+// On disk a journal is an InputJournalHeader followed by one byte per tick.
+
+constexpr static u32 INPUT_JOURNAL_MAGIC = 0x314a4952; // "RIJ1"
+constexpr static u32 INPUT_JOURNAL_VERSION = 1;
+
+enum InputJournalBit
+{
+    InputJournalBit_MoveRight = 0x1,
+    InputJournalBit_MoveLeft  = 0x2,
+    InputJournalBit_Jump      = 0x4
+};
+
+struct InputJournalHeader
+{
+    u32 magic;
+    u32 version;
+    i64 tick_ns;
+    u32 n_ticks;
+    u32 reserved;
+};
+
+struct InputJournal
+{
+    i64 tick_ns;
+    u32 n_ticks;
+    u32 capacity;
+    u32 cursor;
+    ubyte* ticks;
+};
+
+inline ubyte
+pack_input_state(const InputState& state)
+{
+    ubyte result = 0;
+    result |= state.move_right_requested ? InputJournalBit_MoveRight : 0;
+    result |= state.move_left_requested ? InputJournalBit_MoveLeft : 0;
+    result |= state.jump_requested ? InputJournalBit_Jump : 0;
+    return result;
+}
+
+inline InputState
+unpack_input_state(ubyte packed)
+{
+    InputState result;
+    result.move_right_requested = (packed & InputJournalBit_MoveRight) != 0;
+    result.move_left_requested = (packed & InputJournalBit_MoveLeft) != 0;
+    result.jump_requested = (packed & InputJournalBit_Jump) != 0;
+    return result;
+}
+
+InputJournal
+make_input_journal(mem::Arena* arena, u32 capacity, i64 tick_ns = UPDATE_TIME_NS);
+
+// returns false once the journal is full
+b32 input_journal_record(InputJournal* journal, const InputState& state);
+// writes the next recorded tick to `state`, returns false at the end of the journal
+b32 input_journal_replay_next(InputJournal* journal, InputState* state);
+
+b32 input_journal_save(InputJournal* journal, const char* file_path);
+b32 input_journal_load(InputJournal* journal, mem::Arena* arena, const char* file_path);
+
+} // namespace rigel
+
+#endif // RIGEL_INPUT_JOURNAL_H
@@ -4,7 +4,9 @@
 #include "mem.h"
 #include "fs_linux.h"
 
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 namespace rigel {
@@ -19,13 +21,6 @@ bool is_number(char c)
     return (c >= 0x30 && c < 0x40) || c == '-';
 }
 
-const char* next_non_ws_char(const char* start) {
-    while (is_space(*start)) {
-        start++;
-    }
-    return start;
-}
-
 bool json_str_equals(const JsonString jstr, const char* str, usize n)
 {
     if (jstr.end == jstr.start) return false;
@@ -59,21 +54,6 @@ bool json_str_equals(const JsonString lhs, const JsonString rhs)
     return (l == lhs.end && r == rhs.end);
 }
 
-const char* extract_number(const char* start)
-{
-    const char* end = start;
-    while (*end != '\0') {
-        if (is_space(*end) || *end == ',' || *end == '}' || *end == ']') {
-            break;;
-        }
-        if (*end != '.' && !is_number(*end)) {
-            return nullptr;
-        }
-        end++;
-    }
-    return end;
-}
-
 bool extract_json_number(JsonToken tok, JsonNumber* dst)
 {
     assert(tok.type == TOK_NUMBER && "Tried to extract number from non-number token");
@@ -83,105 +63,149 @@ bool extract_json_number(JsonToken tok, JsonNumber* dst)
 }
 
 
-const char* find_end_of_string(const char* start)
-{
-    const char* end = start + 1;
-    while (*end != '"' && *end != '\0') {
-        if (*end == '\'') {
-            end++;
-        }
-        end++;
-    }
-    if (*end == '\0') {
-        return nullptr;
-    }
-    return end + 1;
-}
-
-JsonToken get_next_token(const char* start)
+// Stage 2 walks the structural index from json_build_structural_index. Every
+// token starts at the next position in the index, so there's no whitespace
+// skipping or hunting for delimiters here.
+JsonToken get_next_token(JsonParser* parser)
 {
     JsonToken result;
     result.type = JSON_TOKEN_UNDEF;
-    result.str.start = start;
-    result.str.end = start + 1;
 
-    switch (*start)
+    // the last position is the end of the doc, keep handing that back
+    u32 pos = parser->index.positions[parser->index.n - 1];
+    if (parser->next < parser->index.n) {
+        pos = parser->index.positions[parser->next++];
+    }
+    result.str.start = parser->doc + pos;
+    result.str.end = result.str.start + 1;
+
+    if (pos == parser->len) {
+        result.type = TOK_EOF;
+        result.str.end = result.str.start;
+        return result;
+    }
+
+    switch (*result.str.start)
     {
         case '{':
             result.type = TOK_OPEN_CURLY_BRACE;
-            break;
+            return result;
         case '}':
             result.type = TOK_CLOSE_CURLY_BRACE;
-            break;
+            return result;
         case '[':
             result.type = TOK_OPEN_SQUARE_BRACE;
-            break;
+            return result;
         case ']':
             result.type = TOK_CLOSE_SQUARE_BRACE;
-            break;
+            return result;
         case ',':
             result.type = TOK_COMMA;
-            break;
-        case '"':
-            result.type = TOK_STRING;
-            result.str.end = find_end_of_string(result.str.start);
-            break;
-        case '\0':
-            result.type = TOK_EOF;
-            break;
+            return result;
         case ':':
             result.type = TOK_COLON;
-            break;
+            return result;
+        case '"':
+            // the closing quote is always the next position, stage 1 fails
+            // on unterminated strings
+            result.type = TOK_STRING;
+            result.str.end = parser->doc + parser->index.positions[parser->next++] + 1;
+            return result;
         default:
             break;
     }
 
-    if (result.type != JSON_TOKEN_UNDEF) {
-        return result;
+    // A bare scalar runs up to the next structural, minus any whitespace in
+    // between. There's always a next one since the end of the doc is in the
+    // index.
+    const char* end = parser->doc + parser->index.positions[parser->next];
+    while (end > result.str.start && is_space(end[-1])) {
+        end--;
     }
+    result.str.end = end;
 
     if (is_number(*result.str.start)) {
-        const char* end = extract_number(result.str.start);
-        if (end) {
-            result.type = TOK_NUMBER;
-            result.str.end = end;
-            return result;
-        }
+        result.type = TOK_NUMBER;
+    } else if (json_str_equals(result.str, "true", 4)) {
+        result.type = TOK_TRUE;
+    } else if (json_str_equals(result.str, "false", 5)) {
+        result.type = TOK_FALSE;
+    } else if (json_str_equals(result.str, "null", 4)) {
+        result.type = TOK_NULL;
     }
+    return result;
+}
 
-    while (*result.str.end != '\0') {
-        if (json_str_equals(result.str, "true", 4)) {
-            result.type = TOK_TRUE;
-            return result;
-        }
+JsonString token_string_to_string(JsonString token)
+{
+    return JsonString { token.start + 1, token.end - 1 };
+}
 
-        if (json_str_equals(result.str, "false", 5)) {
-            result.type = TOK_FALSE;
-            return result;
-        }
+JsonObj* parse_json_obj(JsonParser* parser);
 
-        if (json_str_equals(result.str, "null", 4)) {
-            result.type = TOK_NULL;
-            return result;
+// Tile layers are long arrays of small unsigned integers. Those skip strtof
+// and the per-member allocs and go straight into one u32 buffer. If any
+// member isn't a plain unsigned integer this backs out without consuming
+// anything and the caller parses the array as JsonNumbers instead.
+// Called with the first member already consumed.
+static bool
+parse_json_uint_array(JsonValue* value, JsonParser* parser)
+{
+    const char* doc = parser->doc;
+    const u32* positions = parser->index.positions;
+    u32 first = parser->next - 1;
+
+    // inside a number array the index is just members and commas, so the
+    // members sit at every other position up to the ']'
+    u32 close = first + 1;
+    while (close < parser->index.n && doc[positions[close]] != ']') {
+        close++;
+    }
+    if (close == parser->index.n) {
+        return false;
+    }
+    usize n = (close - first + 1) / 2;
+
+    mem::Arena* work_mem = parser->work_mem;
+    mem::ArenaCheckpoint checkpoint = work_mem->checkpoint();
+    JsonArray<u32>* array = work_mem->alloc_simple<JsonArray<u32>>();
+    array->n = n;
+    array->arr = work_mem->alloc_array<u32>(n);
+
+    for (usize i = 0; i < n; i++) {
+        u32 pos = first + 2 * i;
+        const char* start = doc + positions[pos];
+        const char* end = doc + positions[pos + 1];
+
+        // at most 10 digits so the u64 can't overflow before the range check
+        u64 v = 0;
+        const char* c = start;
+        u32 digit = (u32)(*c - '0');
+        while (digit < 10 && c - start < 10) {
+            v = v * 10 + digit;
+            c++;
+            digit = (u32)(*c - '0');
         }
 
-        result.str.end += 1;
+        if (c == start || v > 0xFFFFFFFF || (c != end && !is_space(*c)) ||
+            (*end != ',' && pos + 1 != close)) {
+            work_mem->restore(checkpoint);
+            return false;
+        }
+        array->arr[i] = (u32)v;
     }
 
-    return result;
-}
-
-JsonString token_string_to_string(JsonString token)
-{
-    return JsonString { token.start + 1, token.end - 1 };
+    value->type = JSON_UINT_ARRAY;
+    value->uint_array = array;
+    parser->next = close + 1;
+    return true;
 }
 
-JsonObj* parse_json_obj(mem::Arena* work_mem, const char** obj_str);
-bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_str)
+// called with the opening '[' already consumed
+bool parse_json_array(JsonValue* value, JsonParser* parser)
 {
-    JsonToken tok;
-    const char* cursor = *obj_str;
-    tok = get_next_token(*obj_str);
+    mem::Arena* work_mem = parser->work_mem;
+    JsonToken tok = get_next_token(parser);
 
     if (tok.type == TOK_CLOSE_SQUARE_BRACE) {
         // empty array
@@ -189,7 +213,6 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
         value->string_array = work_mem->alloc_simple<JsonArray<JsonString>>();
         value->string_array->arr = nullptr;
         value->string_array->n = 0;
-        *obj_str = next_non_ws_char(tok.str.end);
         return true;
     }
 
@@ -203,8 +226,7 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
         n += 1;
 
         while (true) {
-            cursor = next_non_ws_char(tok.str.end);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type == TOK_CLOSE_SQUARE_BRACE) {
                 break;
             }
@@ -213,8 +235,7 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
                 return false;
             }
 
-            cursor = next_non_ws_char(tok.str.end);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type != TOK_STRING) {
                 std::cout << "Err: expected array of strings, got type " << tok.type << std::endl;
                 return false;
@@ -225,11 +246,14 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
 
         }
         value->string_array->n = n;
-        *obj_str = next_non_ws_char(tok.str.end);
         return true;
     }
 
     if (tok.type == TOK_NUMBER) {
+        if (parse_json_uint_array(value, parser)) {
+            return true;
+        }
+
         // string array
         usize n = 0;
         value->type = JSON_NUMBER_ARRAY;
@@ -243,8 +267,7 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
         n += 1;
 
         while (true) {
-            cursor = next_non_ws_char(tok.str.end);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type == TOK_CLOSE_SQUARE_BRACE) {
                 break;
             }
@@ -253,8 +276,7 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
                 return false;
             }
 
-            cursor = next_non_ws_char(tok.str.end);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type != TOK_NUMBER) {
                 std::cout << "Err: expected array of numbers, got type " << tok.type << std::endl;
                 return false;
@@ -267,7 +289,6 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
             n += 1;
         }
         value->number_array->n = n;
-        *obj_str = next_non_ws_char(tok.str.end);
         return true;
     }
 
@@ -276,17 +297,16 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
     if (tok.type == TOK_OPEN_CURLY_BRACE) {
         // objects boooo
         value->type = JSON_OBJECT_ARRAY;
-        value->obj_array = work_mem->alloc_simple<JsonObjArray>();
+        value->obj_array = work_mem->alloc_obj<JsonObjArray>();
         auto head = value->obj_array;
 
         while (true)
         {
-            head->obj = parse_json_obj(work_mem, &cursor);
+            head->obj = parse_json_obj(parser);
             if (head->obj == nullptr) {
                 return false;
             }
-            cursor = next_non_ws_char(cursor);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type == TOK_CLOSE_SQUARE_BRACE) {
                 break;
             }
@@ -294,16 +314,14 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
                 std::cout << "Err: objects in array should be separated by a comma" << std::endl;
                 return false;
             }
-            cursor = next_non_ws_char(tok.str.end);
-            tok = get_next_token(cursor);
+            tok = get_next_token(parser);
             if (tok.type != TOK_OPEN_CURLY_BRACE) {
                 std::cout << "Err: expected '{' but got token type " << tok.type << std::endl;
                 return false;
             }
-            head->next = work_mem->alloc_simple<JsonObjArray>();
+            head->next = work_mem->alloc_obj<JsonObjArray>();
             head = head->next;
         }
-        *obj_str = next_non_ws_char(tok.str.end);
         return true;
     }
 
@@ -312,22 +330,35 @@ bool parse_json_array(JsonValue* value, mem::Arena* work_mem, const char** obj_s
     return false;
 }
 
+JsonObj* jsonobj__create(mem::Arena* work_mem, u32 count)
+{
+    u32 capacity = 1;
+    while (capacity < 2 * count) {
+        capacity <<= 1;
+    }
+
+    JsonObj* result = work_mem->alloc_simple<JsonObj>();
+    result->count = 0;
+    result->capacity = capacity;
+    // entries are probed by key.start, so they have to start zeroed even when
+    // the work arena is only reinit()'d (e.g. the frame temp arena)
+    result->entries = work_mem->alloc_array<JsonObjEntry>(capacity);
+    memset(result->entries, 0, capacity * sizeof(JsonObjEntry));
+    return result;
+}
+
 JsonValue* jsonobj__create_mapping(JsonObj* obj, JsonString key)
 {
-    assert(obj->count < N_HASHES && "too many entries in json");
+    assert(obj->count * 2 < obj->capacity && "too many entries in json");
 
-    u64 hash = dbj2(key);
-    usize index = hash & (N_HASHES - 1);
+    usize mask = obj->capacity - 1;
+    usize index = dbj2(key) & mask;
 
     JsonObjEntry* entry = obj->entries + index;
-    if (entry->key.start)
+    while (entry->key.start)
     {
-        // something is there
-        while (entry->key.start)
-        {
-            index = (index + 1) & (N_HASHES - 1);
-            entry = obj->entries + index;
-        }
+        index = (index + 1) & mask;
+        entry = obj->entries + index;
     }
 
     entry->key = key;
@@ -337,73 +368,91 @@ JsonValue* jsonobj__create_mapping(JsonObj* obj, JsonString key)
 
 void jsonobj__add(JsonObj* obj, JsonString key, JsonValue value)
 {
-    assert(obj->count < N_HASHES && "too many entries in json");
+    *jsonobj__create_mapping(obj, key) = value;
+}
 
-    u64 hash = dbj2(key);
-    usize index = hash & (N_HASHES - 1);
+JsonValue* jsonobj_get(JsonObj* obj, const char* key, usize key_len)
+{
+    usize mask = obj->capacity - 1;
+    usize index = dbj2(key, key_len) & mask;
 
     JsonObjEntry* entry = obj->entries + index;
-    if (entry->key.start)
+    while (entry->key.start)
     {
-        // something is there
-        while (entry->key.start)
+        if (json_str_equals(entry->key, key, key_len))
         {
-            index = (index + 1) & (N_HASHES - 1);
-            entry = obj->entries + index;
+            return &entry->value;
         }
+        index = (index + 1) & mask;
+        entry = obj->entries + index;
     }
-
-    entry->key = key;
-    entry->value = value;
-    obj->count += 1;
+    return nullptr;
 }
 
-JsonValue* jsonobj_get(JsonObj* obj, const char* key, usize key_len)
+// Objects are sized to their key count, so count the keys in every object up
+// front with one pass over the index. The counts are stored in the order the
+// objects open, which is the order parse_json_obj meets them.
+static bool
+count_object_keys(JsonParser* parser)
 {
-    u64 hash = dbj2(key, key_len);
-    usize index = hash & (N_HASHES - 1);
-
-    JsonObjEntry* entry = obj->entries + index;
+    const char* doc = parser->doc;
+    const JsonStructuralIndex* index = &parser->index;
 
-    if (entry->key.start && json_str_equals(entry->key, key, key_len))
-    {
-        return &entry->value;
+    u32 n_objects = 0;
+    for (u32 i = 0; i < index->n; i++) {
+        n_objects += doc[index->positions[i]] == '{';
     }
-
-    while (true)
-    {
-        index = (index + 1) & (N_HASHES - 1);
-        entry = obj->entries + index;
-        if (entry->key.start)
-        {
-            if (json_str_equals(entry->key, key, key_len))
-            {
-                return &entry->value;
-            }
-        }
-        else
-        {
-            return nullptr;
+    parser->object_key_counts = parser->work_mem->alloc_array<u32>(n_objects);
+    parser->next_object = 0;
+
+    // which object each open container is, or ARRAY for arrays
+    constexpr u32 ARRAY = 0xFFFFFFFF;
+    u32 open[JSON_READER_MAX_DEPTH];
+    u32 depth = 0;
+    u32 object = 0;
+
+    for (u32 i = 0; i < index->n; i++) {
+        switch (doc[index->positions[i]]) {
+            case '{':
+            case '[':
+                if (depth == JSON_READER_MAX_DEPTH) {
+                    std::cout << "Err: json nested too deep" << std::endl;
+                    return false;
+                }
+                if (doc[index->positions[i]] == '{') {
+                    parser->object_key_counts[object] = 0;
+                    open[depth++] = object++;
+                } else {
+                    open[depth++] = ARRAY;
+                }
+                break;
+            case '}':
+            case ']':
+                depth -= depth > 0;
+                break;
+            case ':':
+                if (depth > 0 && open[depth - 1] != ARRAY) {
+                    parser->object_key_counts[open[depth - 1]]++;
+                }
+                break;
+            default:
+                break;
         }
     }
+    return true;
 }
 
-JsonObj* parse_json_obj(mem::Arena* work_mem, const char** obj_str)
+// called with the opening '{' already consumed
+JsonObj* parse_json_obj(JsonParser* parser)
 {
+    mem::Arena* work_mem = parser->work_mem;
     JsonToken tok;
-    const char* cursor = next_non_ws_char(*obj_str);
-    tok = get_next_token(*obj_str);
-    assert(tok.type == TOK_OPEN_CURLY_BRACE && "malformed json obj");
-
-    // TODO: this needs to be 0'd!
-    JsonObj* result = work_mem->alloc_simple<JsonObj>();
+    tok.type = TOK_OPEN_CURLY_BRACE;
 
-    //cursor = next_non_ws_char(tok.str.end);
-    //tok = get_next_token(cursor);
+    JsonObj* result = jsonobj__create(work_mem, parser->object_key_counts[parser->next_object++]);
 
     while (tok.type != TOK_CLOSE_CURLY_BRACE) {
-        cursor = next_non_ws_char(tok.str.end);
-        tok = get_next_token(cursor);
+        tok = get_next_token(parser);
         // TODO: empty object case here
         if (tok.type != TOK_STRING) {
             std::cout << "Unexpected token type " << tok.type << std::endl;
@@ -412,26 +461,25 @@ JsonObj* parse_json_obj(mem::Arena* work_mem, const char** obj_str)
         JsonString key = token_string_to_string(tok.str);
         JsonValue* value = jsonobj__create_mapping(result, key);
 
-        cursor = next_non_ws_char(tok.str.end);
-        tok = get_next_token(cursor);
+        tok = get_next_token(parser);
         if (tok.type != TOK_COLON) {
             std::cout << "Err: expected ':'" << std::endl;
             return nullptr;
         }
 
-        cursor = next_non_ws_char(tok.str.end);
-        tok = get_next_token(cursor);
+        tok = get_next_token(parser);
         if (tok.type == TOK_OPEN_CURLY_BRACE) {
-
             value->type = JSON_OBJECT;
-            value->object = parse_json_obj(work_mem, &cursor);
+            value->object = parse_json_obj(parser);
+            if (value->object == nullptr) {
+                return nullptr;
+            }
         }
 
         if (tok.type == TOK_STRING) {
             value->type = JSON_STRING;
             value->string = work_mem->alloc_simple<JsonString>();
             *value->string = token_string_to_string(tok.str);
-            cursor = next_non_ws_char(tok.str.end);
         }
 
         if (tok.type == TOK_NUMBER) {
@@ -442,30 +490,25 @@ JsonObj* parse_json_obj(mem::Arena* work_mem, const char** obj_str)
                 std::cout << "err: malformed number" << std::endl;
                 return nullptr;
             }
-            cursor = tok.str.end;
         }
 
         if (tok.type == TOK_TRUE || tok.type == TOK_FALSE) {
             value->type = JSON_BOOL;
             value->jbool = work_mem->alloc_simple<bool>();
             *value->jbool = tok.type == TOK_TRUE;
-            cursor = tok.str.end;
         }
 
         if (tok.type == TOK_NULL) {
             value->type = JSON_NULL;
-            cursor = tok.str.end;
         }
 
         if (tok.type == TOK_OPEN_SQUARE_BRACE) {
-            cursor = next_non_ws_char(tok.str.end);
-            if (!parse_json_array(value, work_mem, &cursor)) {
+            if (!parse_json_array(value, parser)) {
                 return nullptr;
             }
         }
 
-        cursor = next_non_ws_char(cursor);
-        tok = get_next_token(cursor);
+        tok = get_next_token(parser);
         if (tok.type != TOK_COMMA && tok.type != TOK_CLOSE_CURLY_BRACE) {
             // TODO: error locations
             std::cout << "Err: expected comma or end of object but got " << tok.type << std::endl;
@@ -473,30 +516,41 @@ JsonObj* parse_json_obj(mem::Arena* work_mem, const char** obj_str)
         }
     }
 
-    *obj_str = tok.str.end;
     return result;
 }
 
 JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str)
 {
-    const char* cursor = json_str;
-    JsonValue* result = work_mem->alloc_simple<JsonValue>();
+    return parse_json_string(work_mem, json_str, strlen(json_str));
+}
 
-    //JsonValue* value = work_mem->alloc_simple<JsonValue>();
-    JsonToken tok;
-    cursor = next_non_ws_char(cursor);
-    tok = get_next_token(cursor);
+JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str, usize len)
+{
+    JsonParser parser = {0};
+    parser.doc = json_str;
+    parser.len = len;
+    parser.work_mem = work_mem;
+    if (!json_build_structural_index(work_mem, json_str, len, &parser.index)) {
+        std::cout << "Err: doc ends in the middle of a string" << std::endl;
+        return nullptr;
+    }
+    if (!count_object_keys(&parser)) {
+        return nullptr;
+    }
+
+    JsonValue* result = work_mem->alloc_simple<JsonValue>();
+    JsonToken tok = get_next_token(&parser);
 
     switch (tok.type) {
         case TOK_OPEN_CURLY_BRACE:
             result->type = JSON_OBJECT;
-            result->object = parse_json_obj(work_mem, &cursor);
+            result->object = parse_json_obj(&parser);
             if (result->object == nullptr) {
                 return nullptr;
             }
             break;
         case TOK_OPEN_SQUARE_BRACE:
-            if (!parse_json_array(result, work_mem, &cursor)) {
+            if (!parse_json_array(result, &parser)) {
                 return nullptr;
             }
             break;
@@ -506,8 +560,7 @@ JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str)
             break;
     }
 
-    cursor = next_non_ws_char(cursor);
-    tok = get_next_token(cursor);
+    tok = get_next_token(&parser);
     if (tok.type != TOK_EOF) {
         std::cout << "Expect only one object or array in a file, found another token of type " << tok.type << std::endl;
         return nullptr;
@@ -518,8 +571,258 @@ JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str)
 
 JsonValue* parse_json_file(mem::Arena* work_mem, const char* file_name)
 {
-    const char* buffer = (const char*)slurp_into_mem(work_mem, file_name);
-    return parse_json_string(work_mem, buffer);
+    usize len = 0;
+    const char* buffer = (const char*)slurp_into_mem(work_mem, file_name, &len);
+    if (!buffer) {
+        return nullptr;
+    }
+    return parse_json_string(work_mem, buffer, len);
+}
+
+bool json_reader_init(JsonReader* reader, mem::Arena* work_mem, const char* json_str, usize len)
+{
+    *reader = {};
+    reader->parser.doc = json_str;
+    reader->parser.len = len;
+    reader->parser.work_mem = work_mem;
+    reader->expect = JSON_EXPECT_VALUE;
+    if (!json_build_structural_index(work_mem, json_str, len, &reader->parser.index)) {
+        std::cout << "Err: doc ends in the middle of a string" << std::endl;
+        reader->error = true;
+        return false;
+    }
+    return true;
+}
+
+bool json_reader_open_file(JsonReader* reader, mem::Arena* work_mem, const char* file_name)
+{
+    usize len = 0;
+    const char* buffer = (const char*)slurp_into_mem(work_mem, file_name, &len);
+    if (!buffer) {
+        *reader = {};
+        reader->error = true;
+        return false;
+    }
+    return json_reader_init(reader, work_mem, buffer, len);
+}
+
+static JsonEvent
+json_reader_fail(JsonReader* reader, JsonToken tok)
+{
+    if (!reader->error) {
+        std::cout << "Err: unexpected token of type " << tok.type << " at offset "
+                  << (tok.str.start - reader->parser.doc) << std::endl;
+    }
+    reader->error = true;
+    return JsonEvent { JSON_EVENT_ERROR, tok.str };
+}
+
+static JsonEvent
+json_reader_close(JsonReader* reader, JsonEventType type, JsonToken tok)
+{
+    reader->depth--;
+    reader->expect = JSON_EXPECT_SEPARATOR;
+    return JsonEvent { type, tok.str };
+}
+
+JsonEvent json_next_event(JsonReader* reader)
+{
+    JsonToken tok = get_next_token(&reader->parser);
+    if (reader->error) {
+        return JsonEvent { JSON_EVENT_ERROR, tok.str };
+    }
+
+    ubyte container = reader->depth > 0 ? reader->containers[reader->depth - 1] : 0;
+
+    if (reader->expect == JSON_EXPECT_SEPARATOR) {
+        if (reader->depth == 0) {
+            if (tok.type != TOK_EOF) {
+                return json_reader_fail(reader, tok);
+            }
+            return JsonEvent { JSON_EVENT_EOF, tok.str };
+        }
+        if (tok.type == TOK_CLOSE_CURLY_BRACE && container == JSON_EVENT_OBJECT_BEGIN) {
+            return json_reader_close(reader, JSON_EVENT_OBJECT_END, tok);
+        }
+        if (tok.type == TOK_CLOSE_SQUARE_BRACE && container == JSON_EVENT_ARRAY_BEGIN) {
+            return json_reader_close(reader, JSON_EVENT_ARRAY_END, tok);
+        }
+        if (tok.type != TOK_COMMA) {
+            return json_reader_fail(reader, tok);
+        }
+        reader->expect = container == JSON_EVENT_OBJECT_BEGIN ? JSON_EXPECT_KEY : JSON_EXPECT_VALUE;
+        tok = get_next_token(&reader->parser);
+    }
+
+    if (reader->expect == JSON_EXPECT_KEY_OR_END && tok.type == TOK_CLOSE_CURLY_BRACE) {
+        return json_reader_close(reader, JSON_EVENT_OBJECT_END, tok);
+    }
+    if (reader->expect == JSON_EXPECT_VALUE_OR_END && tok.type == TOK_CLOSE_SQUARE_BRACE) {
+        return json_reader_close(reader, JSON_EVENT_ARRAY_END, tok);
+    }
+
+    if (reader->expect == JSON_EXPECT_KEY || reader->expect == JSON_EXPECT_KEY_OR_END) {
+        if (tok.type != TOK_STRING) {
+            return json_reader_fail(reader, tok);
+        }
+        JsonToken colon = get_next_token(&reader->parser);
+        if (colon.type != TOK_COLON) {
+            return json_reader_fail(reader, colon);
+        }
+        reader->expect = JSON_EXPECT_VALUE;
+        return JsonEvent { JSON_EVENT_KEY, token_string_to_string(tok.str) };
+    }
+
+    switch (tok.type) {
+        case TOK_OPEN_CURLY_BRACE:
+        case TOK_OPEN_SQUARE_BRACE:
+        {
+            if (reader->depth == JSON_READER_MAX_DEPTH) {
+                std::cout << "Err: json nested too deep" << std::endl;
+                return json_reader_fail(reader, tok);
+            }
+            b32 is_object = tok.type == TOK_OPEN_CURLY_BRACE;
+            JsonEventType type = is_object ? JSON_EVENT_OBJECT_BEGIN : JSON_EVENT_ARRAY_BEGIN;
+            reader->containers[reader->depth++] = (ubyte)type;
+            reader->expect = is_object ? JSON_EXPECT_KEY_OR_END : JSON_EXPECT_VALUE_OR_END;
+            return JsonEvent { type, tok.str };
+        }
+        case TOK_STRING:
+            reader->expect = JSON_EXPECT_SEPARATOR;
+            return JsonEvent { JSON_EVENT_STRING, token_string_to_string(tok.str) };
+        case TOK_NUMBER:
+            reader->expect = JSON_EXPECT_SEPARATOR;
+            return JsonEvent { JSON_EVENT_NUMBER, tok.str };
+        case TOK_TRUE:
+        case TOK_FALSE:
+            reader->expect = JSON_EXPECT_SEPARATOR;
+            return JsonEvent { JSON_EVENT_BOOL, tok.str };
+        case TOK_NULL:
+            reader->expect = JSON_EXPECT_SEPARATOR;
+            return JsonEvent { JSON_EVENT_NULL, tok.str };
+        default:
+            return json_reader_fail(reader, tok);
+    }
+}
+
+bool json_skip_value(JsonReader* reader)
+{
+    JsonEvent event = json_next_event(reader);
+    if (event.type != JSON_EVENT_OBJECT_BEGIN && event.type != JSON_EVENT_ARRAY_BEGIN) {
+        return event.type != JSON_EVENT_ERROR;
+    }
+
+    u32 depth = reader->depth - 1;
+    while (reader->depth > depth && !reader->error) {
+        json_next_event(reader);
+    }
+    return !reader->error;
+}
+
+bool json_next_key(JsonReader* reader, JsonString* key)
+{
+    JsonEvent event = json_next_event(reader);
+    if (event.type == JSON_EVENT_KEY) {
+        *key = event.str;
+        return true;
+    }
+    if (event.type != JSON_EVENT_OBJECT_END) {
+        json_reader_fail(reader, JsonToken { JSON_TOKEN_UNDEF, event.str });
+    }
+    return false;
+}
+
+bool json_next_element(JsonReader* reader)
+{
+    // peek on a copy so the element is still there for the caller
+    JsonReader peek = *reader;
+    JsonEvent event = json_next_event(&peek);
+    if (event.type == JSON_EVENT_ARRAY_END || event.type == JSON_EVENT_ERROR) {
+        *reader = peek;
+        return false;
+    }
+    return true;
+}
+
+static JsonEvent
+json_read_event(JsonReader* reader, JsonEventType type)
+{
+    JsonEvent event = json_next_event(reader);
+    if (event.type != type) {
+        json_reader_fail(reader, JsonToken { JSON_TOKEN_UNDEF, event.str });
+        event.type = JSON_EVENT_ERROR;
+    }
+    return event;
+}
+
+bool json_read_object_begin(JsonReader* reader)
+{
+    return json_read_event(reader, JSON_EVENT_OBJECT_BEGIN).type != JSON_EVENT_ERROR;
+}
+
+bool json_read_array_begin(JsonReader* reader)
+{
+    return json_read_event(reader, JSON_EVENT_ARRAY_BEGIN).type != JSON_EVENT_ERROR;
+}
+
+JsonString json_read_string(JsonReader* reader)
+{
+    JsonEvent event = json_read_event(reader, JSON_EVENT_STRING);
+    if (event.type == JSON_EVENT_ERROR) {
+        return JsonString { nullptr, nullptr };
+    }
+    return event.str;
+}
+
+f32 json_read_number(JsonReader* reader)
+{
+    JsonEvent event = json_read_event(reader, JSON_EVENT_NUMBER);
+    if (event.type == JSON_EVENT_ERROR) {
+        return 0;
+    }
+    JsonNumber number;
+    if (!extract_json_number(JsonToken { TOK_NUMBER, event.str }, &number)) {
+        std::cout << "err: malformed number" << std::endl;
+        reader->error = true;
+        return 0;
+    }
+    return number.value;
+}
+
+usize json_read_uint_array(JsonReader* reader, u32* out, usize max_out)
+{
+    if (!json_read_array_begin(reader)) {
+        return 0;
+    }
+
+    usize n = 0;
+    while (true) {
+        JsonEvent event = json_next_event(reader);
+        if (event.type == JSON_EVENT_ARRAY_END) {
+            break;
+        }
+
+        // same digit loop as the DOM's uint arrays, but the token is exact
+        // here so every byte has to be a digit
+        usize n_digits = event.str.end - event.str.start;
+        u64 v = 0;
+        for (usize i = 0; i < n_digits && i <= 10; i++) {
+            u32 digit = (u32)(event.str.start[i] - '0');
+            if (digit >= 10) {
+                n_digits = 0;
+                break;
+            }
+            v = v * 10 + digit;
+        }
+
+        if (event.type != JSON_EVENT_NUMBER || n_digits == 0 || n_digits > 10 ||
+            v > 0xFFFFFFFF || n == max_out) {
+            json_reader_fail(reader, JsonToken { JSON_TOKEN_UNDEF, event.str });
+            return n;
+        }
+        out[n++] = (u32)v;
+    }
+    return n;
 }
 
 }
@@ -535,3 +838,117 @@ std::ostream& operator<<(std::ostream& os, rigel::JsonString& js)
     return os;
 }
 
+
+#include "doctest.h"
+
+TEST_CASE("unsigned integer arrays skip the float path")
+{
+    using namespace rigel;
+
+    static ubyte backing[64 * ONE_KB];
+    mem::Arena arena(backing, 64 * ONE_KB);
+
+    const char* doc = "{\"tiles\": [0, 12 ,4294967295,\n 7], \"floats\": [1, 2.5, -3], \"big\": [4294967296]}";
+    JsonValue* root = parse_json_string(&arena, doc);
+    REQUIRE(root);
+
+    JsonValue* tiles = jsonobj_get(root->object, "tiles", 5);
+    REQUIRE(tiles->type == JSON_UINT_ARRAY);
+    REQUIRE(tiles->uint_array->n == 4);
+    CHECK(tiles->uint_array->arr[0] == 0);
+    CHECK(tiles->uint_array->arr[1] == 12);
+    CHECK(tiles->uint_array->arr[2] == 4294967295u);
+    CHECK(tiles->uint_array->arr[3] == 7);
+
+    JsonValue* floats = jsonobj_get(root->object, "floats", 6);
+    REQUIRE(floats->type == JSON_NUMBER_ARRAY);
+    REQUIRE(floats->number_array->n == 3);
+    CHECK(floats->number_array->arr[1].value == 2.5f);
+    CHECK(floats->number_array->arr[2].value == -3.0f);
+
+    CHECK(jsonobj_get(root->object, "big", 3)->type == JSON_NUMBER_ARRAY);
+}
+
+TEST_CASE("json objects are sized to their keys")
+{
+    using namespace rigel;
+
+    static ubyte backing[256 * ONE_KB];
+    mem::Arena arena(backing, 256 * ONE_KB);
+
+    // more keys than the old fixed table could hold, with a small object
+    // nested part way through so the per-object counts have to line up
+    static char doc[16 * ONE_KB];
+    char* out = doc;
+    out += sprintf(out, "{");
+    for (i32 i = 0; i < 300; i++) {
+        out += sprintf(out, "%s\"key%d\": %d", i ? ", " : "", i, i);
+        if (i == 150) {
+            out += sprintf(out, ", \"inner\": {\"a\": [{\"b\": 1}], \"c\": 2}");
+        }
+    }
+    sprintf(out, "}");
+
+    JsonValue* root = parse_json_string(&arena, doc);
+    REQUIRE(root);
+    JsonObj* obj = root->object;
+    CHECK(obj->count == 301);
+    CHECK(obj->capacity == 1024);
+    CHECK(jsonobj_get(obj, "key0", 4)->number->value == 0.0f);
+    CHECK(jsonobj_get(obj, "key299", 6)->number->value == 299.0f);
+    CHECK(jsonobj_get(obj, "key300", 6) == nullptr);
+
+    JsonObj* inner = jsonobj_get(obj, "inner", 5)->object;
+    CHECK(inner->count == 2);
+    CHECK(inner->capacity == 4);
+    CHECK(jsonobj_get(inner, "c", 1)->number->value == 2.0f);
+    JsonObj* b = jsonobj_get(inner, "a", 1)->obj_array->obj;
+    CHECK(b->capacity == 2);
+    CHECK(jsonobj_get(b, "b", 1)->number->value == 1.0f);
+}
+
+TEST_CASE("json reader streams events and can come back to a bookmark")
+{
+    using namespace rigel;
+
+    static ubyte backing[64 * ONE_KB];
+    mem::Arena arena(backing, 64 * ONE_KB);
+
+    const char* doc = "{\"data\": [3, 1, 4], \"skip\": {\"a\": [{}, []]}, \"name\": \"fg\", \"ok\": true}";
+    JsonReader reader;
+    REQUIRE(json_reader_init(&reader, &arena, doc, strlen(doc)));
+
+    CHECK(json_read_object_begin(&reader));
+    JsonString key;
+    REQUIRE(json_next_key(&reader, &key));
+    CHECK(json_str_equals(key, "data", 4));
+    JsonReader data = reader;
+    CHECK(json_skip_value(&reader));
+
+    REQUIRE(json_next_key(&reader, &key));
+    CHECK(json_str_equals(key, "skip", 4));
+    CHECK(json_skip_value(&reader));
+
+    REQUIRE(json_next_key(&reader, &key));
+    JsonString name = json_read_string(&reader);
+    CHECK(json_str_equals(name, "fg", 2));
+
+    REQUIRE(json_next_key(&reader, &key));
+    CHECK(json_next_event(&reader).type == JSON_EVENT_BOOL);
+    CHECK(!json_next_key(&reader, &key));
+    CHECK(json_next_event(&reader).type == JSON_EVENT_EOF);
+    CHECK(!reader.error);
+
+    u32 tiles[4];
+    REQUIRE(json_read_uint_array(&data, tiles, 4) == 3);
+    CHECK(tiles[0] == 3);
+    CHECK(tiles[2] == 4);
+
+    const char* bad = "{\"a\": 1 \"b\": 2}";
+    REQUIRE(json_reader_init(&reader, &arena, bad, strlen(bad)));
+    CHECK(json_read_object_begin(&reader));
+    CHECK(json_next_key(&reader, &key));
+    CHECK(json_read_number(&reader) == 1.0f);
+    CHECK(!json_next_key(&reader, &key));
+    CHECK(reader.error);
+}
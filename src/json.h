@@ -71,6 +71,7 @@ enum JsonValueType {
     JSON_OBJECT_ARRAY,
     JSON_NUMBER,
     JSON_NUMBER_ARRAY,
+    JSON_UINT_ARRAY,
     JSON_STRING,
     JSON_STRING_ARRAY,
     JSON_BOOL,
@@ -105,6 +106,8 @@ struct JsonValue {
         JsonNumber* number;
         JsonArray<JsonString>* string_array;
         JsonArray<JsonNumber>* number_array;
+        // number arrays where every member is a plain unsigned integer
+        JsonArray<u32>* uint_array;
         JsonObjArray* obj_array;
         JsonArray<bool> bool_array;
         bool* jbool;
@@ -117,11 +120,13 @@ struct JsonObjEntry
     JsonValue value;
 };
 
-// TODO(spencer): these should reeeeeeally be dynamically alloc'd
-#define N_HASHES 128
+// Open addressed table sized to the object: capacity is the smallest power
+// of two that's at least twice the number of keys, so there's always an
+// empty slot to stop a probe.
 struct JsonObj {
-    JsonObjEntry entries[N_HASHES];
     u32 count;
+    u32 capacity;
+    JsonObjEntry* entries;
 };
 
 inline u64
@@ -150,9 +155,124 @@ dbj2(const char* str, usize len)
 }
 JsonValue* jsonobj_get(JsonObj* obj, const char* key, usize key_len);
 
+// Stage 1 of the parser (json_scan.cpp). Classifies the document a block at a
+// time and records the offset of every structural character ({}[]:,) outside
+// of a string, every unescaped quote (both ends of each string) and the first
+// byte of every bare scalar (numbers, true, false, null), in document order.
+// The last position is always the offset of the end of the document, so the
+// parser sees TOK_EOF there. Stage 2 (json.cpp) just walks this index.
+enum JsonScanKind {
+    JSON_SCAN_SCALAR,
+    JSON_SCAN_SSE2,
+    JSON_SCAN_AVX2,
+    N_JSON_SCAN_KINDS
+};
+
+struct JsonStructuralIndex {
+    u32* positions;
+    u32 n;
+};
+
+// The best scanner this cpu supports is picked the first time a document is
+// scanned. Forcing a kind the cpu can't run falls back to the best one it can.
+JsonScanKind json_scan_kind();
+void json_force_scan_kind(JsonScanKind kind);
+
+// false if the document ends inside a string.
+bool json_build_structural_index(mem::Arena* work_mem, const char* json_str, usize len,
+                                 JsonStructuralIndex* out);
+
 JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str);
+JsonValue* parse_json_string(mem::Arena* work_mem, const char* json_str, usize len);
 JsonValue* parse_json_file(mem::Arena* work_mem, const char* file_name);
 
+// Stage 2 cursor over the structural index, shared by the DOM parser and the
+// reader below.
+struct JsonParser {
+    const char* doc;
+    usize len;
+    JsonStructuralIndex index;
+    u32 next;
+    mem::Arena* work_mem;
+    // DOM only: number of keys in each object, in the order the objects open
+    u32* object_key_counts;
+    u32 next_object;
+};
+
+// Streaming alternative to the DOM. A JsonReader hands back the document one
+// event at a time and never builds a tree, the only thing it allocates is the
+// structural index. Commas and colons are checked and eaten by the reader.
+// Strings and keys come back without their quotes, numbers, bools and nulls
+// as their raw text.
+//
+// A reader is a plain value, so copying one bookmarks a spot in the doc that
+// can be read again later (e.g. a layer's data before its name is known).
+enum JsonEventType {
+    JSON_EVENT_ERROR,
+    JSON_EVENT_OBJECT_BEGIN,
+    JSON_EVENT_OBJECT_END,
+    JSON_EVENT_ARRAY_BEGIN,
+    JSON_EVENT_ARRAY_END,
+    JSON_EVENT_KEY,
+    JSON_EVENT_STRING,
+    JSON_EVENT_NUMBER,
+    JSON_EVENT_BOOL,
+    JSON_EVENT_NULL,
+    JSON_EVENT_EOF,
+    N_JSON_EVENT_TYPES
+};
+
+struct JsonEvent {
+    JsonEventType type;
+    JsonString str;
+};
+
+#define JSON_READER_MAX_DEPTH 32
+
+enum JsonReaderExpect {
+    JSON_EXPECT_VALUE,
+    JSON_EXPECT_VALUE_OR_END,
+    JSON_EXPECT_KEY,
+    JSON_EXPECT_KEY_OR_END,
+    JSON_EXPECT_SEPARATOR
+};
+
+struct JsonReader {
+    JsonParser parser;
+    JsonReaderExpect expect;
+    b32 error;
+    u32 depth;
+    // JSON_EVENT_OBJECT_BEGIN or JSON_EVENT_ARRAY_BEGIN for each open container
+    ubyte containers[JSON_READER_MAX_DEPTH];
+};
+
+// false if the doc can't be scanned (e.g. it ends inside a string)
+bool json_reader_init(JsonReader* reader, mem::Arena* work_mem, const char* json_str, usize len);
+bool json_reader_open_file(JsonReader* reader, mem::Arena* work_mem, const char* file_name);
+
+JsonEvent json_next_event(JsonReader* reader);
+
+// Consumes the next value, including everything inside it if it's an object
+// or array. false on a malformed doc.
+bool json_skip_value(JsonReader* reader);
+
+// Call these after JSON_EVENT_OBJECT_BEGIN/JSON_EVENT_ARRAY_BEGIN. They
+// return false once the container has been closed (or on an error).
+// json_next_element leaves the element itself for the caller to read.
+bool json_next_key(JsonReader* reader, JsonString* key);
+bool json_next_element(JsonReader* reader);
+
+// Read one value of the given kind. Anything else puts the reader in the
+// error state and returns a zero value.
+bool json_read_object_begin(JsonReader* reader);
+bool json_read_array_begin(JsonReader* reader);
+JsonString json_read_string(JsonReader* reader);
+f32 json_read_number(JsonReader* reader);
+
+// Reads a whole array of unsigned integers straight into out, returns how
+// many there were. More than max_out members is an error.
+usize json_read_uint_array(JsonReader* reader, u32* out, usize max_out);
+
 } // namespace rigel
 
 std::ostream& operator<<(std::ostream& os, rigel::JsonString& js);
@@ -0,0 +1,346 @@
+#include "json.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RIGEL_JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace rigel {
+
+// Everything works on 64 byte blocks so one bit in a u64 is one byte of the
+// document. The per-isa part only has to turn a block into the four raw masks
+// below, the string/escape bookkeeping after that is plain integer math that
+// all the scanners share.
+constexpr static usize JSON_SCAN_BLOCK_BYTES = 64;
+
+struct JsonBlockMasks {
+    u64 whitespace;
+    u64 op;
+    u64 quote;
+    u64 backslash;
+};
+
+// carried from one block to the next
+struct JsonScanState {
+    u64 in_string;      // all ones if the previous block ended inside a string
+    u64 escaped;        // 1 if the first byte of this block is escaped
+    u64 scalar;         // 1 if the previous block ended in the middle of a scalar
+};
+
+typedef JsonBlockMasks (*JsonClassifyFn)(const char* block);
+
+static JsonBlockMasks
+classify_block_scalar(const char* block)
+{
+    JsonBlockMasks masks = {0};
+    for (usize i = 0; i < JSON_SCAN_BLOCK_BYTES; i++)
+    {
+        u64 bit = (u64)1 << i;
+        switch (block[i])
+        {
+            case ' ': case '\t': case '\n': case '\r':
+                masks.whitespace |= bit;
+                break;
+            case '{': case '}': case '[': case ']': case ':': case ',':
+                masks.op |= bit;
+                break;
+            case '"':
+                masks.quote |= bit;
+                break;
+            case '\\':
+                masks.backslash |= bit;
+                break;
+            default:
+                break;
+        }
+    }
+    return masks;
+}
+
+#ifdef RIGEL_JSON_SCAN_X86
+static JsonBlockMasks
+classify_block_sse2(const char* block)
+{
+    JsonBlockMasks masks = {0};
+    for (usize i = 0; i < JSON_SCAN_BLOCK_BYTES; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(block + i));
+
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v, _mm_set1_epi8('}'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('[')), _mm_cmpeq_epi8(v, _mm_set1_epi8(']')))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+        __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+        __m128i backslash = _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'));
+
+        masks.whitespace |= (u64)(u16)_mm_movemask_epi8(ws) << i;
+        masks.op |= (u64)(u16)_mm_movemask_epi8(op) << i;
+        masks.quote |= (u64)(u16)_mm_movemask_epi8(quote) << i;
+        masks.backslash |= (u64)(u16)_mm_movemask_epi8(backslash) << i;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2")))
+static JsonBlockMasks
+classify_block_avx2(const char* block)
+{
+    JsonBlockMasks masks = {0};
+    for (usize i = 0; i < JSON_SCAN_BLOCK_BYTES; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(block + i));
+
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('}'))),
+                _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('[')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(']')))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+        __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+        __m256i backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+
+        masks.whitespace |= (u64)(u32)_mm256_movemask_epi8(ws) << i;
+        masks.op |= (u64)(u32)_mm256_movemask_epi8(op) << i;
+        masks.quote |= (u64)(u32)_mm256_movemask_epi8(quote) << i;
+        masks.backslash |= (u64)(u32)_mm256_movemask_epi8(backslash) << i;
+    }
+    return masks;
+}
+#endif
+
+static JsonScanKind best_scan_kind = N_JSON_SCAN_KINDS;
+static JsonScanKind selected_scan_kind = N_JSON_SCAN_KINDS;
+
+static JsonScanKind
+detect_best_scan_kind()
+{
+#ifdef RIGEL_JSON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return JSON_SCAN_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return JSON_SCAN_SSE2;
+    }
+#endif
+    return JSON_SCAN_SCALAR;
+}
+
+JsonScanKind json_scan_kind()
+{
+    if (best_scan_kind == N_JSON_SCAN_KINDS)
+    {
+        best_scan_kind = detect_best_scan_kind();
+    }
+    if (selected_scan_kind == N_JSON_SCAN_KINDS)
+    {
+        selected_scan_kind = best_scan_kind;
+    }
+    return selected_scan_kind;
+}
+
+void json_force_scan_kind(JsonScanKind kind)
+{
+    assert(kind < N_JSON_SCAN_KINDS && "unknown json scan kind");
+    if (best_scan_kind == N_JSON_SCAN_KINDS)
+    {
+        best_scan_kind = detect_best_scan_kind();
+    }
+    // the kinds are ordered so anything at or below the best one will run
+    selected_scan_kind = kind <= best_scan_kind ? kind : best_scan_kind;
+}
+
+static JsonClassifyFn
+classify_fn_for(JsonScanKind kind)
+{
+    switch (kind)
+    {
+#ifdef RIGEL_JSON_SCAN_X86
+        case JSON_SCAN_AVX2:
+            return classify_block_avx2;
+        case JSON_SCAN_SSE2:
+            return classify_block_sse2;
+#endif
+        default:
+            return classify_block_scalar;
+    }
+}
+
+// Bit i of the result is the xor of bits 0..i of x, so with x as the quote
+// mask it's set from an opening quote up to (not including) its closing one.
+static inline u64
+prefix_xor(u64 x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static inline u64
+find_escaped(u64 backslash, JsonScanState* state)
+{
+    if (!backslash && !state->escaped)
+    {
+        return 0;
+    }
+
+    // Backslashes are rare enough in our data that walking the block is fine.
+    // A run of backslashes escapes every other byte, so this has to go in order.
+    u64 escaped = 0;
+    u64 escaping = state->escaped;
+    for (usize i = 0; i < JSON_SCAN_BLOCK_BYTES; i++)
+    {
+        u64 bit = (u64)1 << i;
+        if (escaping)
+        {
+            escaped |= bit;
+            escaping = 0;
+        }
+        else if (backslash & bit)
+        {
+            escaping = 1;
+        }
+    }
+    state->escaped = escaping;
+    return escaped;
+}
+
+static inline u64
+find_structurals(JsonBlockMasks masks, JsonScanState* state)
+{
+    u64 escaped = find_escaped(masks.backslash, state);
+    u64 quote = masks.quote & ~escaped;
+
+    u64 in_string = prefix_xor(quote) ^ state->in_string;
+    state->in_string = (u64)((i64)in_string >> 63);
+
+    u64 outside = ~in_string;
+    u64 scalar = ~(masks.whitespace | masks.op | masks.quote) & outside;
+    u64 scalar_starts = scalar & ~((scalar << 1) | state->scalar);
+    state->scalar = scalar >> 63;
+
+    return (masks.op & outside) | quote | scalar_starts;
+}
+
+static inline u32
+flatten_bits(u32* out, u32 base, u64 bits)
+{
+    u32 n = 0;
+    while (bits)
+    {
+        out[n++] = base + (u32)__builtin_ctzll(bits);
+        bits &= bits - 1;
+    }
+    return n;
+}
+
+bool json_build_structural_index(mem::Arena* work_mem, const char* json_str, usize len,
+                                 JsonStructuralIndex* out)
+{
+    JsonClassifyFn classify = classify_fn_for(json_scan_kind());
+
+    // every byte can be at most one structural, plus the end of the document
+    out->positions = work_mem->alloc_array<u32>(len + 1);
+    out->n = 0;
+    if (!out->positions)
+    {
+        return false;
+    }
+
+    JsonScanState state = {0};
+    usize offset = 0;
+    for (; offset + JSON_SCAN_BLOCK_BYTES <= len; offset += JSON_SCAN_BLOCK_BYTES)
+    {
+        u64 structurals = find_structurals(classify(json_str + offset), &state);
+        out->n += flatten_bits(out->positions + out->n, offset, structurals);
+    }
+
+    if (offset < len)
+    {
+        // pad the tail with whitespace so it doesn't add anything
+        char tail[JSON_SCAN_BLOCK_BYTES];
+        memset(tail, ' ', JSON_SCAN_BLOCK_BYTES);
+        memcpy(tail, json_str + offset, len - offset);
+        u64 structurals = find_structurals(classify(tail), &state);
+        out->n += flatten_bits(out->positions + out->n, offset, structurals);
+    }
+
+    out->positions[out->n++] = len;
+    return state.in_string == 0;
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+TEST_CASE("every json scanner finds the same structurals")
+{
+    using namespace rigel;
+
+    static ubyte backing[256 * ONE_KB];
+    mem::Arena arena(backing, 256 * ONE_KB);
+
+    const char* doc =
+        "{ \"name\": \"a \\\"quoted\\\" [word]\", \"data\":[1, 22,333 , -4.5e3],\n"
+        "  \"path\": \"..\\\\\\\\tiles\\\\\", \"ok\": true, \"none\":null, \"o\": {\"k\": false} }";
+    char shifted[256];
+
+    // slide the document across the block boundary so every byte of it,
+    // including the runs of backslashes, lands on the edge at some point
+    for (usize shift = 0; shift <= 64; shift++)
+    {
+        memset(shifted, ' ', shift);
+        strcpy(shifted + shift, doc);
+        usize len = strlen(shifted);
+
+        JsonStructuralIndex expected;
+        json_force_scan_kind(JSON_SCAN_SCALAR);
+        REQUIRE(json_build_structural_index(&arena, shifted, len, &expected));
+
+        const char* s = shifted + shift;
+        u32 base = (u32)shift;
+        CHECK(s[expected.positions[0] - base] == '{');
+        CHECK(s[expected.positions[3] - base] == ':');
+        // the escaped quotes and the brackets inside the string are skipped
+        CHECK(s[expected.positions[5] - base] == '"');
+        CHECK(s[expected.positions[6] - base] == ',');
+        CHECK(s[expected.positions[10] - base] == '[');
+        CHECK(s[expected.positions[11] - base] == '1');
+        CHECK(s[expected.positions[13] - base] == '2');
+        CHECK(expected.positions[expected.n - 1] == len);
+
+        for (i32 kind = JSON_SCAN_SSE2; kind < N_JSON_SCAN_KINDS; kind++)
+        {
+            json_force_scan_kind((JsonScanKind)kind);
+            JsonStructuralIndex index;
+            REQUIRE(json_build_structural_index(&arena, shifted, len, &index));
+            REQUIRE(index.n == expected.n);
+            CHECK(memcmp(index.positions, expected.positions, expected.n * sizeof(u32)) == 0);
+        }
+        arena.reinit();
+    }
+
+    JsonStructuralIndex unterminated;
+    CHECK(!json_build_structural_index(&arena, "{\"oops", 6, &unterminated));
+
+    // asking for the widest scanner gets the best one this cpu has
+    json_force_scan_kind(JSON_SCAN_AVX2);
+}
@@ -0,0 +1,462 @@
+#include "level_file.h"
+#include "world.h"
+#include "json.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace rigel {
+
+// what we care about from an object in one of Tiled's object layers. Which
+// fields mean anything depends on the layer it came from.
+struct TiledObject
+{
+    f32 x;
+    f32 y;
+    EntityType entity_type;
+    LightType light_type;
+    m::Vec3 color;
+    f32 intensity;
+};
+
+static void
+read_tiled_object_property(JsonReader* reader, TiledObject* object)
+{
+    // properties are {"name", "type", "value"}, and the value can come before
+    // the name, so bookmark it and read it once we know what it is
+    JsonString name = {};
+    JsonReader value = {};
+    b32 found_value = false;
+
+    JsonString key;
+    json_read_object_begin(reader);
+    while (json_next_key(reader, &key)) {
+        if (json_str_equals(key, "name", 4)) {
+            name = json_read_string(reader);
+        } else if (json_str_equals(key, "value", 5)) {
+            value = *reader;
+            found_value = true;
+            json_skip_value(reader);
+        } else {
+            json_skip_value(reader);
+        }
+    }
+
+    if (!found_value) {
+        return;
+    }
+
+    if (json_str_equals(name, "Type", 4)) {
+        // TODO: jsonstrings reeeeeeally suck
+        char buf[64];
+        auto type_s = json_read_string(&value);
+        json_str_copy(buf, &type_s, sizeof(buf));
+        object->entity_type = get_entity_type_for_str(buf);
+    } else if (json_str_equals(name, "LightType", 9)) {
+        char buf[64];
+        auto type_s = json_read_string(&value);
+        json_str_copy(buf, &type_s, sizeof(buf));
+        object->light_type = get_light_type_for_str(buf);
+    } else if (json_str_equals(name, "Color", 5)) {
+        char buf[32];
+        auto color_s = json_read_string(&value);
+        json_str_copy(buf, &color_s, sizeof(buf));
+        object->color = parse_color_str(buf);
+    } else if (json_str_equals(name, "Intensity", 9)) {
+        object->intensity = json_read_number(&value);
+    }
+}
+
+static void
+read_tiled_object(JsonReader* reader, TiledObject* object)
+{
+    *object = {};
+    object->entity_type = EntityType_NumberOfTypes;
+    object->light_type = LightType_NLightTypes;
+    object->intensity = -1;
+
+    JsonString key;
+    json_read_object_begin(reader);
+    while (json_next_key(reader, &key)) {
+        if (json_str_equals(key, "x", 1)) {
+            object->x = json_read_number(reader);
+        } else if (json_str_equals(key, "y", 1)) {
+            object->y = json_read_number(reader);
+            object->y = (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS) - object->y;
+        } else if (json_str_equals(key, "properties", 10)) {
+            json_read_array_begin(reader);
+            while (json_next_element(reader)) {
+                read_tiled_object_property(reader, object);
+            }
+        } else {
+            json_skip_value(reader);
+        }
+    }
+}
+
+static void
+read_tile_layer(mem::Arena* level_arena, LevelDesc* level, RlvlTileLayer layer, JsonReader* data)
+{
+    u32 tile_ids[WORLD_SIZE_TILES];
+    usize n_tiles = json_read_uint_array(data, tile_ids, WORLD_SIZE_TILES);
+    assert(!data->error && "data is not an array of tile ids");
+
+    level->tiles[layer] = level_arena->alloc_array<TileType>(WORLD_SIZE_TILES);
+    level->tile_sprites[layer] = level_arena->alloc_array<u16>(WORLD_SIZE_TILES);
+    level->n_nonempty_tiles[layer] =
+      fill_tiles_from_ids(level->tiles[layer], level->tile_sprites[layer], tile_ids, n_tiles);
+}
+
+static void
+read_entity_layer(LevelDesc* level, JsonReader* objects)
+{
+    json_read_array_begin(objects);
+    while (json_next_element(objects)) {
+        TiledObject object;
+        read_tiled_object(objects, &object);
+
+        if (object.entity_type != EntityType_NumberOfTypes) {
+            assert(level->n_entities < MAX_ENTITIES && "too many entities!");
+            RlvlEntity* entity = level->entities + level->n_entities++;
+            entity->type = object.entity_type;
+            entity->x = object.x;
+            entity->y = object.y;
+        }
+    }
+}
+
+static void
+read_light_layer(LevelDesc* level, JsonReader* objects)
+{
+    json_read_array_begin(objects);
+    while (json_next_element(objects)) {
+        TiledObject object;
+        read_tiled_object(objects, &object);
+
+        if(object.light_type != LightType_NLightTypes
+                    && object.color != m::Vec3{0, 0, 0}
+                    && object.intensity > 0)
+        {
+            assert(level->n_lights < MAX_LIGHTS && "too many lights!");
+            m::Vec3 color = object.color * object.intensity;
+            RlvlLight* light = level->lights + level->n_lights++;
+            light->type = object.light_type;
+            light->x = object.x;
+            light->y = object.y;
+            light->r = color.x;
+            light->g = color.y;
+            light->b = color.z;
+        }
+        else
+        {
+            std::cout << "skipping light with not enough props..." << std::endl;
+        }
+    }
+}
+
+b32
+read_level_json(mem::Arena* level_arena, mem::Arena* temp_arena, const char* file_path, LevelDesc* out)
+{
+    *out = {};
+    out->entities = temp_arena->alloc_array<RlvlEntity>(MAX_ENTITIES);
+    out->lights = temp_arena->alloc_array<RlvlLight>(MAX_LIGHTS);
+    // Tiled levels don't have zone triggers (yet)
+    out->zone_triggers = nullptr;
+
+    JsonReader reader;
+    json_reader_open_file(&reader, temp_arena, file_path);
+    json_read_object_begin(&reader);
+    if (reader.error) {
+        std::cerr << "Couldn't read level '" << file_path << "'" << std::endl;
+        return false;
+    }
+
+    f32 width = 0;
+    f32 height = 0;
+
+    JsonString key;
+    while (json_next_key(&reader, &key)) {
+        if (json_str_equals(key, "width", 5)) {
+            width = json_read_number(&reader);
+            continue;
+        }
+        if (json_str_equals(key, "height", 6)) {
+            height = json_read_number(&reader);
+            continue;
+        }
+        if (!json_str_equals(key, "layers", 6)) {
+            json_skip_value(&reader);
+            continue;
+        }
+
+        json_read_array_begin(&reader);
+        while (json_next_element(&reader)) {
+            // Tiled writes a layer's data/objects before its name, so
+            // bookmark them and read them once the name turns up
+            JsonString name = {};
+            JsonReader contents = {};
+
+            json_read_object_begin(&reader);
+            while (json_next_key(&reader, &key)) {
+                if (json_str_equals(key, "name", 4)) {
+                    name = json_read_string(&reader);
+                } else if (json_str_equals(key, "data", 4) || json_str_equals(key, "objects", 7)) {
+                    contents = reader;
+                    json_skip_value(&reader);
+                } else {
+                    json_skip_value(&reader);
+                }
+            }
+            assert(name.start && "layer has no name");
+            assert(contents.parser.doc && "layer has no data or objects");
+
+            if (json_str_equals(name, "fg", 2)) {
+                read_tile_layer(level_arena, out, RlvlTileLayer_Foreground, &contents);
+            } else if (json_str_equals(name, "bg", 2)) {
+                read_tile_layer(level_arena, out, RlvlTileLayer_Background, &contents);
+            } else if (json_str_equals(name, "decoration", 10)) {
+                read_tile_layer(level_arena, out, RlvlTileLayer_Decoration, &contents);
+            } else if (json_str_equals(name, "entities", 8)) {
+                read_entity_layer(out, &contents);
+            } else if (json_str_equals(name, "lights", 6)) {
+                read_light_layer(out, &contents);
+            } else {
+                assert(false && "Found an unexpected layer");
+            }
+        }
+    }
+    if (reader.error) {
+        std::cerr << "Malformed level json in '" << file_path << "'" << std::endl;
+        return false;
+    }
+
+    if (width != WORLD_WIDTH_TILES || height != WORLD_HEIGHT_TILES) {
+        std::cerr << "Level '" << file_path << "' is " << width << "x" << height
+                  << " tiles, expected " << WORLD_WIDTH_TILES << "x" << WORLD_HEIGHT_TILES << std::endl;
+        return false;
+    }
+
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        if (!out->tiles[layer]) {
+            std::cerr << "Level '" << file_path << "' is missing a tile layer" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static u32
+align_section(u32 offset)
+{
+    return (offset + RLVL_SECTION_ALIGN - 1) & ~(RLVL_SECTION_ALIGN - 1);
+}
+
+b32
+write_level_file(const LevelDesc* level, const char* file_path)
+{
+    RlvlHeader header = {};
+    header.magic = RLVL_MAGIC;
+    header.version = RLVL_VERSION;
+    header.width_tiles = WORLD_WIDTH_TILES;
+    header.height_tiles = WORLD_HEIGHT_TILES;
+
+    u32 offset = align_section(sizeof(RlvlHeader));
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        header.layers[layer].n_nonempty_tiles = level->n_nonempty_tiles[layer];
+        header.layers[layer].tiles_offset = offset;
+        offset = align_section(offset + WORLD_SIZE_TILES * sizeof(TileType));
+        header.layers[layer].sprites_offset = offset;
+        offset = align_section(offset + WORLD_SIZE_TILES * sizeof(u16));
+    }
+
+    header.n_entities = level->n_entities;
+    header.entities_offset = offset;
+    offset = align_section(offset + level->n_entities * sizeof(RlvlEntity));
+
+    header.n_lights = level->n_lights;
+    header.lights_offset = offset;
+    offset = align_section(offset + level->n_lights * sizeof(RlvlLight));
+
+    header.n_zone_triggers = level->n_zone_triggers;
+    header.zone_triggers_offset = offset;
+    offset = align_section(offset + level->n_zone_triggers * sizeof(RlvlZoneTrigger));
+
+    header.file_size = offset;
+
+    // zeroed so the padding between sections is too, and baking the same
+    // level twice gives the same bytes
+    ubyte* out = new ubyte[header.file_size]();
+    memcpy(out, &header, sizeof(RlvlHeader));
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        memcpy(out + header.layers[layer].tiles_offset, level->tiles[layer], WORLD_SIZE_TILES * sizeof(TileType));
+        memcpy(out + header.layers[layer].sprites_offset, level->tile_sprites[layer], WORLD_SIZE_TILES * sizeof(u16));
+    }
+    if (level->n_entities) {
+        memcpy(out + header.entities_offset, level->entities, level->n_entities * sizeof(RlvlEntity));
+    }
+    if (level->n_lights) {
+        memcpy(out + header.lights_offset, level->lights, level->n_lights * sizeof(RlvlLight));
+    }
+    if (level->n_zone_triggers) {
+        memcpy(out + header.zone_triggers_offset, level->zone_triggers, level->n_zone_triggers * sizeof(RlvlZoneTrigger));
+    }
+
+    b32 result = dump_to_file(file_path, out, header.file_size);
+    delete[] out;
+
+    return result;
+}
+
+static b32
+section_fits(const RlvlHeader& header, u32 offset, u32 n_bytes)
+{
+    return (offset % RLVL_SECTION_ALIGN) == 0
+        && offset >= sizeof(RlvlHeader)
+        && offset <= header.file_size
+        && n_bytes <= header.file_size - offset;
+}
+
+b32
+map_level_file(const char* file_path, MappedFile* file, LevelDesc* out)
+{
+    *out = {};
+    if (!map_file(file_path, file)) {
+        std::cerr << "Couldn't map level '" << file_path << "'" << std::endl;
+        return false;
+    }
+
+    b32 ok = file->size >= sizeof(RlvlHeader);
+    RlvlHeader header = {};
+    if (ok) {
+        memcpy(&header, file->data, sizeof(RlvlHeader));
+        ok = header.magic == RLVL_MAGIC && header.version == RLVL_VERSION;
+    }
+    if (!ok) {
+        std::cerr << "'" << file_path << "' isn't a version " << RLVL_VERSION << " rlvl file" << std::endl;
+        unmap_file(file);
+        return false;
+    }
+
+    ok = header.file_size == file->size
+      && header.width_tiles == WORLD_WIDTH_TILES
+      && header.height_tiles == WORLD_HEIGHT_TILES
+      && header.n_entities <= MAX_ENTITIES
+      && header.n_lights <= MAX_LIGHTS
+      && header.n_zone_triggers <= MAX_ZONE_TRIGGERS;
+    for (u32 layer = 0; ok && layer < RlvlTileLayer_N; layer++) {
+        const RlvlTileLayerInfo& info = header.layers[layer];
+        ok = section_fits(header, info.tiles_offset, WORLD_SIZE_TILES * sizeof(TileType))
+          && section_fits(header, info.sprites_offset, WORLD_SIZE_TILES * sizeof(u16))
+          && info.n_nonempty_tiles <= WORLD_SIZE_TILES;
+    }
+    ok = ok
+      && section_fits(header, header.entities_offset, header.n_entities * sizeof(RlvlEntity))
+      && section_fits(header, header.lights_offset, header.n_lights * sizeof(RlvlLight))
+      && section_fits(header, header.zone_triggers_offset, header.n_zone_triggers * sizeof(RlvlZoneTrigger));
+    if (!ok) {
+        std::cerr << "Level '" << file_path << "' is truncated or corrupt" << std::endl;
+        unmap_file(file);
+        return false;
+    }
+
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        out->tiles[layer] = reinterpret_cast<TileType*>(file->data + header.layers[layer].tiles_offset);
+        out->tile_sprites[layer] = reinterpret_cast<u16*>(file->data + header.layers[layer].sprites_offset);
+        out->n_nonempty_tiles[layer] = header.layers[layer].n_nonempty_tiles;
+    }
+    out->n_entities = header.n_entities;
+    out->entities = reinterpret_cast<RlvlEntity*>(file->data + header.entities_offset);
+    out->n_lights = header.n_lights;
+    out->lights = reinterpret_cast<RlvlLight*>(file->data + header.lights_offset);
+    out->n_zone_triggers = header.n_zone_triggers;
+    out->zone_triggers = reinterpret_cast<RlvlZoneTrigger*>(file->data + header.zone_triggers_offset);
+
+    return true;
+}
+
+b32
+baked_level_path(const char* json_path, char* out, usize out_size)
+{
+    const char* ext = strrchr(json_path, '.');
+    usize stem_len = ext ? ext - json_path : strlen(json_path);
+    if (stem_len + sizeof(".rlvl") > out_size) {
+        return false;
+    }
+    memcpy(out, json_path, stem_len);
+    memcpy(out + stem_len, ".rlvl", sizeof(".rlvl"));
+    return true;
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+namespace rigel {
+
+TEST_CASE("baked levels map back to what was written")
+{
+    static TileType tiles[RlvlTileLayer_N][WORLD_SIZE_TILES];
+    static u16 sprites[RlvlTileLayer_N][WORLD_SIZE_TILES];
+
+    LevelDesc level = {};
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        for (u32 i = 0; i < WORLD_SIZE_TILES; i++) {
+            sprites[layer][i] = (u16)((i * 7 + layer) % 40);
+            tiles[layer][i] = sprites[layer][i] ? TileType::WALL : TileType::EMPTY;
+        }
+        level.tiles[layer] = tiles[layer];
+        level.tile_sprites[layer] = sprites[layer];
+        level.n_nonempty_tiles[layer] = 17 + layer;
+    }
+
+    RlvlEntity entities[2] = { { EntityType_Player, 16, 32 }, { EntityType_Bumpngo, 100.5f, 64 } };
+    RlvlLight lights[1] = { { LightType_Circle, 40, 50, 0.25f, 0.5f, 1.0f } };
+    RlvlZoneTrigger triggers[1] = { { 0, 0, 16, 368, 1, 2 } };
+    level.n_entities = 2;
+    level.entities = entities;
+    level.n_lights = 1;
+    level.lights = lights;
+    level.n_zone_triggers = 1;
+    level.zone_triggers = triggers;
+
+    const char* path = "/tmp/rigel_level_file_test.rlvl";
+    REQUIRE(write_level_file(&level, path));
+
+    MappedFile file;
+    LevelDesc mapped;
+    REQUIRE(map_level_file(path, &file, &mapped));
+
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        CHECK(memcmp(mapped.tiles[layer], tiles[layer], sizeof(tiles[layer])) == 0);
+        CHECK(memcmp(mapped.tile_sprites[layer], sprites[layer], sizeof(sprites[layer])) == 0);
+        CHECK(mapped.n_nonempty_tiles[layer] == 17 + layer);
+        CHECK(((uintptr_t)mapped.tile_sprites[layer] % alignof(u16)) == 0);
+    }
+    REQUIRE(mapped.n_entities == 2);
+    CHECK(mapped.entities[1].type == EntityType_Bumpngo);
+    CHECK(mapped.entities[1].x == 100.5f);
+    REQUIRE(mapped.n_lights == 1);
+    CHECK(mapped.lights[0].b == 1.0f);
+    REQUIRE(mapped.n_zone_triggers == 1);
+    CHECK(mapped.zone_triggers[0].height == 368);
+    CHECK(mapped.zone_triggers[0].target_id == 2);
+
+    unmap_file(&file);
+
+    // a file cut short is refused rather than read past its end
+    usize n_bytes = 0;
+    static ubyte backing[16 * ONE_KB];
+    mem::Arena arena(backing, sizeof(backing));
+    ubyte* bytes = slurp_into_mem(&arena, path, &n_bytes);
+    REQUIRE(bytes);
+    REQUIRE(dump_to_file(path, bytes, n_bytes - 16));
+    CHECK_FALSE(map_level_file(path, &file, &mapped));
+
+    char baked[64];
+    CHECK(baked_level_path("resource/tiled/stage_1/junction.tmj", baked, sizeof(baked)));
+    CHECK(strcmp(baked, "resource/tiled/stage_1/junction.rlvl") == 0);
+    CHECK_FALSE(baked_level_path("resource/tiled/stage_1/junction.tmj", baked, 8));
+}
+
+} // namespace rigel
@@ -0,0 +1,121 @@
+#ifndef RIGEL_LEVEL_FILE_H
+#define RIGEL_LEVEL_FILE_H
+
+#include "rigel.h"
+#include "mem.h"
+#include "tilemap.h"
+#include "fs_linux.h"
+
+namespace rigel {
+
+// Baked levels (.rlvl). Tiled json stays the authoring format, tools/bake_level
+// turns a .tmj into one of these and load_world_chunk maps it in place of
+// parsing the json when it's there and newer than the .tmj.
+//
+// On disk a level is an RlvlHeader followed by its sections, each at the
+// offset the header gives and aligned to RLVL_SECTION_ALIGN. Everything is
+// little-endian and laid out the way the game uses it, so once the file is
+// mapped the tilemaps point straight into it. Entity and light types are
+// stored as their enum values, so bump RLVL_VERSION if those enums change.
+
+constexpr static u32 RLVL_MAGIC = 0x4c564c52; // "RLVL"
+constexpr static u32 RLVL_VERSION = 1;
+constexpr static u32 RLVL_SECTION_ALIGN = 16;
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "rlvl files are little-endian");
+static_assert(sizeof(TileType) == 1, "rlvl stores a byte per tile type");
+
+enum RlvlTileLayer
+{
+    RlvlTileLayer_Foreground,
+    RlvlTileLayer_Background,
+    RlvlTileLayer_Decoration,
+    RlvlTileLayer_N
+};
+
+struct RlvlTileLayerInfo
+{
+    u32 tiles_offset;       // WORLD_SIZE_TILES TileTypes
+    u32 sprites_offset;     // WORLD_SIZE_TILES u16 sprite ids
+    u32 n_nonempty_tiles;
+    u32 reserved;
+};
+
+struct RlvlHeader
+{
+    u32 magic;
+    u32 version;
+    u32 file_size;
+    u16 width_tiles;
+    u16 height_tiles;
+
+    RlvlTileLayerInfo layers[RlvlTileLayer_N];
+
+    u32 n_entities;
+    u32 entities_offset;
+    u32 n_lights;
+    u32 lights_offset;
+    u32 n_zone_triggers;
+    u32 zone_triggers_offset;
+};
+
+struct RlvlEntity
+{
+    u32 type;   // EntityType
+    f32 x;
+    f32 y;
+};
+
+struct RlvlLight
+{
+    u32 type;   // LightType
+    f32 x;
+    f32 y;
+    // already scaled by the light's intensity
+    f32 r;
+    f32 g;
+    f32 b;
+};
+
+struct RlvlZoneTrigger
+{
+    f32 x;
+    f32 y;
+    f32 width;
+    f32 height;
+    u32 target_effect;  // EffectId
+    u32 target_id;
+};
+
+// A level as authored, whichever file it came from. When it was mapped from
+// an .rlvl everything points into the mapping.
+struct LevelDesc
+{
+    TileType* tiles[RlvlTileLayer_N];
+    u16* tile_sprites[RlvlTileLayer_N];
+    u32 n_nonempty_tiles[RlvlTileLayer_N];
+
+    u32 n_entities;
+    RlvlEntity* entities;
+    u32 n_lights;
+    RlvlLight* lights;
+    u32 n_zone_triggers;
+    RlvlZoneTrigger* zone_triggers;
+};
+
+// Reads a Tiled .tmj. The tile layers are allocated from level_arena since
+// they outlive the load, everything else comes out of temp_arena.
+b32 read_level_json(mem::Arena* level_arena, mem::Arena* temp_arena, const char* file_path, LevelDesc* out);
+
+b32 write_level_file(const LevelDesc* level, const char* file_path);
+
+// Maps an .rlvl and points `out` into it. The mapping has to stay around as
+// long as anything uses the level, unmap it with unmap_file.
+b32 map_level_file(const char* file_path, MappedFile* file, LevelDesc* out);
+
+// e.g. resource/tiled/stage_1/junction.tmj -> resource/tiled/stage_1/junction.rlvl
+b32 baked_level_path(const char* json_path, char* out, usize out_size);
+
+} // namespace rigel
+
+#endif // RIGEL_LEVEL_FILE_H
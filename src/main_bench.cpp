@@ -0,0 +1,236 @@
+#include "rigel.h"
+#include "mem.h"
+#include "world.h"
+#include "render.h"
+#include "game.h"
+#include "debug.h"
+#include "input.h"
+#include "input_journal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <time.h>
+
+// Headless simulation benchmark. Loads the stage the same way the game does,
+// minus the window and GL context, then runs simulate_one_tick at a fixed dt
+// and reports how long each tick took.
+//
+// usage: rigel_bench [n_ticks] [--replay <journal>] [--max-p99-ns <ns>] [--arena-report] [--load-all] [--render]
+// (run from the root of the repo so resource paths resolve)
+//
+// With --replay the inputs and dt come from a journal recorded with
+// `rigel --record`, and n_ticks defaults to the length of the journal.
+// With --max-p99-ns the exit code is non-zero if the p99 tick time is
+// over budget, so the bench can be used as a regression gate.
+// With --arena-report the arena usage is printed after the load and again
+// after the run. --load-all loads every chunk in the stage up front instead
+// of streaming them in around the player. --render also submits each tick's
+// entity batch to the recording GL backend, outside the tick timing, and
+// reports how fast submit_batch got through it.
+
+using namespace rigel;
+
+constexpr static i64 DEFAULT_BENCH_TICKS = 10000;
+
+static i64
+now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((i64)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static i64
+percentile(i64* sorted, i64 n, f64 pct)
+{
+    i64 idx = (i64)(pct * (n - 1));
+    return sorted[idx];
+}
+
+int main(int argc, char** argv)
+{
+    i64 n_ticks = -1;
+    i64 max_p99_ns = -1;
+    const char* replay_journal_path = nullptr;
+    b32 arena_report = false;
+    b32 stream_chunks = true;
+    b32 submit_batches = false;
+    b32 bad_args = false;
+    for (i32 arg = 1; arg < argc && !bad_args; arg++)
+    {
+        if (strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc)
+        {
+            replay_journal_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--max-p99-ns") == 0 && arg + 1 < argc)
+        {
+            max_p99_ns = strtoll(argv[++arg], nullptr, 10);
+            bad_args = max_p99_ns <= 0;
+        }
+        else if (strcmp(argv[arg], "--arena-report") == 0)
+        {
+            arena_report = true;
+        }
+        else if (strcmp(argv[arg], "--load-all") == 0)
+        {
+            stream_chunks = false;
+        }
+        else if (strcmp(argv[arg], "--render") == 0)
+        {
+            submit_batches = true;
+        }
+        else if (argv[arg][0] != '-' && n_ticks < 0)
+        {
+            n_ticks = strtoll(argv[arg], nullptr, 10);
+            bad_args = n_ticks <= 0;
+        }
+        else
+        {
+            bad_args = true;
+        }
+    }
+
+    if (bad_args)
+    {
+        std::cerr << "usage: " << argv[0] << " [n_ticks] [--replay <journal>] [--max-p99-ns <ns>] [--arena-report] [--load-all] [--render]" << std::endl;
+        return 1;
+    }
+
+    mem::GameMem memory = mem::initialize_game_memory();
+
+    f32 dt = UPDATE_TIME_NS / 1000000000.0f;
+    InputJournal journal = {0};
+    if (replay_journal_path)
+    {
+        if (!input_journal_load(&journal, &memory.resource_arena, replay_journal_path))
+        {
+            return 1;
+        }
+        dt = journal.tick_ns / 1000000000.0f;
+        if (n_ticks < 0 || n_ticks > journal.n_ticks)
+        {
+            n_ticks = journal.n_ticks;
+        }
+    }
+    if (n_ticks < 0)
+    {
+        n_ticks = DEFAULT_BENCH_TICKS;
+    }
+
+    resource_initialize(memory.resource_arena);
+
+#ifdef RIGEL_DEBUG
+    debug::init_debug(&memory.debug_arena);
+#endif
+
+    render::GLRecording* gl_recording = render::initialize_headless_renderer(&memory.gfx_arena);
+
+    memory.frame_temp_arena.reinit_zeroed();
+
+    i64 load_start = now_ns();
+    GameState* game_state = load_game(memory, stream_chunks);
+    i64 load_time = now_ns() - load_start;
+
+    if (arena_report)
+    {
+        mem::print_game_mem_report(mem::make_game_mem_report(memory), "after load");
+    }
+
+    memory.frame_temp_arena.reinit();
+    if (arena_report)
+    {
+        mem::reset_game_mem_stats(memory);
+    }
+
+    i64* tick_times = new i64[n_ticks];
+    i64 submit_time = 0;
+    u64 items_submitted = 0;
+    if (submit_batches)
+    {
+        render::default_atlas_rebuffer(&memory.frame_temp_arena);
+        memory.frame_temp_arena.reinit();
+        render::gl_recording_reset(gl_recording);
+    }
+
+    for (i64 tick = 0; tick < n_ticks; tick++)
+    {
+#ifdef RIGEL_DEBUG
+        debug::new_frame();
+#endif
+        render::BatchBuffer* entity_batch_buffer = render::make_batch_buffer(&memory.frame_temp_arena, 256);
+        if (submit_batches)
+        {
+            // same as the game loop
+            render::batch_push_use_shader_cmd(entity_batch_buffer, render::game_shaders + render::SIMPLE_SPRITE_SHADER);
+            render::batch_push_attach_texture_cmd(entity_batch_buffer, 0, render::get_default_sprite_atlas_texture());
+        }
+
+        if (replay_journal_path)
+        {
+            input_journal_replay_next(&journal, &g_input_state);
+        }
+
+        poll_resource_loads();
+
+        i64 tick_start = now_ns();
+
+        simulate_one_tick(memory, game_state, dt, entity_batch_buffer);
+        update_animations(game_state->active_world_chunk, dt);
+
+        tick_times[tick] = now_ns() - tick_start;
+
+        if (submit_batches)
+        {
+            items_submitted += entity_batch_buffer->items_in_buffer;
+            i64 submit_start = now_ns();
+            render::submit_batch(entity_batch_buffer, &memory.frame_temp_arena);
+            submit_time += now_ns() - submit_start;
+        }
+
+        memory.frame_temp_arena.reinit();
+    }
+
+    i64 total = 0;
+    for (i64 tick = 0; tick < n_ticks; tick++)
+    {
+        total += tick_times[tick];
+    }
+    std::sort(tick_times, tick_times + n_ticks);
+
+    std::cout << std::endl;
+    std::cout << "load_game: " << load_time << " ns" << std::endl;
+    std::cout << "ticks: " << n_ticks << " at dt " << dt << "s" << std::endl;
+    std::cout << "ns/tick mean: " << (total / n_ticks) << std::endl;
+    std::cout << "ns/tick min:  " << tick_times[0] << std::endl;
+    std::cout << "ns/tick p50:  " << percentile(tick_times, n_ticks, 0.50) << std::endl;
+    std::cout << "ns/tick p90:  " << percentile(tick_times, n_ticks, 0.90) << std::endl;
+    std::cout << "ns/tick p99:  " << percentile(tick_times, n_ticks, 0.99) << std::endl;
+    std::cout << "ns/tick max:  " << tick_times[n_ticks - 1] << std::endl;
+
+    if (submit_batches)
+    {
+        f64 submit_secs = submit_time / 1000000000.0;
+        std::cout << "submit_batch: " << items_submitted << " items in " << submit_time << " ns, "
+                  << (u64)(submit_secs > 0 ? items_submitted / submit_secs : 0) << " items/s" << std::endl;
+        std::cout << "draw calls/tick: " << (f64)gl_recording->n_draw_calls / n_ticks
+                  << ", uploaded bytes/tick: " << gl_recording->bytes_uploaded / n_ticks << std::endl;
+    }
+
+    if (arena_report)
+    {
+        mem::print_game_mem_report(mem::make_game_mem_report(memory), "peak over all ticks");
+    }
+
+    i64 p99 = percentile(tick_times, n_ticks, 0.99);
+    delete[] tick_times;
+
+    if (max_p99_ns > 0 && p99 > max_p99_ns)
+    {
+        std::cerr << "p99 tick time " << p99 << " ns is over the budget of " << max_p99_ns << " ns" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -8,73 +8,47 @@
 #include "rigelmath.h"
 #include "debug.h"
 #include "input.h"
+#include "input_journal.h"
 
 #include <glad/glad.h>
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_opengl.h>
 #include <SDL3/SDL_time.h>
+#include <cstring>
 #include <iostream>
-#include <sys/mman.h>
 
 
 using namespace rigel;
 
-mem::GameMem
-initialize_game_memory()
-{
-    mem::GameMem memory;
-    memory.game_state_storage_size = 64 * ONE_PAGE;
-    auto gs_ptr = mmap(nullptr,
-                       memory.game_state_storage_size,
-                       PROT_READ | PROT_WRITE,
-                       MAP_ANONYMOUS | MAP_PRIVATE,
-                       -1,
-                       0);
-    assert(gs_ptr && "Couldn't map game state");
-    memory.game_state_storage = reinterpret_cast<byte_ptr*>(gs_ptr);
-
-    memory.ephemeral_storage_size = 20 * ONE_MB;
-    auto es_ptr = mmap(nullptr,
-                       memory.ephemeral_storage_size,
-                       PROT_READ | PROT_WRITE,
-                       MAP_ANONYMOUS | MAP_PRIVATE,
-                       -1,
-                       0);
-    assert(es_ptr && "Couldn't map ephemeral");
-    memory.ephemeral_storage = reinterpret_cast<byte_ptr*>(es_ptr);
-
-    assert(sizeof(rigel::GameState) < memory.game_state_storage_size);
-
-    memory.game_state_arena.arena_bytes = memory.game_state_storage_size;
-    memory.game_state_arena.mem_begin = memory.game_state_storage;
-
-    memory.ephemeral_arena.arena_bytes = memory.ephemeral_storage_size;
-    memory.ephemeral_arena.mem_begin = memory.ephemeral_storage;
-
-    memory.stage_arena = memory.ephemeral_arena.alloc_sub_arena(ONE_MB);
-    memory.colliders_arena = memory.ephemeral_arena.alloc_sub_arena(1024);
-    // TODO: this should be much bigger, ya?
-    memory.frame_temp_arena = memory.ephemeral_arena.alloc_sub_arena(5 * ONE_MB);
-    memory.resource_arena = memory.ephemeral_arena.alloc_sub_arena(12 * ONE_MB);
-    memory.gfx_arena = memory.ephemeral_arena.alloc_sub_arena(3 * ONE_KB);
-    memory.debug_arena = memory.ephemeral_arena.alloc_sub_arena(1 * ONE_MB);
-
-    std::cout << "memory map:" << std::endl;
-    std::cout << "game state: " << (mem_ptr*)memory.game_state_arena.mem_begin << " for " << memory.game_state_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "ephemeral: " << (mem_ptr*)memory.ephemeral_arena.mem_begin << " for " << memory.ephemeral_arena.arena_bytes << " bytes" << std::endl;
-
-    std::cout << "stage: " << (mem_ptr*)memory.stage_arena.mem_begin << " for " << memory.stage_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "colliders: " << (mem_ptr*)memory.colliders_arena.mem_begin << " for " << memory.colliders_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "scratch: " << (mem_ptr*)memory.frame_temp_arena.mem_begin << " for " << memory.frame_temp_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "resource: " << (mem_ptr*)memory.resource_arena.mem_begin << " for " << memory.resource_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "gfx: " << (mem_ptr*)memory.gfx_arena.mem_begin << " for " << memory.gfx_arena.arena_bytes << " bytes" << std::endl;
-    std::cout << "debug: " << (mem_ptr*)memory.debug_arena.mem_begin << " for " << memory.debug_arena.arena_bytes << " bytes" << std::endl;
-    return memory;
-}
-
+// ~30 minutes of ticks at 60Hz
+constexpr static u32 INPUT_JOURNAL_MAX_TICKS = 60 * 60 * 30;
 
-int main()
+int main(int argc, char** argv)
 {
+    const char* record_journal_path = nullptr;
+    const char* replay_journal_path = nullptr;
+    b32 arena_report = false;
+    for (i32 arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--record") == 0 && arg + 1 < argc)
+        {
+            record_journal_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--replay") == 0 && arg + 1 < argc)
+        {
+            replay_journal_path = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--arena-report") == 0)
+        {
+            arena_report = true;
+        }
+        else
+        {
+            std::cerr << "usage: " << argv[0] << " [--record <journal>] [--replay <journal>] [--arena-report]" << std::endl;
+            return 1;
+        }
+    }
+
     SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD);
     SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 
@@ -100,7 +74,24 @@ int main()
 
     input_start();
 
-    mem::GameMem memory = initialize_game_memory();
+    mem::GameMem memory = mem::initialize_game_memory();
+
+    InputJournal journal = {0};
+    if (replay_journal_path)
+    {
+        if (!input_journal_load(&journal, &memory.resource_arena, replay_journal_path))
+        {
+            return 1;
+        }
+        std::cout << "Replaying " << journal.n_ticks << " ticks from " << replay_journal_path << std::endl;
+    }
+    else if (record_journal_path)
+    {
+        journal = make_input_journal(&memory.resource_arena, INPUT_JOURNAL_MAX_TICKS);
+    }
+    i64 replay_frame_count = 0;
+    i64 replay_frame_ns_total = 0;
+    i64 replay_frame_ns_worst = 0;
 
 
     resource_initialize(memory.resource_arena);
@@ -114,6 +105,12 @@ int main()
     memory.frame_temp_arena.reinit_zeroed();
     GameState* game_state = load_game(memory);
 
+    if (arena_report)
+    {
+        mem::print_game_mem_report(mem::make_game_mem_report(memory), "after load");
+        mem::reset_game_mem_stats(memory);
+    }
+
     render::Viewport viewport;
     viewport.zoom(1.0);
 
@@ -145,13 +142,13 @@ int main()
     rect.world_max = m::Vec2 { 20, 20 };
     rect.color_and_strength = m::Vec4{ 1, 0, 0, 1 };
 
-    render::buffer_rectangles(&vertbuf, &rect, 1, &memory.frame_temp_arena);
+    render::buffer_rectangles(&vertbuf, &rect, 1);
 
     render::RenderTarget internal_target = render::make_render_to_texture_target(320, 180);
     //render::RenderTarget shadow_target = render::make_render_to_array_texture_target(320, 180, 24, GL_RGBA);
 
     while (running) {
-        render::BatchBuffer* entity_batch_buffer = render::make_batch_buffer(&memory.frame_temp_arena, 256);
+        render::BatchBuffer* entity_batch_buffer = render::make_batch_buffer(&memory.frame_temp_arena, 256, true);
         auto rect_shader = render::game_shaders + render::SIMPLE_SPRITE_SHADER;
 
         render::batch_push_use_shader_cmd(entity_batch_buffer, rect_shader);
@@ -319,6 +316,27 @@ int main()
             //while (delta_update_time > 0) {
                 f32 dt = delta_update_time / 1000000000.0f; // to seconds
 
+                // Journals only store the one tick_ns, so recording has to
+                // simulate at that fixed dt too, not at however long the
+                // tick actually took, or the replay won't match
+                if (replay_journal_path)
+                {
+                    if (!input_journal_replay_next(&journal, &g_input_state))
+                    {
+                        running = false;
+                        break;
+                    }
+                    dt = journal.tick_ns / 1000000000.0f;
+                }
+                else if (record_journal_path)
+                {
+                    input_journal_record(&journal, g_input_state);
+                    dt = journal.tick_ns / 1000000000.0f;
+                }
+
+                // anything the resource thread finished shows up before the tick
+                poll_resource_loads();
+
                 simulate_one_tick(memory, game_state, dt, entity_batch_buffer);
 
                 update_animations(game_state->active_world_chunk, dt);
@@ -435,6 +453,17 @@ int main()
             if (!SDL_GetCurrentTime(&one_frame_time)) {
                 std::cerr << "warn: couln't get current time? " << SDL_GetError() << std::endl;
             }
+
+            if (replay_journal_path)
+            {
+                i64 frame_ns = one_frame_time - iter_time;
+                replay_frame_count++;
+                replay_frame_ns_total += frame_ns;
+                if (frame_ns > replay_frame_ns_worst)
+                {
+                    replay_frame_ns_worst = frame_ns;
+                }
+            }
         }
 
         //std::cout << "Here we have " << entity_batch_buffer->items_in_buffer << std::endl;
@@ -469,6 +498,30 @@ int main()
 
     }
 
+    if (arena_report)
+    {
+        mem::print_game_mem_report(mem::make_game_mem_report(memory), "peak over all frames");
+    }
+
+    if (record_journal_path)
+    {
+        if (input_journal_save(&journal, record_journal_path))
+        {
+            std::cout << "Recorded " << journal.n_ticks << " ticks to " << record_journal_path << std::endl;
+        }
+        else
+        {
+            std::cerr << "Couldn't write input journal to " << record_journal_path << std::endl;
+        }
+    }
+
+    if (replay_journal_path && replay_frame_count > 0)
+    {
+        std::cout << "replayed " << replay_frame_count << " frames, "
+                  << "mean " << (replay_frame_ns_total / replay_frame_count) << " ns/frame, "
+                  << "worst " << replay_frame_ns_worst << " ns/frame" << std::endl;
+    }
+
     SDL_GL_DestroyContext(context);
     SDL_DestroyWindow(window);
     SDL_Quit();
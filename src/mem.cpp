@@ -0,0 +1,57 @@
+#include "mem.h"
+
+#include <cstdio>
+
+namespace rigel {
+namespace mem {
+
+static const char* game_mem_arena_names[] = {
+#define X(name) #name,
+    GAME_MEM_ARENA_LIST
+#undef X
+};
+
+GameMemReport
+make_game_mem_report(GameMem& memory)
+{
+    GameMemReport result;
+#define X(name) result.arenas[(usize)GameMemArena::name] = arena_stats(memory.name);
+    GAME_MEM_ARENA_LIST
+#undef X
+    return result;
+}
+
+void
+reset_game_mem_stats(GameMem& memory)
+{
+#define X(name) memory.name.reset_stats();
+    GAME_MEM_ARENA_LIST
+#undef X
+}
+
+void
+print_game_mem_report(const GameMemReport& report, const char* label)
+{
+    printf("arena usage (%s):\n", label);
+    printf("  %-18s %12s %12s %12s %12s %7s %10s %12s\n",
+           "arena", "used", "peak", "committed", "capacity", "peak%", "allocs", "align waste");
+    for (usize i = 0; i < (usize)GameMemArena::N_ARENAS; i++)
+    {
+        const ArenaStats& stats = report.arenas[i];
+        f32 peak_pct = stats.capacity_bytes > 0
+            ? 100.0f * (f32)stats.high_water_mark / (f32)stats.capacity_bytes
+            : 0.0f;
+        printf("  %-18s %12u %12u %12u %12u %6.2f%% %10u %12u\n",
+               game_mem_arena_names[i],
+               stats.used_bytes,
+               stats.high_water_mark,
+               stats.committed_bytes,
+               stats.capacity_bytes,
+               peak_pct,
+               stats.n_allocs,
+               stats.alignment_waste_bytes);
+    }
+}
+
+} // namespace mem
+} // namespace rigel
@@ -21,25 +21,75 @@ align_sz(usize sz, usize align)
     return (sz + align - 1) & ~(align - 1);
 }
 
+// Platform hooks for reserve-and-commit arenas, see mem_linux.cpp.
+// Reserved address space is inaccessible until it is committed, and
+// committed pages read back as zero after being decommitted.
+byte_ptr* reserve_address_space(usize size);
+b32 commit_pages(byte_ptr* start, usize size);
+void decommit_pages(byte_ptr* start, usize size);
+
+// commit in chunks of this many bytes so we aren't making a syscall per page
+constexpr static usize ARENA_COMMIT_GRANULARITY = 16 * ONE_PAGE;
+// when rewinding, keep this much committed above the new top so arenas that
+// are reset every frame don't fault their pages back in every frame
+constexpr static usize ARENA_DEFAULT_KEEP_COMMITTED = 64 * ONE_PAGE;
+
 struct Arena
 {
     usize arena_bytes;
     usize next_free_idx;
     byte_ptr* mem_begin;
 
-    Arena() : arena_bytes(0), next_free_idx(0), mem_begin(nullptr) {}
+    // Reserve-and-commit mode. arena_bytes is reserved address space and
+    // only [0, committed_bytes) is actually backed by memory. Pages get
+    // committed as next_free_idx advances and handed back on restore/reinit.
+    b32 commit_on_demand;
+    usize committed_bytes;
+    usize keep_committed_bytes;
+
+    // Telemetry. These survive restore/reinit so the high-water mark covers
+    // every frame since the last reset_stats().
+    usize high_water_mark;
+    usize n_allocs;
+    usize alignment_waste_bytes;
+
+    Arena()
+      : arena_bytes(0)
+      , next_free_idx(0)
+      , mem_begin(nullptr)
+      , commit_on_demand(false)
+      , committed_bytes(0)
+      , keep_committed_bytes(0)
+      , high_water_mark(0)
+      , n_allocs(0)
+      , alignment_waste_bytes(0)
+    {}
 
     Arena(byte_ptr* memory, usize size)
       : arena_bytes(size)
       , next_free_idx(0)
       , mem_begin(memory)
+      , commit_on_demand(false)
+      , committed_bytes(size)
+      , keep_committed_bytes(0)
+      , high_water_mark(0)
+      , n_allocs(0)
+      , alignment_waste_bytes(0)
     {
     }
 
-    void reinit() { next_free_idx = 0; }
+    void reinit() { restore(0); }
 
     void reinit_zeroed()
     {
+        if (commit_on_demand)
+        {
+            // decommitted pages come back zeroed
+            decommit_from(0);
+            next_free_idx = 0;
+            return;
+        }
+
         for (usize i = 0; i < arena_bytes; i++)
         {
             mem_begin[i] = 0;
@@ -47,6 +97,56 @@ struct Arena
         next_free_idx = 0;
     }
 
+    inline void commit_up_to(usize end)
+    {
+        if (end <= committed_bytes)
+        {
+            return;
+        }
+
+        usize new_committed = align_sz(end, ARENA_COMMIT_GRANULARITY);
+        if (new_committed > arena_bytes)
+        {
+            new_committed = arena_bytes;
+        }
+
+        b32 ok = commit_pages(mem_begin + committed_bytes, new_committed - committed_bytes);
+        assert(ok && "Couldn't commit arena pages");
+        (void)ok;
+
+        committed_bytes = new_committed;
+    }
+
+    inline void decommit_from(usize offset)
+    {
+        usize start = align_sz(offset, ONE_PAGE);
+        if (start < committed_bytes)
+        {
+            decommit_pages(mem_begin + start, committed_bytes - start);
+            committed_bytes = start;
+        }
+    }
+
+    inline void record_alloc(usize old_top, usize new_top, usize requested_bytes)
+    {
+        n_allocs++;
+        alignment_waste_bytes += (new_top - old_top) - requested_bytes;
+        if (new_top > high_water_mark)
+        {
+            high_water_mark = new_top;
+        }
+    }
+
+    // starts a new measurement window, eg. per frame or per load
+    inline void reset_stats()
+    {
+        high_water_mark = next_free_idx;
+        n_allocs = 0;
+        alignment_waste_bytes = 0;
+    }
+
+    // Carves a sub-arena out of this one that is usable straight away. In
+    // reserve-and-commit mode its pages are committed up front.
     Arena alloc_sub_arena(usize size)
     {
         auto base = next_free_idx;
@@ -56,10 +156,43 @@ struct Arena
 
         assert(end < arena_bytes && "Tried to alloc sub-arena bigger than its parent");
 
+        if (commit_on_demand)
+        {
+            commit_up_to(end);
+        }
+
+        record_alloc(base, end, end - start);
         next_free_idx = end;
         return Arena(mem_begin + start, end - start);
     }
 
+    // Carves out a sub-arena that commits its own pages on demand. Only
+    // reserves address space in this arena, so it's meant for long-lived
+    // arenas that never get rewound past, like the ones in GameMem. Falls
+    // back to alloc_sub_arena when this arena isn't reserve-and-commit.
+    Arena reserve_sub_arena(usize size)
+    {
+        if (!commit_on_demand)
+        {
+            return alloc_sub_arena(size);
+        }
+
+        // page aligned so the child can commit independently of us
+        auto start = align_sz(next_free_idx, ONE_PAGE);
+        auto end = align_sz(start + size, ONE_PAGE);
+
+        assert(end < arena_bytes && "Tried to reserve sub-arena bigger than its parent");
+
+        record_alloc(next_free_idx, end, size);
+        next_free_idx = end;
+
+        Arena result(mem_begin + start, end - start);
+        result.commit_on_demand = true;
+        result.committed_bytes = 0;
+        result.keep_committed_bytes = keep_committed_bytes;
+        return result;
+    }
+
     inline byte_ptr* alloc_bytes(usize bytes, usize align_to = 1)
     {
         auto start = align_sz(next_free_idx, align_to);
@@ -67,6 +200,12 @@ struct Arena
 
         assert (end < arena_bytes && "Overflowed memory arena!");
 
+        if (commit_on_demand)
+        {
+            commit_up_to(end);
+        }
+
+        record_alloc(next_free_idx, end, bytes);
         next_free_idx = end;
 
         return mem_begin + start;
@@ -107,6 +246,11 @@ struct Arena
 
     inline void restore(ArenaCheckpoint checkpoint)
     {
+        if (commit_on_demand)
+        {
+            decommit_from(checkpoint + keep_committed_bytes);
+        }
+
         next_free_idx = checkpoint;
     }
 
@@ -114,7 +258,18 @@ struct Arena
     {
         assert(checkpoint < next_free_idx && "invalid checkpoint");
 
-        for (usize c = checkpoint; c < next_free_idx; c++)
+        usize zero_end = next_free_idx;
+        if (commit_on_demand)
+        {
+            // anything we hand back will be zero when it's committed again
+            decommit_from(checkpoint + keep_committed_bytes);
+            if (zero_end > committed_bytes)
+            {
+                zero_end = committed_bytes;
+            }
+        }
+
+        for (usize c = checkpoint; c < zero_end; c++)
         {
             mem_begin[c] = 0;
         }
@@ -124,6 +279,21 @@ struct Arena
 
 };
 
+// Reserves `reserve_bytes` of address space for an arena without backing it
+// with memory. Pages are committed as allocations need them.
+inline Arena
+make_reserved_arena(usize reserve_bytes, usize keep_committed_bytes = ARENA_DEFAULT_KEEP_COMMITTED)
+{
+    Arena result;
+    result.mem_begin = reserve_address_space(reserve_bytes);
+    assert(result.mem_begin && "Couldn't reserve address space");
+    result.arena_bytes = reserve_bytes;
+    result.commit_on_demand = true;
+    result.committed_bytes = 0;
+    result.keep_committed_bytes = keep_committed_bytes;
+    return result;
+}
+
 struct GameMem
 {
     byte_ptr* game_state_storage;
@@ -145,6 +315,62 @@ struct GameMem
     Arena debug_arena;
 };
 
+// maps the backing storage and carves out the sub-arenas. Lives with the
+// platform code (mem_linux.cpp).
+GameMem initialize_game_memory();
+
+#define GAME_MEM_ARENA_LIST \
+    X(game_state_arena) \
+    X(ephemeral_arena) \
+    X(stage_arena) \
+    X(colliders_arena) \
+    X(frame_temp_arena) \
+    X(resource_arena) \
+    X(gfx_arena) \
+    X(debug_arena)
+
+enum class GameMemArena
+{
+#define X(name) name,
+    GAME_MEM_ARENA_LIST
+#undef X
+    N_ARENAS
+};
+
+struct ArenaStats
+{
+    usize capacity_bytes;
+    usize committed_bytes;
+    usize used_bytes;
+    usize high_water_mark;
+    usize n_allocs;
+    usize alignment_waste_bytes;
+};
+
+struct GameMemReport
+{
+    ArenaStats arenas[(usize)GameMemArena::N_ARENAS];
+};
+
+inline ArenaStats
+arena_stats(const Arena& arena)
+{
+    ArenaStats result;
+    result.capacity_bytes = arena.arena_bytes;
+    result.committed_bytes = arena.committed_bytes;
+    result.used_bytes = arena.next_free_idx;
+    result.high_water_mark = arena.high_water_mark;
+    result.n_allocs = arena.n_allocs;
+    result.alignment_waste_bytes = arena.alignment_waste_bytes;
+    return result;
+}
+
+// Snapshot of every GameMem arena. Take one after a load or at the end of a
+// frame, then reset_game_mem_stats() to start the next window.
+GameMemReport make_game_mem_report(GameMem& memory);
+void reset_game_mem_stats(GameMem& memory);
+void print_game_mem_report(const GameMemReport& report, const char* label);
+
 template <typename T>
 struct SimpleList
 {
@@ -180,6 +406,77 @@ simple_list_append(SimpleList<T>* list, T item)
     return result;
 }
 
+// Fixed-size pool of Ts. Freed slots are threaded into a free list through
+// the slots themselves, so both alloc and free are O(1) and the pool never
+// grows past the capacity it was made with.
+template <typename T>
+union PoolSlot
+{
+    PoolSlot* next_free;
+    alignas(T) ubyte storage[sizeof(T)];
+};
+
+template <typename T>
+struct Pool
+{
+    usize capacity;
+    usize n_allocated;
+    // slots past this have never been handed out
+    usize next_untouched_idx;
+    PoolSlot<T>* slots;
+    PoolSlot<T>* free_list;
+};
+
+template <typename T>
+Pool<T>
+make_pool(usize capacity, mem::Arena* arena)
+{
+    auto slots = arena->alloc_array<PoolSlot<T>>(capacity);
+    return Pool<T> { .capacity = capacity,
+                     .n_allocated = 0,
+                     .next_untouched_idx = 0,
+                     .slots = slots,
+                     .free_list = nullptr };
+}
+
+// returns an uninitialized T, or nullptr if the pool is full
+template <typename T>
+T*
+pool_alloc(Pool<T>* pool)
+{
+    PoolSlot<T>* slot = nullptr;
+    if (pool->free_list)
+    {
+        slot = pool->free_list;
+        pool->free_list = slot->next_free;
+    }
+    else if (pool->next_untouched_idx < pool->capacity)
+    {
+        slot = pool->slots + pool->next_untouched_idx;
+        pool->next_untouched_idx++;
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    pool->n_allocated++;
+    return reinterpret_cast<T*>(slot->storage);
+}
+
+template <typename T>
+void
+pool_free(Pool<T>* pool, T* item)
+{
+    auto slot = reinterpret_cast<PoolSlot<T>*>(item);
+    assert(slot >= pool->slots && slot < pool->slots + pool->next_untouched_idx && "Freeing into the wrong pool");
+    assert(pool->n_allocated > 0 && "Pool double free");
+
+    slot->next_free = pool->free_list;
+    pool->free_list = slot;
+    pool->n_allocated--;
+}
+
 template <typename T>
 T*
 simple_list_insert(SimpleList<T>* list, T item, usize index)
@@ -0,0 +1,108 @@
+#include "mem.h"
+#include "game.h"
+
+#include <iostream>
+#include <sys/mman.h>
+
+namespace rigel {
+namespace mem {
+
+byte_ptr*
+reserve_address_space(usize size)
+{
+    auto ptr = mmap(nullptr,
+                    size,
+                    PROT_NONE,
+                    MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE,
+                    -1,
+                    0);
+    if (ptr == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    return reinterpret_cast<byte_ptr*>(ptr);
+}
+
+b32
+commit_pages(byte_ptr* start, usize size)
+{
+    return mprotect(start, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void
+decommit_pages(byte_ptr* start, usize size)
+{
+    // drop the backing pages first so they fault back in zeroed
+    madvise(start, size, MADV_DONTNEED);
+    mprotect(start, size, PROT_NONE);
+}
+
+GameMem
+initialize_game_memory()
+{
+    // Everything is reserved up front and committed as it gets used, so these
+    // sizes are upper bounds on address space rather than what we touch.
+    GameMem memory;
+    memory.game_state_arena = make_reserved_arena(64 * ONE_MB);
+    memory.game_state_storage = memory.game_state_arena.mem_begin;
+    memory.game_state_storage_size = memory.game_state_arena.arena_bytes;
+
+    memory.ephemeral_arena = make_reserved_arena(ONE_GB);
+    memory.ephemeral_storage = memory.ephemeral_arena.mem_begin;
+    memory.ephemeral_storage_size = memory.ephemeral_arena.arena_bytes;
+
+    assert(sizeof(rigel::GameState) < memory.game_state_storage_size);
+
+    memory.stage_arena = memory.ephemeral_arena.reserve_sub_arena(64 * ONE_MB);
+    memory.colliders_arena = memory.ephemeral_arena.reserve_sub_arena(16 * ONE_MB);
+    memory.frame_temp_arena = memory.ephemeral_arena.reserve_sub_arena(256 * ONE_MB);
+    memory.resource_arena = memory.ephemeral_arena.reserve_sub_arena(512 * ONE_MB);
+    memory.gfx_arena = memory.ephemeral_arena.reserve_sub_arena(16 * ONE_MB);
+    memory.debug_arena = memory.ephemeral_arena.reserve_sub_arena(16 * ONE_MB);
+
+    std::cout << "memory map:" << std::endl;
+    std::cout << "game state: " << (mem_ptr*)memory.game_state_arena.mem_begin << " for " << memory.game_state_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "ephemeral: " << (mem_ptr*)memory.ephemeral_arena.mem_begin << " for " << memory.ephemeral_arena.arena_bytes << " bytes reserved" << std::endl;
+
+    std::cout << "stage: " << (mem_ptr*)memory.stage_arena.mem_begin << " for " << memory.stage_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "colliders: " << (mem_ptr*)memory.colliders_arena.mem_begin << " for " << memory.colliders_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "scratch: " << (mem_ptr*)memory.frame_temp_arena.mem_begin << " for " << memory.frame_temp_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "resource: " << (mem_ptr*)memory.resource_arena.mem_begin << " for " << memory.resource_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "gfx: " << (mem_ptr*)memory.gfx_arena.mem_begin << " for " << memory.gfx_arena.arena_bytes << " bytes reserved" << std::endl;
+    std::cout << "debug: " << (mem_ptr*)memory.debug_arena.mem_begin << " for " << memory.debug_arena.arena_bytes << " bytes reserved" << std::endl;
+    return memory;
+}
+
+} // namespace mem
+} // namespace rigel
+
+#include "doctest.h"
+
+TEST_CASE("reserved arenas commit on demand and hand pages back")
+{
+    using namespace rigel;
+    mem::Arena arena = mem::make_reserved_arena(64 * ONE_MB, 0);
+    CHECK(arena.committed_bytes == 0);
+
+    ubyte* bytes = arena.alloc_array<ubyte>(3 * ONE_PAGE);
+    CHECK(arena.committed_bytes >= 3 * ONE_PAGE);
+    bytes[3 * ONE_PAGE - 1] = 0xAB;
+
+    auto checkpoint = arena.checkpoint();
+    ubyte* more = arena.alloc_array<ubyte>(ONE_MB);
+    more[ONE_MB - 1] = 0xCD;
+    CHECK(arena.committed_bytes >= checkpoint + ONE_MB);
+
+    arena.restore(checkpoint);
+    CHECK(arena.committed_bytes < checkpoint + ONE_PAGE);
+    CHECK(bytes[3 * ONE_PAGE - 1] == 0xAB);
+
+    // pages that were handed back come back zeroed
+    more = arena.alloc_array<ubyte>(ONE_MB);
+    CHECK(more[ONE_MB - 1] == 0);
+
+    arena.reinit_zeroed();
+    CHECK(arena.committed_bytes == 0);
+    bytes = arena.alloc_array<ubyte>(ONE_PAGE);
+    CHECK(bytes[0] == 0);
+}
@@ -12,22 +12,54 @@
 // TODO: remove
 #include <iostream>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 
 namespace rigel {
 namespace render {
 
 Shader game_shaders[N_GAME_SHADERS];
 
+// Rectangles and quads from a batch stream through one big buffer instead
+// of getting fresh storage from glBufferData on every flush. The buffer has
+// a region per frame in flight. Writes map only the range they fill, and
+// they map it unsynchronized. That's safe because a region is only reused
+// once the fence from the last frame that used it has passed.
+#define STREAM_BUFFER_FRAMES 3
+#define STREAM_BUFFER_FRAME_BYTES (4 * ONE_MB)
+// quads share one index buffer and pick their vertices with a base vertex,
+// so a single draw is capped at this many
+#define STREAM_MAX_QUADS_PER_DRAW (16 * 1024)
+
+struct StreamBuffer
+{
+    GLuint vbo;
+    u32 region;
+    u32 region_used;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+};
+
+// What's currently bound, so binding the same thing again can be skipped.
+// Every bind in here goes through the gl_bind_* helpers below, or the cache
+// would go stale.
+struct GLStateCache
+{
+    u32 program;
+    u32 vao;
+    u32 framebuffer;
+    u32 active_texture_slot;
+    u32 texture_2d[MAX_TEXTURE_SLOTS];
+    u32 texture_2d_array[MAX_TEXTURE_SLOTS];
+};
+
 struct RenderState
 {
     mem::Arena* gfx_arena;
+    GLStateCache gl;
 
     RenderTarget screen_target;
-    VertexBuffer sprite_buffer;
-    VertexBuffer quad_buffer;
+    StreamBuffer stream;
+    GLuint stream_rect_vao;
+    GLuint stream_quad_vao;
+    GLuint quad_index_buffer;
     SpriteAtlas sprite_atlas;
     Shader* active_shader;
 
@@ -41,6 +73,95 @@ struct RenderState
 
 static RenderState render_state;
 
+static void
+gl_use_program(u32 program)
+{
+    if (render_state.gl.program != program)
+    {
+        glUseProgram(program);
+        render_state.gl.program = program;
+    }
+}
+
+static void
+gl_bind_vertex_array(u32 vao)
+{
+    if (render_state.gl.vao != vao)
+    {
+        glBindVertexArray(vao);
+        render_state.gl.vao = vao;
+    }
+}
+
+// GL unbinds a VAO that gets deleted, and its name can come straight back
+// from glGenVertexArrays
+static void
+gl_delete_vertex_array(u32 vao)
+{
+    if (render_state.gl.vao == vao)
+    {
+        render_state.gl.vao = 0;
+    }
+    glDeleteVertexArrays(1, &vao);
+}
+
+static void
+gl_bind_framebuffer(u32 framebuffer)
+{
+    if (render_state.gl.framebuffer != framebuffer)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        render_state.gl.framebuffer = framebuffer;
+    }
+}
+
+static void
+gl_select_texture_slot(u32 slot)
+{
+    assert(slot < MAX_TEXTURE_SLOTS && "Bad texture slot");
+    if (render_state.gl.active_texture_slot != slot)
+    {
+        glActiveTexture(GL_TEXTURE0 + slot);
+        render_state.gl.active_texture_slot = slot;
+    }
+}
+
+// binds to GL_TEXTURE_2D on the given slot, for drawing with. Doesn't select
+// the slot if the texture's already there.
+static void
+gl_bind_texture_2d(u32 slot, u32 texture)
+{
+    assert(slot < MAX_TEXTURE_SLOTS && "Bad texture slot");
+    if (render_state.gl.texture_2d[slot] == texture)
+    {
+        return;
+    }
+    gl_select_texture_slot(slot);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    render_state.gl.texture_2d[slot] = texture;
+}
+
+// binds to target on slot 0 and leaves slot 0 selected, so the glTex* calls
+// after it edit this texture. target is GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY.
+static void
+gl_bind_texture_for_edit(GLenum target, u32 texture)
+{
+    assert((target == GL_TEXTURE_2D || target == GL_TEXTURE_2D_ARRAY) && "Bad texture target");
+    gl_select_texture_slot(0);
+    u32* bound = target == GL_TEXTURE_2D ? render_state.gl.texture_2d : render_state.gl.texture_2d_array;
+    if (bound[0] != texture)
+    {
+        glBindTexture(target, texture);
+        bound[0] = texture;
+    }
+}
+
+static const char* shader_uniform_names[ShaderUniform_Count] = {
+    #define X(name) #name,
+    SHADER_UNIFORM_LIST
+    #undef X
+};
+
 // TODO(spencer): we should move these into the main renderer.
 // The main renderer should also be able to draw lines.
 #ifdef RIGEL_DEBUG
@@ -105,27 +226,84 @@ shader_load_from_src(Shader* shader, const char* vs_src, const char* fs_src)
 
     u32 uniform_block = glGetUniformBlockIndex(shader->id, "GlobalUniforms");
     glUniformBlockBinding(shader->id, uniform_block, 0);
+
+    for (u32 i = 0; i < ShaderUniform_Count; i++)
+    {
+        shader->uniform_locations[i] = glGetUniformLocation(shader->id, shader_uniform_names[i]);
+    }
+
+    // textureN always samples slot N, so that only needs setting once
+    for (u32 slot = 0; slot < MAX_TEXTURE_SLOTS; slot++)
+    {
+        shader_set_uniform_1i(shader, (ShaderUniform)(ShaderUniform_texture0 + slot), slot);
+    }
+}
+
+static i32
+shader_uniform_location(Shader* shader, const char* name)
+{
+    for (u32 i = 0; i < ShaderUniform_Count; i++)
+    {
+        if (strcmp(shader_uniform_names[i], name) == 0)
+        {
+            return shader->uniform_locations[i];
+        }
+    }
+    return glGetUniformLocation(shader->id, name);
 }
 
 void
 shader_set_uniform_m4v(Shader* shader, const char* name, m::Mat4 mat)
 {
-    glUseProgram(shader->id);
-    glUniformMatrix4fv(glGetUniformLocation(shader->id, name), 1, GL_FALSE, reinterpret_cast<f32*>(&mat));
+    gl_use_program(shader->id);
+    glUniformMatrix4fv(shader_uniform_location(shader, name), 1, GL_FALSE, reinterpret_cast<f32*>(&mat));
 }
 
 void
 shader_set_uniform_2fv(Shader* shader, const char* name, m::Vec2 vec)
 {
-    glUseProgram(shader->id);
-    glUniform2fv(glGetUniformLocation(shader->id, name), 1, reinterpret_cast<f32*>(&vec));
+    gl_use_program(shader->id);
+    glUniform2fv(shader_uniform_location(shader, name), 1, reinterpret_cast<f32*>(&vec));
 }
 
 void
 shader_set_uniform_1i(Shader* shader, const char* name, i32 value)
 {
-    glUseProgram(shader->id);
-    glUniform1i(glGetUniformLocation(shader->id, name), value);
+    gl_use_program(shader->id);
+    glUniform1i(shader_uniform_location(shader, name), value);
+}
+
+void
+shader_set_uniform_m4v(Shader* shader, ShaderUniform uniform, m::Mat4 mat)
+{
+    i32 location = shader->uniform_locations[uniform];
+    if (location >= 0)
+    {
+        gl_use_program(shader->id);
+        glUniformMatrix4fv(location, 1, GL_FALSE, reinterpret_cast<f32*>(&mat));
+    }
+}
+
+void
+shader_set_uniform_2fv(Shader* shader, ShaderUniform uniform, m::Vec2 vec)
+{
+    i32 location = shader->uniform_locations[uniform];
+    if (location >= 0)
+    {
+        gl_use_program(shader->id);
+        glUniform2fv(location, 1, reinterpret_cast<f32*>(&vec));
+    }
+}
+
+void
+shader_set_uniform_1i(Shader* shader, ShaderUniform uniform, i32 value)
+{
+    i32 location = shader->uniform_locations[uniform];
+    if (location >= 0)
+    {
+        gl_use_program(shader->id);
+        glUniform1i(location, value);
+    }
 }
 
 TextureConfig::TextureConfig()
@@ -142,7 +320,7 @@ Texture make_texture(TextureConfig config)
     tex.dims = m::Vec3 { (f32)config.width, (f32)config.height, 1 };
 
     glGenTextures(1, &tex.id);
-    glBindTexture(GL_TEXTURE_2D, tex.id);
+    gl_bind_texture_for_edit(GL_TEXTURE_2D, tex.id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, config.wrap_s);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, config.wrap_t);
@@ -159,7 +337,7 @@ Texture make_texture(TextureConfig config)
                  config.src_data_type,
                  config.data);
     glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    gl_bind_texture_2d(0, 0);
 
     return tex;
 }
@@ -168,7 +346,7 @@ Texture make_array_texture_from_vstrip(ImageResource image, TextureConfig config
 {
     Texture tex;
     glGenTextures(1, &tex.id);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, tex.id);
+    gl_bind_texture_for_edit(GL_TEXTURE_2D_ARRAY, tex.id);
 
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, config.wrap_s);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, config.wrap_t);
@@ -198,7 +376,7 @@ Texture alloc_array_texture(usize w, usize h, usize layers, usize internal_forma
     Texture tex;
     tex.dims = m::Vec3 { (f32)w, (f32)h, (f32)layers };
     glGenTextures(1, &tex.id);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, tex.id);
+    gl_bind_texture_for_edit(GL_TEXTURE_2D_ARRAY, tex.id);
 
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -295,21 +473,22 @@ out vec2 tex_uv;
 uniform mat4 screen_transform;
 uniform vec2 tdim0;
 
+// one instance per rectangle, drawn as a 4 vertex triangle strip
 void main()
 {
-    uint idx = gl_VertexID & 3;
+    int idx = gl_VertexID & 3;
     vec4 vert = mat4(
         vec4(min_p.x, min_p.y, 0, 1),
         vec4(max_p.x, min_p.y, 0, 1),
-        vec4(max_p.x, max_p.y, 0, 1),
-        vec4(min_p.x, max_p.y, 0, 1)
+        vec4(min_p.x, max_p.y, 0, 1),
+        vec4(max_p.x, max_p.y, 0, 1)
     )[idx];
 
     vec2 atlas_coord = mat4(
         vec4(atlas_min_p.x, atlas_max_p.y, 0, 0),
         vec4(atlas_max_p.x, atlas_max_p.y, 0, 0),
-        vec4(atlas_max_p.x, atlas_min_p.y, 0, 0),
-        vec4(atlas_min_p.x, atlas_min_p.y, 0, 0)
+        vec4(atlas_min_p.x, atlas_min_p.y, 0, 0),
+        vec4(atlas_max_p.x, atlas_min_p.y, 0, 0)
     )[idx].xy;
 
     gl_Position = screen_transform * vert;
@@ -470,14 +649,14 @@ RenderTarget make_render_to_texture_target(i32 w, i32 h)
 
     // create the internal framebuffer
     glGenFramebuffers(1, &result.target_framebuf);
-    glBindFramebuffer(GL_FRAMEBUFFER, result.target_framebuf);
+    gl_bind_framebuffer(result.target_framebuf);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, result.target_texture.id, 0);
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_bind_framebuffer(0);
 
     return result;
 }
@@ -491,12 +670,179 @@ RenderTarget make_render_to_array_texture_target(i32 w, i32 h, i32 layers, usize
     result.target_texture = alloc_array_texture(w, h, layers, format);
 
     glGenFramebuffers(1, &result.target_framebuf);
-    glBindFramebuffer(GL_FRAMEBUFFER, result.target_framebuf);
+    gl_bind_framebuffer(result.target_framebuf);
     // NOTE: wrong call?
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, result.target_texture.id, 0);
     return result;
 }
 
+// Points the bound VAO's rectangle attributes at the bound GL_ARRAY_BUFFER,
+// starting base_offset bytes in.
+static void
+point_rect_attribs_at(u32 base_offset)
+{
+    auto at = [base_offset](usize field_offset)
+    {
+        return reinterpret_cast<void*>((uintptr_t)(base_offset + field_offset));
+    };
+
+    // min & max
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), at(offsetof(RectangleBufferVertex, world_min)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), at(offsetof(RectangleBufferVertex, world_max)));
+    // color: rgb + strength
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), at(offsetof(RectangleBufferVertex, color_and_strength)));
+    // atlas min & max
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), at(offsetof(RectangleBufferVertex, atlas_min)));
+    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), at(offsetof(RectangleBufferVertex, atlas_max)));
+}
+
+static void
+enable_rect_attribs()
+{
+    point_rect_attribs_at(0);
+
+    // every attribute steps once per rectangle rather than once per vertex
+    for (u32 attrib = 0; attrib < 5; attrib++)
+    {
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribDivisor(attrib, 1);
+    }
+}
+
+static void
+enable_quad_attribs()
+{
+    // p
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)0);
+    glEnableVertexAttribArray(0);
+    // uv
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)(offsetof(QuadBufferVertex, uv)));
+    glEnableVertexAttribArray(1);
+    // color & strength
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)(offsetof(QuadBufferVertex, color_and_strength)));
+    glEnableVertexAttribArray(2);
+}
+
+static void
+stream_buffer_init(StreamBuffer* stream)
+{
+    glGenBuffers(1, &stream->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+    glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_FRAMES * STREAM_BUFFER_FRAME_BYTES, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    stream->region = 0;
+    stream->region_used = 0;
+    for (u32 i = 0; i < STREAM_BUFFER_FRAMES; i++)
+    {
+        stream->fences[i] = 0;
+    }
+}
+
+// Moves on to the next frame's region, waiting if the GPU still hasn't
+// finished the frame that last wrote to it.
+static void
+stream_buffer_begin_frame(StreamBuffer* stream)
+{
+    stream->region = (stream->region + 1) % STREAM_BUFFER_FRAMES;
+    stream->region_used = 0;
+
+    GLsync fence = stream->fences[stream->region];
+    if (fence)
+    {
+        // with vsync and three regions this has basically always passed
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        stream->fences[stream->region] = 0;
+    }
+}
+
+static void
+stream_buffer_end_frame(StreamBuffer* stream)
+{
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Copies n_bytes into this frame's region and returns where in the buffer
+// they went. That offset is a multiple of stride, so it can be turned into
+// a base vertex. Leaves the stream bound to GL_ARRAY_BUFFER.
+static u32
+stream_buffer_write(StreamBuffer* stream, const void* data, u32 n_bytes, u32 stride)
+{
+    assert(n_bytes + stride <= STREAM_BUFFER_FRAME_BYTES && "Too much to stream in one go");
+
+    glBindBuffer(GL_ARRAY_BUFFER, stream->vbo);
+
+    u32 region_start = stream->region * STREAM_BUFFER_FRAME_BYTES;
+    u32 offset = (region_start + stream->region_used + stride - 1) / stride * stride;
+    if (offset + n_bytes > region_start + STREAM_BUFFER_FRAME_BYTES)
+    {
+        // More than a frame's worth. Orphan the buffer: the driver hands
+        // back fresh storage, so every region is free to write again.
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_FRAMES * STREAM_BUFFER_FRAME_BYTES, nullptr, GL_STREAM_DRAW);
+        for (u32 i = 0; i < STREAM_BUFFER_FRAMES; i++)
+        {
+            if (stream->fences[i])
+            {
+                glDeleteSync(stream->fences[i]);
+                stream->fences[i] = 0;
+            }
+        }
+        offset = (region_start + stride - 1) / stride * stride;
+    }
+
+    void* dest = glMapBufferRange(GL_ARRAY_BUFFER, offset, n_bytes,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    memcpy(dest, data, n_bytes);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    stream->region_used = offset + n_bytes - region_start;
+    return offset;
+}
+
+static void
+set_up_stream_buffers(mem::Arena* scratch_arena)
+{
+    stream_buffer_init(&render_state.stream);
+
+    // the stream VAOs get their attributes pointed at each batch's data
+    // when it's drawn
+    glGenVertexArrays(1, &render_state.stream_rect_vao);
+    gl_bind_vertex_array(render_state.stream_rect_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, render_state.stream.vbo);
+    enable_rect_attribs();
+
+    glGenVertexArrays(1, &render_state.stream_quad_vao);
+    gl_bind_vertex_array(render_state.stream_quad_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, render_state.stream.vbo);
+    enable_quad_attribs();
+
+    // every batch of quads has the same indices, only the base vertex
+    // changes
+    u32 n_indices = STREAM_MAX_QUADS_PER_DRAW * 6;
+    auto checkpoint = scratch_arena->checkpoint();
+    u32* indices = scratch_arena->alloc_array<u32>(n_indices);
+    for (u32 quad = 0; quad < STREAM_MAX_QUADS_PER_DRAW; quad++)
+    {
+        u32* out = indices + quad * 6;
+        u32 first = quad * 4;
+        out[0] = first + 0;
+        out[1] = first + 1;
+        out[2] = first + 2;
+        out[3] = first + 2;
+        out[4] = first + 3;
+        out[5] = first + 0;
+    }
+
+    glGenBuffers(1, &render_state.quad_index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_state.quad_index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_indices * sizeof(u32), indices, GL_STATIC_DRAW);
+    scratch_arena->restore(checkpoint);
+
+    gl_bind_vertex_array(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 #ifdef RIGEL_DEBUG
 
 void render_debug_init(mem::Arena* gfx_arena)
@@ -505,7 +851,7 @@ void render_debug_init(mem::Arena* gfx_arena)
     glGenBuffers(1, &debug_state.lines_vbo);
     glGenVertexArrays(1, &debug_state.lines_vao);
 
-    glBindVertexArray(debug_state.lines_vao);
+    gl_bind_vertex_array(debug_state.lines_vao);
     glBindBuffer(GL_ARRAY_BUFFER, debug_state.lines_vbo);
 
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(f32), (void*)0);
@@ -513,7 +859,7 @@ void render_debug_init(mem::Arena* gfx_arena)
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(f32), (void*)(3 * sizeof(f32)));
     glEnableVertexAttribArray(1);
 
-    glBindVertexArray(0);
+    gl_bind_vertex_array(0);
 
     //lines shader
     Shader* dbg_line_shader = &game_shaders[DEBUG_LINE_SHADER];
@@ -527,7 +873,7 @@ void render_debug_lines()
     usize n_lines;
     debug::DebugLine* lines = debug::get_lines_for_frame(&n_lines);
 
-    glBindVertexArray(debug_state.lines_vao);
+    gl_bind_vertex_array(debug_state.lines_vao);
     glBindBuffer(GL_ARRAY_BUFFER, debug_state.lines_vbo);
 
     glBufferData(GL_ARRAY_BUFFER, n_lines * sizeof(debug::DebugLine), lines, GL_DYNAMIC_DRAW);
@@ -535,23 +881,19 @@ void render_debug_lines()
     m::Mat4 screen_transform =
         m::scale_by(m::Vec3 { 2.0f / 320.0f, 2.0f / 180.0f, 1.0f }) *
         m::translation_by(m::Vec3 {-1.0f, -1.0f, 0.0f});
-    Shader shader = game_shaders[DEBUG_LINE_SHADER];
-    glUseProgram(shader.id);
-    glUniformMatrix4fv(glGetUniformLocation(shader.id, "screen_transform"),
-                       1,
-                       false,
-                       reinterpret_cast<f32*>(&screen_transform));
+    Shader* shader = &game_shaders[DEBUG_LINE_SHADER];
+    gl_use_program(shader->id);
+    shader_set_uniform_m4v(shader, ShaderUniform_screen_transform, screen_transform);
 
     glDrawArrays(GL_LINES, 0, 2 * n_lines);
-    glBindVertexArray(0);
 }
 
 #endif
 
-void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
+// GL state and objects every renderer needs, context or not
+static void
+set_up_renderer_state(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
 {
-    render_state.gfx_arena = gfx_arena;
-
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -562,8 +904,7 @@ void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, render_state.global_ubo);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    set_up_vertex_buffer_for_rectangles(&render_state.sprite_buffer);
-    set_up_vertex_buffer_for_quads(&render_state.quad_buffer);
+    set_up_stream_buffers(gfx_arena);
 
     TextureConfig sprite_atlas_cfg;
     sprite_atlas_cfg.width = 512;
@@ -585,21 +926,6 @@ void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
     Shader* background_gradient_shader = &game_shaders[BACKGROUND_GRADIENT_SHADER];
     shader_load_from_src(background_gradient_shader, screen_vs_src, fs_gradient);
 
-    Shader* map_shader = &game_shaders[TILEMAP_DRAW_SHADER];
-    TextResource map_shader_vs = load_text_resource("resource/shader/vs_map_batched.glsl");
-    TextResource map_shader_fs = load_text_resource("resource/shader/fs_map_batched.glsl");
-    shader_load_from_src(map_shader, map_shader_vs.text, map_shader_fs.text);
-
-    Shader* entity_shader = &game_shaders[ENTITY_DRAW_SHADER];
-    TextResource entity_shader_vs = load_text_resource("resource/shader/vs_entity.glsl");
-    TextResource entity_shader_fs = load_text_resource("resource/shader/fs_entity.glsl");
-    shader_load_from_src(entity_shader, entity_shader_vs.text, entity_shader_fs.text);
-
-    Shader* shadow_shader = &game_shaders[TILE_OCCLUDER_SHADER];
-    TextResource shadow_shader_vs = load_text_resource("resource/shader/vs_shadowmap.glsl");
-    TextResource shadow_shader_fs = load_text_resource("resource/shader/fs_shadowmap.glsl");
-    shader_load_from_src(shadow_shader, shadow_shader_vs.text, shadow_shader_fs.text);
-
     Shader* simple_rect = &game_shaders[SIMPLE_RECTANGLE_SHADER];
     shader_load_from_src(simple_rect, simple_rect_vs, simple_rect_fs);
 
@@ -608,7 +934,11 @@ void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
 
     Shader* simple_quad = &game_shaders[SIMPLE_QUAD_SHADER];
     shader_load_from_src(simple_quad, simple_quad_vs, simple_sprite_fs);
+}
 
+static void
+alloc_renderable_assets(mem::Arena* gfx_arena)
+{
     // NOTE(spencer): RenderableAssets must be the first thing in the arena,
     // i.e. (RenderableAssets*)gfx_arena->mem_begin should be a valid conversion
     RenderableAssets* assets = gfx_arena->alloc_simple<RenderableAssets>();
@@ -617,6 +947,30 @@ void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
         assets->ready_textures->map[i].resource_id = RESOURCE_ID_NONE;
         assets->ready_textures->map[i].texture_idx = RESOURCE_ID_NONE;
     }
+}
+
+void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
+{
+    render_state.gfx_arena = gfx_arena;
+
+    set_up_renderer_state(gfx_arena, fb_width, fb_height);
+
+    Shader* map_shader = &game_shaders[TILEMAP_DRAW_SHADER];
+    TextResource map_shader_vs = load_text_resource("resource/shader/vs_map_batched.glsl");
+    TextResource map_shader_fs = load_text_resource("resource/shader/fs_map_batched.glsl");
+    shader_load_from_src(map_shader, map_shader_vs.text, map_shader_fs.text);
+
+    Shader* entity_shader = &game_shaders[ENTITY_DRAW_SHADER];
+    TextResource entity_shader_vs = load_text_resource("resource/shader/vs_entity.glsl");
+    TextResource entity_shader_fs = load_text_resource("resource/shader/fs_entity.glsl");
+    shader_load_from_src(entity_shader, entity_shader_vs.text, entity_shader_fs.text);
+
+    Shader* shadow_shader = &game_shaders[TILE_OCCLUDER_SHADER];
+    TextResource shadow_shader_vs = load_text_resource("resource/shader/vs_shadowmap.glsl");
+    TextResource shadow_shader_fs = load_text_resource("resource/shader/fs_shadowmap.glsl");
+    shader_load_from_src(shadow_shader, shadow_shader_vs.text, shadow_shader_fs.text);
+
+    alloc_renderable_assets(gfx_arena);
 
     //ImageResource bg_image = load_image_resource("resource/image/Clouds/Clouds 7/1.png");
     //render_state.bg_image_id = bg_image.resource_id;
@@ -627,6 +981,21 @@ void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height)
 
 }
 
+GLRecording*
+initialize_headless_renderer(mem::Arena* gfx_arena)
+{
+    render_state.gfx_arena = gfx_arena;
+    alloc_renderable_assets(gfx_arena);
+
+    GLRecording* recording = gl_recording_install(gfx_arena);
+    // a fresh backend has nothing bound
+    render_state.gl = GLStateCache {};
+
+    set_up_renderer_state(gfx_arena, RENDER_INTERNAL_WIDTH, RENDER_INTERNAL_HEIGHT);
+
+    return recording;
+}
+
 m::Vec4 linear_to_srgb(m::Vec4 rgba)
 {
     return m::Vec4{powf(rgba.r, 2.2), powf(rgba.g, 2.2), powf(rgba.b, 2.2), rgba.a};
@@ -642,7 +1011,7 @@ void begin_render(Viewport& viewport, f32 fb_width, f32 fb_height)
     render_state.screen_target.w = fb_width;
     render_state.screen_target.h = fb_height;
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_bind_framebuffer(0);
 
     render_state.current_viewport.x = 0;
     render_state.current_viewport.y = 0;
@@ -652,6 +1021,8 @@ void begin_render(Viewport& viewport, f32 fb_width, f32 fb_height)
     glViewport(0, 0, render_state.screen_target.w, render_state.screen_target.h);
     // NOTE: retrieved from tilesheet
 
+    stream_buffer_begin_frame(&render_state.stream);
+
     render_state.last_used_point_light_idx = 0;
     render_state.point_lights_need_update = false;
 
@@ -669,6 +1040,8 @@ void end_render()
 #ifdef RIGEL_DEBUG
     render_debug_lines();
 #endif
+
+    stream_buffer_end_frame(&render_state.stream);
 }
 
 SpriteId
@@ -729,7 +1102,7 @@ atlas_rebuffer(SpriteAtlas* atlas, mem::Arena* temp_arena)
     i32 row_offset = atlas->sprites[0].dimensions.x;
     i32 row_remain = 512;
 
-    glBindTexture(GL_TEXTURE_2D, atlas->texture.id);
+    gl_bind_texture_for_edit(GL_TEXTURE_2D, atlas->texture.id);
     for (i32 im = 0; im < atlas->next_free_sprite_id; im++)
     {
         auto sprite = atlas->sprites + im;
@@ -795,35 +1168,39 @@ set_up_vertex_buffer_for_rectangles(VertexBuffer* buffer)
         // blow old ones away
         glDeleteBuffers(1, &buffer->ebo);
         glDeleteBuffers(1, &buffer->vbo);
-        glDeleteVertexArrays(1, &buffer->vao);
+        gl_delete_vertex_array(buffer->vao);
     }
 
-    // make new buffers
+    // make new buffers. No indices, each rectangle is an instance.
     glGenVertexArrays(1, &buffer->vao);
     glGenBuffers(1, &buffer->vbo);
-    glGenBuffers(1, &buffer->ebo);
+    buffer->ebo = 0;
 
-    glBindVertexArray(buffer->vao);
+    gl_bind_vertex_array(buffer->vao);
     glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
     glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
 
-    // min & max
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), (void*)offsetof(RectangleBufferVertex, world_max));
-    glEnableVertexAttribArray(1);
-    // color: rgb + strength
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), (void*)offsetof(RectangleBufferVertex, color_and_strength));
-    glEnableVertexAttribArray(2);
-    // atlas min & max
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), (void*)offsetof(RectangleBufferVertex, atlas_min));
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(RectangleBufferVertex), (void*)offsetof(RectangleBufferVertex, atlas_max));
-    glEnableVertexAttribArray(4);
+    enable_rect_attribs();
 
-    glBindVertexArray(0);
+    gl_bind_vertex_array(0);
+}
+
+void
+release_vertex_buffer(VertexBuffer* buffer)
+{
+    if (is_vertex_buffer_renderable(buffer))
+    {
+        // rectangle buffers have no ebo, deleting 0 is a no-op
+        glDeleteBuffers(1, &buffer->ebo);
+        glDeleteBuffers(1, &buffer->vbo);
+        gl_delete_vertex_array(buffer->vao);
+    }
+
+    buffer->vao = 0;
+    buffer->vbo = 0;
+    buffer->ebo = 0;
+    buffer->n_elems = 0;
+    buffer->n_instances = 0;
 }
 
 void 
@@ -834,7 +1211,7 @@ set_up_vertex_buffer_for_quads(VertexBuffer* buffer)
         // blow old ones away
         glDeleteBuffers(1, &buffer->ebo);
         glDeleteBuffers(1, &buffer->vbo);
-        glDeleteVertexArrays(1, &buffer->vao);
+        gl_delete_vertex_array(buffer->vao);
     }
 
     // new buffer
@@ -842,67 +1219,33 @@ set_up_vertex_buffer_for_quads(VertexBuffer* buffer)
     glGenBuffers(1, &buffer->vbo);
     glGenBuffers(1, &buffer->ebo);
 
-    glBindVertexArray(buffer->vao);
+    gl_bind_vertex_array(buffer->vao);
     glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
     glBufferData(GL_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, 0, 0, GL_DYNAMIC_DRAW);
 
-    // p
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)0);
-    glEnableVertexAttribArray(0);
-    // uv
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)(offsetof(QuadBufferVertex, uv)));
-    glEnableVertexAttribArray(1);
-    // color & strength
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(QuadBufferVertex), (void*)(offsetof(QuadBufferVertex, color_and_strength)));
-    glEnableVertexAttribArray(2);
+    enable_quad_attribs();
 
-    glBindVertexArray(0);
+    gl_bind_vertex_array(0);
 }
 
 // TODO(spencer): Maybe we buffer sprites instead? I still don't like that we're
 // using RectangleBufferVertex, I think that's something that shouldn't escape the renderer. Hmmmm.
 void
-buffer_rectangles(VertexBuffer* buffer, RectangleBufferVertex* rectangles, u32 n_rects, mem::Arena* scratch_arena)
+buffer_rectangles(VertexBuffer* buffer, RectangleBufferVertex* rectangles, u32 n_rects)
 {
-    u32 total_n_verts = n_rects * 4;
-    u32 total_n_indices = n_rects * 6;
-
-    mem::SimpleList<RectangleBufferVertex> verts = mem::make_simple_list<RectangleBufferVertex>(total_n_verts, scratch_arena);
-    mem::SimpleList<u32> indices = mem::make_simple_list<u32>(total_n_indices, scratch_arena);
+    buffer->n_instances = n_rects;
 
-    for (u32 i = 0; i < n_rects; i++) 
-    {
-        for (u32 vert = 0; vert < 4; vert++)
-        {
-            simple_list_append(&verts, rectangles[i]);
-        }
-        
-        auto index_start = i * 4;
-        simple_list_append(&indices, index_start + 0);
-        simple_list_append(&indices, index_start + 1);
-        simple_list_append(&indices, index_start + 2);
-        simple_list_append(&indices, index_start + 2);
-        simple_list_append(&indices, index_start + 3);
-        simple_list_append(&indices, index_start + 0);
-    }
-
-    glBindVertexArray(buffer->vao);
+    // the rectangles are the instances as they are, nothing to expand
     glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->ebo);
-
     // TODO(spencer): need to expose memory type param
-    glBufferData(GL_ARRAY_BUFFER, verts.length * sizeof(RectangleBufferVertex), verts.items, GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.length * sizeof(u32), indices.items, GL_STATIC_DRAW);
-    
-    glBindVertexArray(0);
-
-    buffer->n_elems = indices.length;
+    glBufferData(GL_ARRAY_BUFFER, n_rects * sizeof(RectangleBufferVertex), rectangles, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 BatchBuffer*
-make_batch_buffer(mem::Arena* target_arena, u32 size_in_bytes)
+make_batch_buffer(mem::Arena* target_arena, u32 size_in_bytes, b32 sort_items)
 {
     BatchBuffer* result = target_arena->alloc_simple<BatchBuffer>();
     result->buffer = target_arena->alloc_bytes(size_in_bytes);
@@ -911,105 +1254,122 @@ make_batch_buffer(mem::Arena* target_arena, u32 size_in_bytes)
     result->items_in_buffer = 0;
     result->buffer_used = 0;
     result->buffer_size = size_in_bytes;
+    result->sort_items = sort_items;
     return result;
 }
 
+// binds the active shader and its textures and uniforms for a draw
 static void
-do_draw_elem_buffer(u32 n_elems, Texture** textures)
+prepare_draw(Texture** textures)
 {
     // TODO: this should go somewhere else?
     auto shader = render_state.active_shader;
-    glUseProgram(shader->id);
+    gl_use_program(shader->id);
 
-    char tex_name[16];
-    for (u32 i = 0; i < 4; i++)
+    // the textureN samplers were pointed at their slots when it was linked
+    for (u32 i = 0; i < MAX_TEXTURE_SLOTS; i++)
     {
         if (textures[i] == nullptr) 
         {
             continue;
         }
 
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, textures[i]->id);
-
-        snprintf(tex_name, 16, "texture%d", i);
-        shader_set_uniform_1i(shader, tex_name, i);
+        gl_bind_texture_2d(i, textures[i]->id);
 
-        snprintf(tex_name, 16, "tdim%d", i);
         m::Vec2 dims_2d = m::Vec2 { textures[i]->dims.x, textures[i]->dims.y };
-        shader_set_uniform_2fv(shader, tex_name, dims_2d);
+        shader_set_uniform_2fv(shader, (ShaderUniform)(ShaderUniform_tdim0 + i), dims_2d);
     }
 
     m::Mat4 screen_transform = 
         m::scale_by(m::Vec3 {(2.0f / render_state.current_viewport.w), (2.0f / render_state.current_viewport.h), 0.0f})
         * m::translation_by(m::Vec3 { -render_state.current_viewport.w / 2.0f, -render_state.current_viewport.h / 2.0f });
 
-    shader_set_uniform_m4v(shader, "screen_transform", screen_transform);
+    shader_set_uniform_m4v(shader, ShaderUniform_screen_transform, screen_transform);
+}
 
+static void
+do_draw_elem_buffer(u32 n_elems, Texture** textures)
+{
+    prepare_draw(textures);
     glDrawElements(GL_TRIANGLES, n_elems, GL_UNSIGNED_INT, 0);
 }
 
-
 static void
-do_draw_rects(mem::SimpleList<RectangleBufferVertex>* quad_verts, mem::SimpleList<u32>* indices, Texture** textures)
+do_draw_rect_instances(u32 n_instances, Texture** textures)
 {
-    glBindVertexArray(render_state.sprite_buffer.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_state.sprite_buffer.vbo);
-    glBufferData(GL_ARRAY_BUFFER, quad_verts->length * sizeof(RectangleBufferVertex), quad_verts->items, GL_DYNAMIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_state.sprite_buffer.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices->length * sizeof(u32), indices->items, GL_DYNAMIC_DRAW);
-
-    do_draw_elem_buffer(indices->length, textures);
-
-    glBindVertexArray(0);
+    prepare_draw(textures);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, n_instances);
 }
 
-// TODO: this is the same as above
+// draws a retained buffer whichever way it was set up
 static void
-do_draw_quads(mem::SimpleList<QuadBufferVertex>* quad_verts, mem::SimpleList<u32>* indices, Texture** textures)
+do_draw_vertex_buffer(VertexBuffer* buffer, Texture** textures)
 {
-    glBindVertexArray(render_state.quad_buffer.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_state.quad_buffer.vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_state.quad_buffer.ebo);
+    gl_bind_vertex_array(buffer->vao);
+    if (buffer->ebo)
+    {
+        do_draw_elem_buffer(buffer->n_elems, textures);
+    }
+    else
+    {
+        do_draw_rect_instances(buffer->n_instances, textures);
+    }
+}
+
 
-    glBufferData(GL_ARRAY_BUFFER, quad_verts->length * sizeof(QuadBufferVertex), quad_verts->items, GL_DYNAMIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices->length * sizeof(u32), indices->items, GL_DYNAMIC_DRAW);
+static void
+do_draw_rects(mem::SimpleList<RectangleBufferVertex>* rects, Texture** textures)
+{
+    u32 offset = stream_buffer_write(&render_state.stream,
+                                     rects->items,
+                                     rects->length * sizeof(RectangleBufferVertex),
+                                     sizeof(RectangleBufferVertex));
 
-    do_draw_elem_buffer(indices->length, textures);
+    // there's no base instance before GL 4.2, so the attributes get pointed
+    // at this batch instead
+    gl_bind_vertex_array(render_state.stream_rect_vao);
+    point_rect_attribs_at(offset);
 
-    glBindVertexArray(0);
+    do_draw_rect_instances(rects->length, textures);
 }
 
 static void
-basic_rect_to_verts(mem::SimpleList<RectangleBufferVertex>* verts, mem::SimpleList<u32>* indices, RectangleItem* rect_item)
+do_draw_quads(mem::SimpleList<QuadBufferVertex>* quad_verts, Texture** textures)
 {
-    auto index_start = verts->length;
-    // TODO(spencer): we need to be z-sorting here
-    for (u32 i = 0; i < 4; i++)
+    u32 offset = stream_buffer_write(&render_state.stream,
+                                     quad_verts->items,
+                                     quad_verts->length * sizeof(QuadBufferVertex),
+                                     sizeof(QuadBufferVertex));
+    u32 base_vertex = offset / sizeof(QuadBufferVertex);
+    u32 n_quads = quad_verts->length / 4;
+
+    gl_bind_vertex_array(render_state.stream_quad_vao);
+    prepare_draw(textures);
+    for (u32 first = 0; first < n_quads; first += STREAM_MAX_QUADS_PER_DRAW)
     {
-        auto vert = simple_list_append_new(verts);
-
-        vert->world_min.x = rect_item->min.x;
-        vert->world_min.y = rect_item->min.y;
-        vert->world_max.x = rect_item->max.x;
-        vert->world_max.y = rect_item->max.y;
-        vert->color_and_strength = rect_item->color_and_strength;
+        u32 n_to_draw = n_quads - first;
+        n_to_draw = n_to_draw < STREAM_MAX_QUADS_PER_DRAW ? n_to_draw : STREAM_MAX_QUADS_PER_DRAW;
+        glDrawElementsBaseVertex(GL_TRIANGLES, n_to_draw * 6, GL_UNSIGNED_INT, 0, base_vertex + first * 4);
     }
-
-    simple_list_append(indices, index_start + 0);
-    simple_list_append(indices, index_start + 1);
-    simple_list_append(indices, index_start + 2);
-    simple_list_append(indices, index_start + 2);
-    simple_list_append(indices, index_start + 3);
-    simple_list_append(indices, index_start + 0);
 }
 
 static void
-sprite_to_verts(mem::SimpleList<RectangleBufferVertex>* verts, mem::SimpleList<u32>* indices, SpriteItem* sprite_item)
+basic_rect_to_instance(mem::SimpleList<RectangleBufferVertex>* rects, RectangleItem* rect_item)
 {
-    auto index_start = verts->length;
+    auto rect = simple_list_append_new(rects);
+
+    rect->world_min.x = rect_item->min.x;
+    rect->world_min.y = rect_item->min.y;
+    rect->world_max.x = rect_item->max.x;
+    rect->world_max.y = rect_item->max.y;
+    rect->color_and_strength = rect_item->color_and_strength;
+    rect->atlas_min = m::Vec2 {0, 0};
+    rect->atlas_max = m::Vec2 {0, 0};
+}
 
+static void
+sprite_to_instance(mem::SimpleList<RectangleBufferVertex>* rects, SpriteItem* sprite_item)
+{
     m::Vec3 world_min = sprite_item->position;
     m::Vec3 world_max = {0, 0, 0};
     m::Vec2 atlas_min = {0, 0};
@@ -1024,33 +1384,20 @@ sprite_to_verts(mem::SimpleList<RectangleBufferVertex>* verts, mem::SimpleList<u
         atlas_max = sprite->atlas_min + sprite_item->sprite_segment_max;
     }
 
-    // TODO(spencer): we need to be z-sorting here
-    for (u32 i = 0; i < 4; i++)
-    {
-        auto vert = simple_list_append_new(verts);
-
-        vert->world_min.x = world_min.x;
-        vert->world_min.y = world_min.y;
-        vert->world_max.x = world_max.x;
-        vert->world_max.y = world_max.y;
-        vert->color_and_strength = sprite_item->color_and_strength;
-        vert->atlas_min = atlas_min;
-        vert->atlas_max = atlas_max;
-    }
+    auto rect = simple_list_append_new(rects);
 
-    simple_list_append(indices, index_start + 0);
-    simple_list_append(indices, index_start + 1);
-    simple_list_append(indices, index_start + 2);
-    simple_list_append(indices, index_start + 2);
-    simple_list_append(indices, index_start + 3);
-    simple_list_append(indices, index_start + 0);
+    rect->world_min.x = world_min.x;
+    rect->world_min.y = world_min.y;
+    rect->world_max.x = world_max.x;
+    rect->world_max.y = world_max.y;
+    rect->color_and_strength = sprite_item->color_and_strength;
+    rect->atlas_min = atlas_min;
+    rect->atlas_max = atlas_max;
 }
 
-void
-quad_to_verts(mem::SimpleList<QuadBufferVertex>* quad_verts, mem::SimpleList<u32>* quad_indices, QuadItem* quad_item)
+static void
+quad_to_verts(mem::SimpleList<QuadBufferVertex>* quad_verts, QuadItem* quad_item)
 {
-    auto index_start = quad_verts->length;
-
     // expects CCW winding
     auto v1 = simple_list_append_new(quad_verts);
     v1->p = quad_item->v1;
@@ -1071,158 +1418,396 @@ quad_to_verts(mem::SimpleList<QuadBufferVertex>* quad_verts, mem::SimpleList<u32
     v4->p = quad_item->v4;
     v4->uv = m::Vec2 {0, 1};
     v4->color_and_strength = quad_item->color_and_strength;
+}
+
+static Item*
+next_render_item(Item* item)
+{
+    usize item_size = 0;
+    switch (item->type)
+    {
+#define X(ItemName) case RenderItemType_##ItemName: item_size = sizeof(ItemName##Item); break;
+        RENDER_ITEM_LIST
+#undef X
+
+        default:
+        {
+            assert(0 && "Bad default case reached");
+        }
+    }
 
-    simple_list_append(quad_indices, index_start + 0);
-    simple_list_append(quad_indices, index_start + 1);
-    simple_list_append(quad_indices, index_start + 2);
-    simple_list_append(quad_indices, index_start + 2);
-    simple_list_append(quad_indices, index_start + 3);
-    simple_list_append(quad_indices, index_start + 0);
+    return reinterpret_cast<Item*>(reinterpret_cast<ubyte*>(item) + item_size);
 }
 
-void
-submit_batch(BatchBuffer* batch, mem::Arena* temp_arena)
+// renderables collected since the last state change, waiting to be drawn
+struct PendingDraws
 {
-    u32 items_in_buffer = batch->items_in_buffer;
-    u32 items_processed = 0;
+    mem::SimpleList<RectangleBufferVertex> rects;
+    mem::SimpleList<QuadBufferVertex> quad_verts;
+};
 
-    // TODO(spencer): this seems silly. Is it really worth treating these differently?
-    mem::SimpleList<RectangleBufferVertex> rect_verts = make_simple_list<RectangleBufferVertex>(batch->rect_count * 4, temp_arena);
-    mem::SimpleList<u32> rect_indices = make_simple_list<u32>(batch->rect_count * 6, temp_arena);
-    mem::SimpleList<QuadBufferVertex> quad_verts = make_simple_list<QuadBufferVertex>(batch->quad_count * 4, temp_arena);
-    mem::SimpleList<u32> quad_indices = make_simple_list<u32>(batch->quad_count * 6, temp_arena);
-    Texture *textures[4] = {0};
-
-    b32 need_to_render = false;
-    //RenderItemType last_renderable_type = RenderItemType_None;
-    Item* item = reinterpret_cast<Item*>(batch->buffer);
-    while (items_processed < items_in_buffer)
+static void
+flush_pending_draws(PendingDraws* pending, Texture** textures)
+{
+    if (pending->rects.length > 0)
+    {
+        do_draw_rects(&pending->rects, textures);
+        pending->rects.length = 0;
+    }
+
+    if (pending->quad_verts.length > 0)
+    {
+        do_draw_quads(&pending->quad_verts, textures);
+        pending->quad_verts.length = 0;
+    }
+}
+
+static void
+append_renderable(PendingDraws* pending, Item* item)
+{
+    switch (item->type)
     {
-        // TODO(spencer): maybe what I'm after is something like `need_to_render = item->type == shader`?
-        need_to_render = (!is_renderable(item->type) && (rect_verts.length > 0 || quad_verts.length > 0));
-                         
-        if (need_to_render)
+        case RenderItemType_Rectangle:
         {
-            if (rect_verts.length > 0)
-            {
-                do_draw_rects(&rect_verts, &rect_indices, textures);
-                rect_verts.length = 0;
-                rect_indices.length = 0;
-            }
-            if (quad_verts.length > 0)
+            basic_rect_to_instance(&pending->rects, reinterpret_cast<RectangleItem*>(item));
+        } break;
+
+        case RenderItemType_Sprite:
+        {
+            sprite_to_instance(&pending->rects, reinterpret_cast<SpriteItem*>(item));
+        } break;
+
+        case RenderItemType_Quad:
+        {
+            quad_to_verts(&pending->quad_verts, reinterpret_cast<QuadItem*>(item));
+        } break;
+
+        default:
+        {
+            assert(0 && "Not a renderable item");
+        }
+    }
+}
+
+// the commands that touch GL directly. Shader and texture commands only
+// change what the next draw uses, so whoever's walking the batch keeps
+// track of those.
+static void
+execute_render_cmd(Item* item, Texture** textures)
+{
+    switch (item->type)
+    {
+        case RenderItemType_ClearBufferCmd:
+        {
+            auto clear_item = reinterpret_cast<ClearBufferCmdItem*>(item);
+            auto color = clear_item->clear_color;
+            glClearColor(color.r, color.g, color.b, color.a);
+            GLuint clear = GL_COLOR_BUFFER_BIT;
+            if (clear_item->clear_depth)
             {
-                do_draw_quads(&quad_verts, &quad_indices, textures);
-                quad_verts.length = 0;
-                quad_indices.length = 0;
+                clear |= GL_DEPTH_BUFFER_BIT;
             }
+
+            glClear(clear);
+        } break;
+
+        case RenderItemType_SwitchTargetCmd:
+        {
+            auto switch_item = reinterpret_cast<SwitchTargetCmdItem*>(item);
+            auto target = switch_item->target;
+            gl_bind_framebuffer(target->target_framebuf);
+            glViewport(0, 0, target->w, target->h);
+
+            render_state.current_viewport.w = target->w;
+            render_state.current_viewport.h = target->h;
+        } break;
+
+        case RenderItemType_DrawVertexBufferCmd:
+        {
+            auto draw_item = reinterpret_cast<DrawVertexBufferCmdItem*>(item);
+
+            do_draw_vertex_buffer(draw_item->buffer, textures);
+        } break;
+
+        default:
+        {
+            assert(0 && "Bad default case reached");
         }
+    }
+}
 
-        switch (item->type)
+// Sort keys for sorted batches, most significant bits first:
+//
+//   63..48  segment. Bumped around every clear, target switch and vertex
+//           buffer draw so nothing moves across them.
+//   47..32  layer, the top half of the item's z as sortable bits. Lower z
+//           draws first.
+//   31..24  shader, an index into the batch's shader table
+//   23..16  textures, an index into the batch's texture set table
+//   15..0   unused
+//
+// Ties keep the order the items were pushed in.
+#define SORT_KEY_SEGMENT_SHIFT 48
+#define SORT_KEY_LAYER_SHIFT 32
+#define SORT_KEY_SHADER_SHIFT 24
+#define SORT_KEY_TEXTURES_SHIFT 16
+#define SORT_KEY_MAX_SEGMENT 0xFFFF
+#define SORT_KEY_MAX_STATES 256
+
+struct SortedRenderItem
+{
+    u64 key;
+    Item* item;
+};
+
+struct TextureSet
+{
+    Texture* textures[MAX_TEXTURE_SLOTS];
+};
+
+// maps a float to bits that compare the same way the float does
+static u32
+sortable_depth_bits(f32 z)
+{
+    u32 bits;
+    memcpy(&bits, &z, sizeof(bits));
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+static f32
+render_item_depth(Item* item)
+{
+    switch (item->type)
+    {
+        case RenderItemType_Rectangle: return reinterpret_cast<RectangleItem*>(item)->min.z;
+        case RenderItemType_Sprite: return reinterpret_cast<SpriteItem*>(item)->position.z;
+        case RenderItemType_Quad: return reinterpret_cast<QuadItem*>(item)->v1.z;
+        default: return 0;
+    }
+}
+
+// LSD radix sort a byte at a time. Stable, and skips the passes where every
+// key has the same byte, which for a batch is most of them. Returns
+// whichever of the two buffers the result ended up in.
+static SortedRenderItem*
+radix_sort_render_items(SortedRenderItem* items, SortedRenderItem* scratch, u32 n_items)
+{
+    SortedRenderItem* src = items;
+    SortedRenderItem* dst = scratch;
+    for (u32 shift = 0; shift < 64; shift += 8)
+    {
+        u32 counts[256] = {0};
+        for (u32 i = 0; i < n_items; i++)
         {
-            case RenderItemType_Rectangle:
-            {
-                auto rect_item = reinterpret_cast<RectangleItem*>(item);
+            counts[(src[i].key >> shift) & 0xFF]++;
+        }
 
-                basic_rect_to_verts(&rect_verts, &rect_indices, rect_item);
+        if (n_items == 0 || counts[(src[0].key >> shift) & 0xFF] == n_items)
+        {
+            continue;
+        }
 
-                item = reinterpret_cast<Item*>(rect_item + 1);
-            } break;
+        u32 offset = 0;
+        for (u32 byte = 0; byte < 256; byte++)
+        {
+            u32 count = counts[byte];
+            counts[byte] = offset;
+            offset += count;
+        }
 
-            case RenderItemType_Sprite:
-            {
-                auto sprite_item = reinterpret_cast<SpriteItem*>(item);
+        for (u32 i = 0; i < n_items; i++)
+        {
+            dst[counts[(src[i].key >> shift) & 0xFF]++] = src[i];
+        }
 
-                sprite_to_verts(&rect_verts, &rect_indices, sprite_item);
+        SortedRenderItem* tmp = src;
+        src = dst;
+        dst = tmp;
+    }
 
-                item = reinterpret_cast<Item*>(sprite_item + 1);
-            } break;
+    return src;
+}
 
-            case RenderItemType_Quad:
-            {
-                auto quad_item = reinterpret_cast<QuadItem*>(item);
+static u32
+find_or_add_shader(Shader** shaders, u32* n_shaders, Shader* shader)
+{
+    for (u32 i = 0; i < *n_shaders; i++)
+    {
+        if (shaders[i] == shader)
+        {
+            return i;
+        }
+    }
 
-                quad_to_verts(&quad_verts, &quad_indices, quad_item); 
+    assert(*n_shaders < SORT_KEY_MAX_STATES && "Too many shaders in one batch");
+    shaders[*n_shaders] = shader;
+    return (*n_shaders)++;
+}
 
-                item = reinterpret_cast<Item*>(quad_item + 1);
+static u32
+find_or_add_texture_set(TextureSet* sets, u32* n_sets, Texture** textures)
+{
+    for (u32 i = 0; i < *n_sets; i++)
+    {
+        if (memcmp(sets[i].textures, textures, sizeof(sets[i].textures)) == 0)
+        {
+            return i;
+        }
+    }
 
-            } break;
+    assert(*n_sets < SORT_KEY_MAX_STATES && "Too many texture sets in one batch");
+    memcpy(sets[*n_sets].textures, textures, sizeof(sets[*n_sets].textures));
+    return (*n_sets)++;
+}
 
-            case RenderItemType_ClearBufferCmd:
-            {
-                auto clear_item = reinterpret_cast<ClearBufferCmdItem*>(item);
-                auto color = clear_item->clear_color;
-                glClearColor(color.r, color.g, color.b, color.a);
-                GLuint clear = GL_COLOR_BUFFER_BIT;
-                if (clear_item->clear_depth)
-                {
-                    clear |= GL_DEPTH_BUFFER_BIT;
-                }
+static void
+submit_batch_sorted(BatchBuffer* batch, PendingDraws* pending, mem::Arena* temp_arena)
+{
+    u32 items_in_buffer = batch->items_in_buffer;
+    SortedRenderItem* keyed = temp_arena->alloc_array<SortedRenderItem>(items_in_buffer + 1);
+    SortedRenderItem* scratch = temp_arena->alloc_array<SortedRenderItem>(items_in_buffer + 1);
+    Shader** shaders = temp_arena->alloc_array<Shader*>(SORT_KEY_MAX_STATES);
+    TextureSet* texture_sets = temp_arena->alloc_array<TextureSet>(SORT_KEY_MAX_STATES);
+    u32 n_shaders = 0;
+    u32 n_texture_sets = 0;
+
+    // shader and texture commands are folded into the keys of the items
+    // that come after them, they don't get keys of their own
+    Shader* shader = render_state.active_shader;
+    Texture* textures[MAX_TEXTURE_SLOTS] = {0};
+    u64 state_bits = 0;
+    b32 state_changed = true;
+    u64 segment = 0;
+    u32 n_keyed = 0;
 
-                glClear(clear);
+    Item* item = reinterpret_cast<Item*>(batch->buffer);
+    for (u32 i = 0; i < items_in_buffer; i++, item = next_render_item(item))
+    {
+        if (item->type == RenderItemType_UseShaderCmd)
+        {
+            shader = reinterpret_cast<UseShaderCmdItem*>(item)->shader;
+            state_changed = true;
+            continue;
+        }
 
-                item = reinterpret_cast<Item*>(clear_item + 1);
-            } break;
+        if (item->type == RenderItemType_AttachTextureCmd)
+        {
+            auto tex_item = reinterpret_cast<AttachTextureCmdItem*>(item);
+            assert(tex_item->slot < MAX_TEXTURE_SLOTS && "Bad texture slot");
+            textures[tex_item->slot] = tex_item->texture;
+            state_changed = true;
+            continue;
+        }
 
-            case RenderItemType_SwitchTargetCmd:
-            {
-                auto switch_item = reinterpret_cast<SwitchTargetCmdItem*>(item);
-                auto target = switch_item->target;
-                glBindFramebuffer(GL_FRAMEBUFFER, target->target_framebuf);
-                glViewport(0, 0, target->w, target->h);
+        if (state_changed)
+        {
+            u64 shader_idx = find_or_add_shader(shaders, &n_shaders, shader);
+            u64 textures_idx = find_or_add_texture_set(texture_sets, &n_texture_sets, textures);
+            state_bits = (shader_idx << SORT_KEY_SHADER_SHIFT) | (textures_idx << SORT_KEY_TEXTURES_SHIFT);
+            state_changed = false;
+        }
 
-                render_state.current_viewport.w = target->w;
-                render_state.current_viewport.h = target->h;
+        u64 key = state_bits;
+        if (is_renderable(item->type))
+        {
+            u64 layer = sortable_depth_bits(render_item_depth(item)) >> 16;
+            key |= (segment << SORT_KEY_SEGMENT_SHIFT) | (layer << SORT_KEY_LAYER_SHIFT);
+        }
+        else
+        {
+            // a segment of its own, so it stays between what was pushed
+            // before it and what was pushed after
+            key |= (segment + 1) << SORT_KEY_SEGMENT_SHIFT;
+            segment += 2;
+            assert(segment <= SORT_KEY_MAX_SEGMENT && "Too many commands in a sorted batch");
+        }
 
-                item = reinterpret_cast<Item*>(switch_item + 1);
-            } break;
+        keyed[n_keyed].key = key;
+        keyed[n_keyed].item = item;
+        n_keyed++;
+    }
+
+    SortedRenderItem* sorted = radix_sort_render_items(keyed, scratch, n_keyed);
+
+    u64 applied_state = ~0ull;
+    for (u32 i = 0; i < n_keyed; i++)
+    {
+        u64 state = sorted[i].key & 0xFFFF0000;
+        if (state != applied_state)
+        {
+            flush_pending_draws(pending, textures);
+            render_state.active_shader = shaders[(state >> SORT_KEY_SHADER_SHIFT) & 0xFF];
+            memcpy(textures, texture_sets[(state >> SORT_KEY_TEXTURES_SHIFT) & 0xFF].textures, sizeof(textures));
+            applied_state = state;
+        }
+
+        if (is_renderable(sorted[i].item->type))
+        {
+            append_renderable(pending, sorted[i].item);
+        }
+        else
+        {
+            flush_pending_draws(pending, textures);
+            execute_render_cmd(sorted[i].item, textures);
+        }
+    }
+
+    flush_pending_draws(pending, textures);
+
+    // whatever sorted last, the batch leaves behind the shader it asked for
+    // last, same as an unsorted one would
+    render_state.active_shader = shader;
+}
+
+void
+submit_batch(BatchBuffer* batch, mem::Arena* temp_arena)
+{
+    // TODO(spencer): this seems silly. Is it really worth treating these differently?
+    PendingDraws pending;
+    pending.rects = make_simple_list<RectangleBufferVertex>(batch->rect_count, temp_arena);
+    pending.quad_verts = make_simple_list<QuadBufferVertex>(batch->quad_count * 4, temp_arena);
+
+    if (batch->sort_items)
+    {
+        submit_batch_sorted(batch, &pending, temp_arena);
+        return;
+    }
 
+    Texture *textures[MAX_TEXTURE_SLOTS] = {0};
+
+    Item* item = reinterpret_cast<Item*>(batch->buffer);
+    for (u32 i = 0; i < batch->items_in_buffer; i++, item = next_render_item(item))
+    {
+        if (is_renderable(item->type))
+        {
+            append_renderable(&pending, item);
+            continue;
+        }
+
+        flush_pending_draws(&pending, textures);
+
+        switch (item->type)
+        {
             case RenderItemType_UseShaderCmd:
             {
-                auto shader_item = reinterpret_cast<UseShaderCmdItem*>(item);
-
-                render_state.active_shader = shader_item->shader;
-                
-                item = reinterpret_cast<Item*>(shader_item + 1);
+                render_state.active_shader = reinterpret_cast<UseShaderCmdItem*>(item)->shader;
             } break;
 
             case RenderItemType_AttachTextureCmd:
             {
                 auto tex_item = reinterpret_cast<AttachTextureCmdItem*>(item);
-                assert(tex_item->slot < 4 && "Bad texture slot");
+                assert(tex_item->slot < MAX_TEXTURE_SLOTS && "Bad texture slot");
                 textures[tex_item->slot] = tex_item->texture;
-                item = reinterpret_cast<Item*>(tex_item + 1);
-            } break;
-
-            case RenderItemType_DrawVertexBufferCmd:
-            {
-                auto draw_item = reinterpret_cast<DrawVertexBufferCmdItem*>(item);
-
-                glBindVertexArray(draw_item->buffer->vao);
-                do_draw_elem_buffer(draw_item->buffer->n_elems, textures);
-                glBindVertexArray(0);
-
-                item = reinterpret_cast<Item*>(draw_item + 1);
-
             } break;
 
             default:
             {
-                assert(0 && "Bad default case reached");
+                execute_render_cmd(item, textures);
             }
         }
-        items_processed++;
     }
 
-    // TODO(spencer): I oughta be smarter about this, eh?
-    if (rect_verts.length > 0)
-    {
-        do_draw_rects(&rect_verts, &rect_indices, textures);
-    }
-
-    if (quad_verts.length > 0)
-    {
-        do_draw_quads(&quad_verts, &quad_indices, textures);
-    }
+    flush_pending_draws(&pending, textures);
 }
 
 void 
@@ -1305,3 +1890,228 @@ test_shadow_map(mem::Arena* scratch_arena, TileMap* tile_map, m::Vec3 light_pos,
 
 } // namespace render
 } // namespace rigel
+
+#include "doctest.h"
+
+TEST_CASE("sorted batches order by key and keep push order for ties")
+{
+    using namespace rigel;
+    using namespace rigel::render;
+
+    CHECK(sortable_depth_bits(-2.0f) < sortable_depth_bits(-1.0f));
+    CHECK(sortable_depth_bits(-1.0f) < sortable_depth_bits(0.0f));
+    CHECK(sortable_depth_bits(0.0f) < sortable_depth_bits(0.5f));
+    CHECK(sortable_depth_bits(0.5f) < sortable_depth_bits(100.0f));
+
+    Item items[6];
+    SortedRenderItem keyed[6];
+    SortedRenderItem scratch[6];
+    u64 keys[6] = { 0x0000000300000000ull, 0x0001000000000000ull, 0x0000000100000000ull,
+                    0x0000000300000000ull, 0x0000000100000000ull, 0x0000000200FF0000ull };
+    for (u32 i = 0; i < 6; i++)
+    {
+        keyed[i].key = keys[i];
+        keyed[i].item = &items[i];
+    }
+
+    SortedRenderItem* sorted = radix_sort_render_items(keyed, scratch, 6);
+
+    Item* expected[6] = { &items[2], &items[4], &items[5], &items[0], &items[3], &items[1] };
+    for (u32 i = 0; i < 6; i++)
+    {
+        CHECK(sorted[i].item == expected[i]);
+    }
+}
+
+TEST_CASE("batches reach the GL backend as one instanced draw per state change")
+{
+    using namespace rigel;
+    using namespace rigel::render;
+
+    static ubyte gfx_backing[8 * ONE_MB];
+    static ubyte temp_backing[ONE_MB];
+    mem::Arena gfx_arena(gfx_backing, sizeof(gfx_backing));
+    mem::Arena temp_arena(temp_backing, sizeof(temp_backing));
+    GLRecording* recording = initialize_headless_renderer(&gfx_arena);
+
+    static ubyte pixels[16 * 16 * 4];
+    SpriteId sprite = default_atlas_push_sprite(16, 16, pixels);
+    gl_recording_reset(recording);
+    default_atlas_rebuffer(&temp_arena);
+    CHECK(recording->bytes_uploaded == sizeof(pixels));
+
+    Shader* shader = &game_shaders[SIMPLE_SPRITE_SHADER];
+    Texture* atlas = get_default_sprite_atlas_texture();
+    TextureConfig other_cfg;
+    other_cfg.width = 16;
+    other_cfg.height = 16;
+    Texture other = make_texture(other_cfg);
+
+    // atlas, other, atlas: three state changes in push order, two when sorted
+    auto fill_batch = [&](BatchBuffer* batch)
+    {
+        batch_push_use_shader_cmd(batch, shader);
+        batch_push_attach_texture_cmd(batch, 0, atlas);
+        for (u32 i = 0; i < 3; i++)
+        {
+            batch_push_sprite(batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {(f32)i, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+        }
+        batch_push_attach_texture_cmd(batch, 0, &other);
+        for (u32 i = 0; i < 2; i++)
+        {
+            batch_push_sprite(batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {(f32)i, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+        }
+        batch_push_attach_texture_cmd(batch, 0, atlas);
+        batch_push_sprite(batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    };
+
+    BatchBuffer* batch = make_batch_buffer(&temp_arena, 4 * ONE_KB);
+    fill_batch(batch);
+    gl_recording_reset(recording);
+    submit_batch(batch, &temp_arena);
+
+    REQUIRE(recording->n_draw_calls == 3);
+    CHECK(recording->n_program_binds == 1);
+    CHECK(recording->bytes_uploaded == 6 * sizeof(RectangleBufferVertex));
+    u32 unsorted_instances[3] = { 3, 2, 1 };
+    u32 unsorted_textures[3] = { atlas->id, other.id, atlas->id };
+    for (u32 i = 0; i < 3; i++)
+    {
+        CHECK(recording->draws[i].kind == GLDrawKind_ArraysInstanced);
+        CHECK(recording->draws[i].count == 4);
+        CHECK(recording->draws[i].n_instances == unsorted_instances[i]);
+        CHECK(recording->draws[i].program == shader->id);
+        CHECK(recording->draws[i].textures[0] == unsorted_textures[i]);
+    }
+
+    BatchBuffer* sorted_batch = make_batch_buffer(&temp_arena, 4 * ONE_KB, true);
+    fill_batch(sorted_batch);
+    gl_recording_reset(recording);
+    submit_batch(sorted_batch, &temp_arena);
+
+    REQUIRE(recording->n_draw_calls == 2);
+    CHECK(recording->draws[0].n_instances == 4);
+    CHECK(recording->draws[0].textures[0] == atlas->id);
+    CHECK(recording->draws[1].n_instances == 2);
+    CHECK(recording->draws[1].textures[0] == other.id);
+
+    // the rectangle shader sorts after the sprite one, but the sprite one
+    // was asked for last
+    Shader* rect_shader = &game_shaders[SIMPLE_RECTANGLE_SHADER];
+    BatchBuffer* shaders_batch = make_batch_buffer(&temp_arena, 4 * ONE_KB, true);
+    batch_push_use_shader_cmd(shaders_batch, shader);
+    batch_push_attach_texture_cmd(shaders_batch, 0, atlas);
+    batch_push_sprite(shaders_batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    batch_push_use_shader_cmd(shaders_batch, rect_shader);
+    batch_push_sprite(shaders_batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    batch_push_use_shader_cmd(shaders_batch, shader);
+    batch_push_sprite(shaders_batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    gl_recording_reset(recording);
+    submit_batch(shaders_batch, &temp_arena);
+
+    REQUIRE(recording->n_draw_calls == 2);
+    CHECK(recording->draws[0].program == shader->id);
+    CHECK(recording->draws[1].program == rect_shader->id);
+    CHECK(render_state.active_shader == shader);
+
+    // nothing gets sorted across a clear
+    BatchBuffer* cleared_batch = make_batch_buffer(&temp_arena, 4 * ONE_KB, true);
+    batch_push_use_shader_cmd(cleared_batch, shader);
+    batch_push_attach_texture_cmd(cleared_batch, 0, atlas);
+    batch_push_sprite(cleared_batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 1}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    batch_push_clear_buffer_cmd(cleared_batch, m::Vec4 {0, 0, 0, 1}, false);
+    batch_push_sprite(cleared_batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, -1}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    gl_recording_reset(recording);
+    submit_batch(cleared_batch, &temp_arena);
+
+    CHECK(recording->n_draw_calls == 2);
+    CHECK(recording->n_clears == 1);
+}
+
+TEST_CASE("texture edits land on the texture being edited whatever slot is active")
+{
+    using namespace rigel;
+    using namespace rigel::render;
+
+    static ubyte gfx_backing[8 * ONE_MB];
+    static ubyte temp_backing[ONE_MB];
+    mem::Arena gfx_arena(gfx_backing, sizeof(gfx_backing));
+    mem::Arena temp_arena(temp_backing, sizeof(temp_backing));
+    GLRecording* recording = initialize_headless_renderer(&gfx_arena);
+
+    static ubyte pixels[16 * 16 * 4];
+    SpriteId sprite = default_atlas_push_sprite(16, 16, pixels);
+    default_atlas_rebuffer(&temp_arena);
+
+    Texture* atlas = get_default_sprite_atlas_texture();
+    TextureConfig other_cfg;
+    other_cfg.width = 16;
+    other_cfg.height = 16;
+    Texture other = make_texture(other_cfg);
+
+    // leaves the atlas bound on slot 0 with slot 1 selected
+    BatchBuffer* batch = make_batch_buffer(&temp_arena);
+    batch_push_use_shader_cmd(batch, &game_shaders[SIMPLE_SPRITE_SHADER]);
+    batch_push_attach_texture_cmd(batch, 0, atlas);
+    batch_push_attach_texture_cmd(batch, 1, &other);
+    batch_push_sprite(batch, sprite, m::Vec4 {1, 1, 1, 1}, m::Vec3 {0, 0, 0}, m::Vec2 {0, 0}, m::Vec2 {16, 16});
+    submit_batch(batch, &temp_arena);
+    REQUIRE(recording->active_texture_slot == 1);
+    REQUIRE(recording->textures[0] == atlas->id);
+
+    default_atlas_push_sprite(16, 16, pixels);
+    gl_recording_reset(recording);
+    default_atlas_rebuffer(&temp_arena);
+    CHECK(recording->active_texture_slot == 0);
+    CHECK(recording->uploaded_texture == atlas->id);
+    CHECK(recording->textures[1] == other.id);
+
+    gl_select_texture_slot(1);
+    Texture made = make_texture(other_cfg);
+    CHECK(recording->uploaded_texture == made.id);
+    CHECK(recording->textures[1] == other.id);
+
+    gl_select_texture_slot(1);
+    Texture array = alloc_array_texture(16, 16, 2, GL_RGBA8);
+    CHECK(recording->uploaded_texture == array.id);
+    CHECK(recording->array_textures[0] == array.id);
+    CHECK(recording->textures[0] == 0);
+}
+
+TEST_CASE("retained rectangle buffers upload once and draw every instance")
+{
+    using namespace rigel;
+    using namespace rigel::render;
+
+    static ubyte gfx_backing[8 * ONE_MB];
+    static ubyte temp_backing[ONE_MB];
+    mem::Arena gfx_arena(gfx_backing, sizeof(gfx_backing));
+    mem::Arena temp_arena(temp_backing, sizeof(temp_backing));
+    GLRecording* recording = initialize_headless_renderer(&gfx_arena);
+
+    VertexBuffer buffer = {};
+    set_up_vertex_buffer_for_rectangles(&buffer);
+    CHECK(is_vertex_buffer_renderable(&buffer));
+
+    RectangleBufferVertex rects[5] = {};
+    gl_recording_reset(recording);
+    buffer_rectangles(&buffer, rects, 5);
+    CHECK(recording->n_uploads == 1);
+    CHECK(recording->bytes_uploaded == sizeof(rects));
+
+    BatchBuffer* batch = make_batch_buffer(&temp_arena);
+    batch_push_use_shader_cmd(batch, &game_shaders[SIMPLE_RECTANGLE_SHADER]);
+    batch_push_draw_vertex_buffer_cmd(batch, &buffer);
+    batch_push_draw_vertex_buffer_cmd(batch, &buffer);
+    gl_recording_reset(recording);
+    submit_batch(batch, &temp_arena);
+
+    REQUIRE(recording->n_draw_calls == 2);
+    CHECK(recording->draws[0].n_instances == 5);
+    CHECK(recording->draws[0].vao == buffer.vao);
+    CHECK(recording->n_vao_binds == 1);
+    CHECK(recording->bytes_uploaded == 0);
+
+    release_vertex_buffer(&buffer);
+    CHECK(!is_vertex_buffer_renderable(&buffer));
+}
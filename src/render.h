@@ -5,6 +5,7 @@
 #include "resource.h"
 #include "collider.h"
 #include "rigelmath.h"
+#include "gl_recording.h"
 
 #include <string>
 
@@ -48,18 +49,52 @@ class Viewport
     f32 height;
 };
 
+#define MAX_TEXTURE_SLOTS 4
+
+// Uniforms the renderer sets itself. Their locations get looked up once,
+// when the shader is linked. textureN and tdimN have to stay in order.
+#define SHADER_UNIFORM_LIST \
+    X(screen_transform) \
+    X(world_transform) \
+    X(texture0) \
+    X(texture1) \
+    X(texture2) \
+    X(texture3) \
+    X(tdim0) \
+    X(tdim1) \
+    X(tdim2) \
+    X(tdim3)
+
+enum ShaderUniform
+{
+    #define X(name) ShaderUniform_##name,
+    SHADER_UNIFORM_LIST
+    #undef X
+    ShaderUniform_Count
+};
+
 struct Shader
 {
     u32 id;
+    // -1 for the ones the shader doesn't use
+    i32 uniform_locations[ShaderUniform_Count];
 };
 void 
 shader_load_from_src(Shader* shader, const char* vs_src, const char* fs_src);
+// By name works for any uniform, but only the ones in SHADER_UNIFORM_LIST
+// skip glGetUniformLocation.
 void
 shader_set_uniform_m4v(Shader* shader, const char* name, m::Mat4 mat);
 void
 shader_set_uniform_2fv(Shader* shader, const char* name, m::Vec2 vec);
 void
 shader_set_uniform_1i(Shader* shader, const char* name, i32 value);
+void
+shader_set_uniform_m4v(Shader* shader, ShaderUniform uniform, m::Mat4 mat);
+void
+shader_set_uniform_2fv(Shader* shader, ShaderUniform uniform, m::Vec2 vec);
+void
+shader_set_uniform_1i(Shader* shader, ShaderUniform uniform, i32 value);
 bool
 check_shader_status(u32 id, bool prog = false);
 
@@ -155,6 +190,10 @@ enum GameShaders {
 extern Shader game_shaders[N_GAME_SHADERS];
 
 void initialize_renderer(mem::Arena* gfx_arena, f32 fb_width, f32 fb_height);
+// Sets up the renderer on the recording GL backend (see gl_recording.h)
+// instead of a context, for the bench and the tests. Only the shaders
+// built into render.cpp are loaded.
+GLRecording* initialize_headless_renderer(mem::Arena* gfx_arena);
 
 void begin_render(Viewport& vp, f32 fb_width, f32 fb_height);
 
@@ -202,6 +241,9 @@ get_default_sprite_atlas_texture();
 
 // TODO(spencer): this name is bad since this type represents both
 // a "vertex" and a rectangle
+//
+// Rectangles are drawn instanced: one of these per rectangle, and the
+// vertex shader works out which corner it's on from gl_VertexID.
 struct RectangleBufferVertex
 {
     m::Vec2 world_min;
@@ -224,7 +266,10 @@ struct VertexBuffer
     u32 vbo;
     u32 ebo;
 
+    // quad buffers are indexed and draw n_elems indices. Rectangle buffers
+    // have no ebo and draw a 4 vertex strip per instance.
     u32 n_elems;
+    u32 n_instances;
 };
 
 void 
@@ -232,7 +277,9 @@ set_up_vertex_buffer_for_rectangles(VertexBuffer* buffer);
 void 
 set_up_vertex_buffer_for_quads(VertexBuffer* buffer);
 void
-buffer_rectangles(VertexBuffer* buffer, RectangleBufferVertex* rectangles, u32 n_verts, mem::Arena* scratch_arena);
+release_vertex_buffer(VertexBuffer* buffer);
+void
+buffer_rectangles(VertexBuffer* buffer, RectangleBufferVertex* rectangles, u32 n_verts);
 
 
 // TODO(spencer): this new strategy means that I need
@@ -250,6 +297,12 @@ struct BatchBuffer
     u32 quad_count;
     u32 items_in_buffer;
 
+    // when set, submit_batch sorts the renderables by a key made from
+    // their depth and the shader and textures they're drawn with, instead
+    // of drawing them in the order they were pushed. Clears, target
+    // switches and vertex buffer draws still happen where they were pushed.
+    b32 sort_items;
+
     u32 buffer_size;
     u32 buffer_used;
     ubyte* buffer;
@@ -393,7 +446,7 @@ RENDER_ITEM_LIST
 #undef X
 
 BatchBuffer*
-make_batch_buffer(mem::Arena* target_arena, u32 size_in_bytes = 1024);
+make_batch_buffer(mem::Arena* target_arena, u32 size_in_bytes = 1024, b32 sort_items = false);
 
 void
 submit_batch(BatchBuffer* batch, mem::Arena* temp_arena);
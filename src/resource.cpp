@@ -3,11 +3,16 @@
 #include "mem.h"
 #include "rigelmath.h"
 #include "json.h"
+#include "fs_linux.h"
+#include "asset_cache.h"
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
 
 #include "stb_image.h"
 
@@ -15,57 +20,81 @@ namespace rigel {
 
 static ResourceLookup* resource_lookup;
 
-// TODO: rewrite
-std::string
-slurp(std::ifstream& in)
-{
-    std::ostringstream sstr;
-    sstr << in.rdbuf();
-    return sstr.str();
-}
-
 void
 resource_initialize(mem::Arena& resource_arena)
 {
     resource_lookup = resource_arena.alloc_simple<ResourceLookup>();
 
-    resource_lookup->text_storage = resource_arena.alloc_sub_arena(1024 * ONE_KB);
-    resource_lookup->image_storage = resource_arena.alloc_sub_arena(10 * ONE_MB);
-    resource_lookup->frame_storage = resource_arena.alloc_sub_arena(ONE_KB);
+    resource_lookup->texts.init(&resource_arena, MAX_RESOURCES_PER_KIND);
+    resource_lookup->images.init(&resource_arena, MAX_RESOURCES_PER_KIND);
+    resource_lookup->anims.init(&resource_arena, MAX_RESOURCES_PER_KIND);
+
+    // these only reserve address space, pages get committed as resources load
+    resource_lookup->text_storage = resource_arena.reserve_sub_arena(16 * ONE_MB);
+    resource_lookup->image_storage = resource_arena.reserve_sub_arena(128 * ONE_MB);
+    resource_lookup->frame_storage = resource_arena.reserve_sub_arena(ONE_MB);
+
+    // scratch for stb_image, one per decode thread. Pages only stay
+    // committed while a batch of images is decoding.
+    for (u32 t = 0; t < IMAGE_DECODE_MAX_THREADS; t++)
+    {
+        resource_lookup->image_decode_storage[t] = resource_arena.reserve_sub_arena(IMAGE_DECODE_SCRATCH_BYTES);
+        resource_lookup->image_decode_storage[t].keep_committed_bytes = 0;
+    }
+
+    resource_lookup->load_requests.init();
+    resource_lookup->load_results.init();
+    resource_lookup->n_loads_in_flight = 0;
+    resource_lookup->load_thread_started = false;
+    resource_lookup->async_storage = resource_arena.reserve_sub_arena(128 * ONE_MB);
+    resource_lookup->async_decode_storage = resource_arena.reserve_sub_arena(IMAGE_DECODE_SCRATCH_BYTES);
+    resource_lookup->async_decode_storage.keep_committed_bytes = 0;
+}
+
+// the registries keep the key pointer, so it's copied somewhere permanent
+static const char*
+copy_resource_key(const char* file_path)
+{
+    usize key_len = strlen(file_path) + 1;
+    char* key = reinterpret_cast<char*>(resource_lookup->text_storage.alloc_bytes(key_len));
+    memcpy(key, file_path, key_len);
+    return key;
 }
 
 TextResource
 load_text_resource(const char* file_path)
 {
-    // TODO: check if the friggin thing exists ya numpty
-    std::ifstream txt_file(file_path);
-    auto txt = slurp(txt_file);
-
-    TextResource* new_resource = resource_lookup->text_resources + resource_lookup->next_free_text_id;
-    new_resource->resource_id = resource_lookup->next_free_text_id;
-    resource_lookup->next_free_text_id += 1;
-
-    // TODO: I really need my own string lib at some point
-    // TODO: also this should move to the map
-    usize key_len = strlen(file_path) + 1;
-    char* text_resource_key = reinterpret_cast<char*>(resource_lookup->text_storage.alloc_bytes(key_len));
-    usize k;
-    for (k = 0; k < key_len; k++)
+    // it might already be here, or on its way from the resource thread
+    ResourceId existing = resource_lookup->texts.find(file_path);
+    if (existing != RESOURCE_ID_NONE)
     {
-        text_resource_key[k] = file_path[k];
+        if (resource_lookup->texts.get(existing)->state == ResourceState_Loading)
+        {
+            // it was requested async, but now it's needed
+            wait_for_resource_loads();
+        }
+        return *resource_lookup->texts.get(existing);
     }
-    text_resource_key[k] = '\0';
 
-    new_resource->length = txt.length() + 1; // null term'd!
-    char* text_resource = reinterpret_cast<char*>(resource_lookup->text_storage.alloc_bytes(new_resource->length));
-    usize i;
-    for (i = 0; i < new_resource->length; i++) {
-        text_resource[i] = txt[i];
+    // read straight into text_storage, which is where the text lives from
+    // now on. It comes back null terminated, so it can go to GL or get
+    // parsed in place as is.
+    usize length = 0;
+    const char* text = reinterpret_cast<const char*>(
+      slurp_into_mem(&resource_lookup->text_storage, file_path, &length));
+    if (!text)
+    {
+        std::cerr << "Couldn't read text resource '" << file_path << "'" << std::endl;
+        return TextResource { RESOURCE_ID_NONE, 0, "" };
     }
-    text_resource[i] = '\0';
-    new_resource->text = text_resource;
 
-    resource_lookup->text_resource_map.add(text_resource_key, new_resource->resource_id);
+    // TODO: I really need my own string lib at some point
+    ResourceId id = resource_lookup->texts.add(copy_resource_key(file_path));
+    TextResource* new_resource = resource_lookup->texts.get(id);
+    new_resource->resource_id = id;
+    new_resource->length = length;
+    new_resource->text = text;
+    new_resource->state = ResourceState_Ready;
 
     return *new_resource;
 }
@@ -73,64 +102,510 @@ load_text_resource(const char* file_path)
 TextResource
 get_text_resource(ResourceId id)
 {
-    assert(id < resource_lookup->next_free_text_id && "OOB text resource access");
-    return resource_lookup->text_resources[id];
+    return *resource_lookup->texts.get(id);
 }
 
 TextResource
 get_text_resource(const char* file_path)
 {
-    ResourceId* resource_id = resource_lookup->text_resource_map.get(file_path);
-    if (resource_id)
+    TextResource* resource = resource_lookup->texts.get(file_path);
+    if (resource)
     {
-        return resource_lookup->text_resources[*resource_id];
-
+        return *resource;
     }
     return TextResource { RESOURCE_ID_NONE, 0, "" };
 }
 
 
-ImageResource
-load_image_resource(const char* file_path, usize n_frames)
+// stb_image sends its allocations here (see vendor/stb_image/stb_image.c).
+// A decode worker points this at its scratch arena so a decode is a handful
+// of bumps that get thrown away in one go. Anywhere else, or if the arena
+// fills up, it's plain malloc.
+static thread_local mem::Arena* stbi_arena = nullptr;
+
+// stb's buffers are all 16-byte aligned so a realloc can grow the last one
+// in place
+constexpr static usize STBI_ARENA_ALIGN = 16;
+
+static b32
+stbi_arena_owns(void* p)
+{
+    auto bytes = reinterpret_cast<byte_ptr*>(p);
+    return stbi_arena
+        && bytes >= stbi_arena->mem_begin
+        && bytes < stbi_arena->mem_begin + stbi_arena->arena_bytes;
+}
+
+static b32
+stbi_arena_fits(usize size)
+{
+    usize start = mem::align_sz(stbi_arena->next_free_idx, STBI_ARENA_ALIGN);
+    return start + mem::align_sz(size, STBI_ARENA_ALIGN) < stbi_arena->arena_bytes;
+}
+
+extern "C" void*
+rigel_stbi_malloc(size_t size)
+{
+    if (stbi_arena && stbi_arena_fits(size))
+    {
+        return stbi_arena->alloc_bytes(size, STBI_ARENA_ALIGN);
+    }
+    return malloc(size);
+}
+
+extern "C" void*
+rigel_stbi_realloc_sized(void* p, size_t old_size, size_t new_size)
+{
+    if (!p)
+    {
+        return rigel_stbi_malloc(new_size);
+    }
+    if (!stbi_arena_owns(p))
+    {
+        return realloc(p, new_size);
+    }
+    if (new_size <= old_size)
+    {
+        return p;
+    }
+
+    // the inflate output doubles as it goes and is nearly always the last
+    // thing allocated, so most of the time this just moves the top up
+    usize old_end = mem::align_sz(old_size, STBI_ARENA_ALIGN);
+    usize grow_by = mem::align_sz(new_size, STBI_ARENA_ALIGN) - old_end;
+    auto top = stbi_arena->mem_begin + stbi_arena->next_free_idx;
+    if (reinterpret_cast<byte_ptr*>(p) + old_end == top && stbi_arena_fits(grow_by))
+    {
+        stbi_arena->alloc_bytes(grow_by, STBI_ARENA_ALIGN);
+        return p;
+    }
+
+    void* result = rigel_stbi_malloc(new_size);
+    if (result)
+    {
+        memcpy(result, p, old_size);
+    }
+    return result;
+}
+
+extern "C" void
+rigel_stbi_free(void* p)
+{
+    // arena memory goes back when the worker resets its arena
+    if (!stbi_arena_owns(p))
+    {
+        free(p);
+    }
+}
+
+struct ImageDecodeJob
 {
-    ImageResource* resource = resource_lookup->image_resources + resource_lookup->next_free_image_id;
-    resource->resource_id = resource_lookup->next_free_image_id;
-    resource_lookup->next_free_image_id += 1;
+    const char* file_path;
+    MappedFile source;
+    u64 source_hash;
+    ImageResource* resource;
+    b32 ok;
+};
 
+struct ImageDecodeQueue
+{
+    ImageDecodeJob* jobs;
+    u32 n_jobs;
+    std::atomic<u32> next_job;
+};
+
+// Decodes the job's (mapped) png into the block its resource already has.
+static void
+decode_image(ImageDecodeJob* job, mem::Arena* scratch_arena)
+{
+    stbi_arena = scratch_arena;
+    auto checkpoint = scratch_arena->checkpoint();
+
+    // always 4 channels, whatever's in the file
     int w, h, c;
-    // TODO: This allocs! need to write an adapter or something like that
-    auto data = stbi_load(file_path,
-                               &w,
-                               &h,
-                               &c,
-                               4);
-    assert(data != nullptr && "Could not load an image"); // TODO: this isn't a show-stopper
-
-    i32 n_bytes = w * h * c;
-    std::cout << "Loading image of size " << n_bytes << std::endl;
-
-    // TODO: see above.
-    resource->data = resource_lookup->image_storage.alloc_bytes(n_bytes);
-    for (i32 i = 0; i < n_bytes; i++) {
-        resource->data[i] = data[i];
-    }
-    resource->width = w;
-    resource->height = h;
-    resource->channels = c;
+    ubyte* pixels = stbi_load_from_memory(job->source.data, job->source.size, &w, &h, &c, 4);
+    job->ok = pixels
+        && (usize)w == job->resource->width
+        && (usize)h == job->resource->height;
+    if (job->ok)
+    {
+        memcpy(job->resource->data, pixels, (usize)w * h * 4);
+        asset_cache_store_image(job->source_hash, w, h, pixels);
+    }
+    stbi_image_free(pixels);
+
+    scratch_arena->restore(checkpoint);
+    stbi_arena = nullptr;
+}
+
+// Pulls jobs off the queue until it's empty. Runs on the decode workers and
+// on the thread that started them.
+static void
+decode_images(ImageDecodeQueue* queue, mem::Arena* scratch_arena)
+{
+    for (;;)
+    {
+        u32 job_idx = queue->next_job.fetch_add(1, std::memory_order_relaxed);
+        if (job_idx >= queue->n_jobs)
+        {
+            break;
+        }
+        decode_image(queue->jobs + job_idx, scratch_arena);
+    }
+}
+
+// data is null for an image that's still loading
+static ImageResource*
+add_image_resource(const char* file_path, usize n_frames, u32 width, u32 height, ubyte* data,
+                   const char** out_key = nullptr)
+{
+    const char* resource_key = copy_resource_key(file_path);
+    ResourceId id = resource_lookup->images.add(resource_key);
+    ImageResource* resource = resource_lookup->images.get(id);
+    resource->resource_id = id;
+
+    if (data)
+    {
+        std::cout << "Loading image of size " << (usize)width * height * 4 << std::endl;
+    }
+
+    resource->data = data;
+    resource->width = width;
+    resource->height = height;
+    resource->channels = 4;
     resource->n_frames = n_frames;
+    resource->state = data ? ResourceState_Ready : ResourceState_Loading;
 
-    usize key_len = strlen(file_path) + 1;
-    char* resource_key = reinterpret_cast<char*>(resource_lookup->text_storage.alloc_bytes(key_len));
-    usize k;
-    for (k = 0; k < key_len; k++)
+    if (out_key)
+    {
+        *out_key = resource_key;
+    }
+
+    return resource;
+}
+
+void
+load_image_resources(const ImageLoadRequest* requests, usize n_requests)
+{
+    // everything that touches the resource tables happens here, the workers
+    // only write pixels into blocks that are already theirs. The jobs go at
+    // the bottom of the first decoder's scratch, under anything stb_image
+    // allocates, and go away with it.
+    mem::Arena* decode_arenas = resource_lookup->image_decode_storage;
+    ImageDecodeJob* jobs = decode_arenas[0].alloc_array<ImageDecodeJob>(n_requests);
+    u32 n_jobs = 0;
+    b32 any_loading_async = false;
+    for (usize i = 0; i < n_requests; i++)
+    {
+        const char* file_path = requests[i].file_path;
+        ImageResource existing = get_image_resource(file_path);
+        if (existing.resource_id != RESOURCE_ID_NONE)
+        {
+            any_loading_async |= existing.state == ResourceState_Loading;
+            continue;
+        }
+
+        ImageDecodeJob* job = jobs + n_jobs;
+        job->file_path = file_path;
+        job->ok = false;
+        b32 found = map_file(file_path, &job->source);
+        assert(found && "Could not load an image"); // TODO: this isn't a show-stopper
+        (void)found;
+
+        // decoded on an earlier run and the png hasn't changed since
+        job->source_hash = asset_cache_hash(job->source.data, job->source.size);
+        CachedImage cached;
+        if (asset_cache_map_image(job->source_hash, &cached))
+        {
+            add_image_resource(file_path, requests[i].n_frames, cached.width, cached.height, cached.pixels);
+            unmap_file(&job->source);
+            continue;
+        }
+
+        // otherwise size the block it decodes into from the header
+        int w, h, c;
+        found = stbi_info_from_memory(job->source.data, job->source.size, &w, &h, &c);
+        assert(found && "Could not load an image");
+
+        ubyte* data = resource_lookup->image_storage.alloc_bytes((usize)w * h * 4, STBI_ARENA_ALIGN);
+        job->resource = add_image_resource(file_path, requests[i].n_frames, w, h, data);
+        n_jobs++;
+    }
+
+    u32 n_threads = std::thread::hardware_concurrency();
+    n_threads = n_threads < IMAGE_DECODE_MAX_THREADS ? n_threads : IMAGE_DECODE_MAX_THREADS;
+    n_threads = n_threads < n_jobs ? n_threads : n_jobs;
+    n_threads = n_threads > 0 ? n_threads : 1;
+
+    ImageDecodeQueue queue;
+    queue.jobs = jobs;
+    queue.n_jobs = n_jobs;
+    queue.next_job = 0;
+
+    std::thread workers[IMAGE_DECODE_MAX_THREADS];
+    for (u32 t = 1; t < n_threads; t++)
+    {
+        workers[t] = std::thread(decode_images, &queue, decode_arenas + t);
+    }
+    decode_images(&queue, decode_arenas);
+    for (u32 t = 1; t < n_threads; t++)
     {
-        resource_key[k] = file_path[k];
+        workers[t].join();
     }
-    resource_key[k] = '\0';
 
-    resource_lookup->image_resource_map.add(resource_key, resource->resource_id);
+    for (u32 j = 0; j < n_jobs; j++)
+    {
+        assert(jobs[j].ok && "Could not load an image"); // TODO: this isn't a show-stopper
+        unmap_file(&jobs[j].source);
+    }
+    for (u32 t = 0; t < n_threads; t++)
+    {
+        decode_arenas[t].reinit();
+    }
 
-    return *resource;
+    // everything asked for has to be there when this returns
+    if (any_loading_async)
+    {
+        wait_for_resource_loads();
+    }
+}
+
+ImageResource
+load_image_resource(const char* file_path, usize n_frames)
+{
+    ImageLoadRequest request { file_path, n_frames };
+    load_image_resources(&request, 1);
+    return get_image_resource(file_path);
+}
+
+static void
+fill_anim_resource(mem::Arena* scratch_arena, mem::Arena* storage, const char* text, usize length, AnimationResource* resource);
+
+// The resource thread. Does the file reads and decodes for async requests
+// into memory only it allocates from, and hands the results back.
+static void
+resource_load_thread()
+{
+    auto requests = &resource_lookup->load_requests;
+    auto results = &resource_lookup->load_results;
+
+    for (;;)
+    {
+        requests->wait_for_items();
+
+        ResourceLoadRequest request;
+        while (requests->pop(&request))
+        {
+            ResourceLoadResult result = {};
+            result.kind = request.kind;
+            result.id = request.id;
+
+            if (request.kind == ResourceLoadKind_Text)
+            {
+                usize length = 0;
+                result.data = slurp_into_mem(&resource_lookup->async_storage, request.file_path, &length);
+                result.length = length;
+                result.ok = result.data != nullptr;
+            }
+            else if (request.kind == ResourceLoadKind_Anim)
+            {
+                // the text's only needed while parsing
+                mem::Arena* scratch = &resource_lookup->async_decode_storage;
+                usize length = 0;
+                const char* text = reinterpret_cast<const char*>(slurp_into_mem(scratch, request.file_path, &length));
+                if (text)
+                {
+                    result.anim = resource_lookup->async_storage.alloc_simple<AnimationResource>();
+                    memset(result.anim, 0, sizeof(AnimationResource));
+                    fill_anim_resource(scratch, &resource_lookup->async_storage, text, length, result.anim);
+                    result.ok = true;
+                }
+                scratch->reinit();
+            }
+            else
+            {
+                ImageDecodeJob job = {};
+                job.file_path = request.file_path;
+                if (map_file(request.file_path, &job.source))
+                {
+                    job.source_hash = asset_cache_hash(job.source.data, job.source.size);
+
+                    CachedImage cached;
+                    int w, h, c;
+                    if (asset_cache_map_image(job.source_hash, &cached))
+                    {
+                        result.data = cached.pixels;
+                        result.width = cached.width;
+                        result.height = cached.height;
+                        result.ok = true;
+                    }
+                    else if (stbi_info_from_memory(job.source.data, job.source.size, &w, &h, &c))
+                    {
+                        // decode_image writes into a resource, so give it a
+                        // stand-in until the real one is published
+                        ImageResource decoded = {};
+                        decoded.width = w;
+                        decoded.height = h;
+                        decoded.data = resource_lookup->async_storage.alloc_bytes((usize)w * h * 4, STBI_ARENA_ALIGN);
+                        job.resource = &decoded;
+                        decode_image(&job, &resource_lookup->async_decode_storage);
+                        resource_lookup->async_decode_storage.reinit();
+
+                        result.data = decoded.data;
+                        result.width = w;
+                        result.height = h;
+                        result.ok = job.ok;
+                    }
+                    unmap_file(&job.source);
+                }
+            }
+
+            // never full: there are never more loads in flight than it holds
+            b32 pushed = results->push(result);
+            assert(pushed && "resource load results overflowed");
+            (void)pushed;
+        }
+    }
+}
+
+static void
+push_load_request(ResourceLoadKind kind, ResourceId id, const char* file_path)
+{
+    if (!resource_lookup->load_thread_started)
+    {
+        // lives as long as the process does, it's asleep when there's
+        // nothing to load
+        std::thread(resource_load_thread).detach();
+        resource_lookup->load_thread_started = true;
+    }
+
+    // if everything's in flight, make room by taking some results back
+    while (resource_lookup->n_loads_in_flight == RESOURCE_LOAD_QUEUE_SIZE)
+    {
+        resource_lookup->load_results.wait_for_items();
+        poll_resource_loads();
+    }
+
+    ResourceLoadRequest request = { kind, id, file_path };
+    b32 pushed = resource_lookup->load_requests.push(request);
+    assert(pushed && "resource load requests overflowed");
+    (void)pushed;
+    resource_lookup->n_loads_in_flight++;
+}
+
+ResourceId
+request_text_resource(const char* file_path)
+{
+    ResourceId existing = resource_lookup->texts.find(file_path);
+    if (existing != RESOURCE_ID_NONE)
+    {
+        return existing;
+    }
+
+    const char* key = copy_resource_key(file_path);
+    ResourceId id = resource_lookup->texts.add(key);
+    TextResource* resource = resource_lookup->texts.get(id);
+    resource->resource_id = id;
+    resource->length = 0;
+    resource->text = "";
+    resource->state = ResourceState_Loading;
+
+    // the key stays put, so the resource thread can read the path from it
+    push_load_request(ResourceLoadKind_Text, resource->resource_id, key);
+    return resource->resource_id;
+}
+
+ResourceId
+request_image_resource(const char* file_path, usize n_frames)
+{
+    ResourceId existing = resource_lookup->images.find(file_path);
+    if (existing != RESOURCE_ID_NONE)
+    {
+        return existing;
+    }
+
+    // the key stays put, so the resource thread can read the path from it
+    const char* key;
+    ImageResource* resource = add_image_resource(file_path, n_frames, 0, 0, nullptr, &key);
+    push_load_request(ResourceLoadKind_Image, resource->resource_id, key);
+    return resource->resource_id;
+}
+
+ResourceId
+request_anim_resource(const char* file_path)
+{
+    ResourceId existing = resource_lookup->anims.find(file_path);
+    if (existing != RESOURCE_ID_NONE)
+    {
+        return existing;
+    }
+
+    const char* key = copy_resource_key(file_path);
+    ResourceId id = resource_lookup->anims.add(key);
+    AnimationResource* resource = resource_lookup->anims.get(id);
+    resource->id = id;
+    resource->state = ResourceState_Loading;
+
+    // the key stays put, so the resource thread can read the path from it
+    push_load_request(ResourceLoadKind_Anim, id, key);
+    return id;
+}
+
+u32
+poll_resource_loads()
+{
+    u32 n_published = 0;
+
+    ResourceLoadResult result;
+    while (resource_lookup->load_results.pop(&result))
+    {
+        n_published++;
+        resource_lookup->n_loads_in_flight--;
+
+        if (result.kind == ResourceLoadKind_Text)
+        {
+            TextResource* resource = resource_lookup->texts.get(result.id);
+            if (result.ok)
+            {
+                resource->text = reinterpret_cast<const char*>(result.data);
+                resource->length = result.length;
+            }
+            resource->state = result.ok ? ResourceState_Ready : ResourceState_Failed;
+        }
+        else if (result.kind == ResourceLoadKind_Anim)
+        {
+            AnimationResource* resource = resource_lookup->anims.get(result.id);
+            if (result.ok)
+            {
+                *resource = *result.anim;
+                resource->id = result.id;
+            }
+            resource->state = result.ok ? ResourceState_Ready : ResourceState_Failed;
+        }
+        else
+        {
+            ImageResource* resource = resource_lookup->images.get(result.id);
+            if (result.ok)
+            {
+                resource->data = result.data;
+                resource->width = result.width;
+                resource->height = result.height;
+            }
+            resource->state = result.ok ? ResourceState_Ready : ResourceState_Failed;
+        }
+    }
+
+    return n_published;
+}
+
+void
+wait_for_resource_loads()
+{
+    while (resource_lookup->n_loads_in_flight > 0)
+    {
+        resource_lookup->load_results.wait_for_items();
+        poll_resource_loads();
+    }
 }
 
 ImageResource
@@ -140,135 +615,638 @@ get_or_load_image_resource(const char* file_path, usize n_frames)
     if (check.resource_id == RESOURCE_ID_NONE) {
         return load_image_resource(file_path, n_frames);
     }
+    if (check.state == ResourceState_Loading) {
+        // it was requested async, but now it's needed
+        wait_for_resource_loads();
+        return get_image_resource(check.resource_id);
+    }
     return check;
 }
 
 ImageResource
 get_image_resource(ResourceId id)
 {
-    assert(id < resource_lookup->next_free_image_id && "OOB image resource access");
-    return resource_lookup->image_resources[id];
+    return *resource_lookup->images.get(id);
 }
 
 ImageResource
 get_image_resource(const char* key)
 {
-    ResourceId* id = resource_lookup->image_resource_map.get(key);
-    if (id)
+    ImageResource* resource = resource_lookup->images.get(key);
+    if (resource)
     {
-        return resource_lookup->image_resources[*id];
+        return *resource;
     }
     ImageResource dummy = {0};
     dummy.resource_id = RESOURCE_ID_NONE;
     return dummy;
 }
 
+static void
+read_anim_frame(JsonReader* reader, Frame* new_frame)
+{
+    m::Vec2 size { 0, 0 };
+    new_frame->spritesheet_min = m::Vec2 { 0, 0 };
+    new_frame->duration_ms = 0;
+
+    JsonString key;
+    json_read_object_begin(reader);
+    while (json_next_key(reader, &key))
+    {
+        if (json_str_equals(key, "frame", 5))
+        {
+            json_read_object_begin(reader);
+            while (json_next_key(reader, &key))
+            {
+                if (json_str_equals(key, "x", 1))
+                {
+                    new_frame->spritesheet_min.x = json_read_number(reader);
+                }
+                else if (json_str_equals(key, "y", 1))
+                {
+                    new_frame->spritesheet_min.y = json_read_number(reader);
+                }
+                else if (json_str_equals(key, "w", 1))
+                {
+                    size.x = json_read_number(reader);
+                }
+                else if (json_str_equals(key, "h", 1))
+                {
+                    size.y = json_read_number(reader);
+                }
+                else
+                {
+                    json_skip_value(reader);
+                }
+            }
+        }
+        else if (json_str_equals(key, "duration", 8))
+        {
+            new_frame->duration_ms = json_read_number(reader);
+        }
+        else
+        {
+            json_skip_value(reader);
+        }
+    }
+
+    new_frame->spritesheet_max.x = new_frame->spritesheet_min.x + size.x;
+    new_frame->spritesheet_max.y = new_frame->spritesheet_min.y + size.y;
+}
+
+static void
+read_anim_tag(JsonReader* reader, mem::Arena* storage, AnimationResource* resource)
+{
+    Animation animation;
+    JsonString name = {};
+    f32 from = 0;
+    f32 to = 0;
+
+    JsonString key;
+    json_read_object_begin(reader);
+    while (json_next_key(reader, &key))
+    {
+        if (json_str_equals(key, "name", 4))
+        {
+            name = json_read_string(reader);
+        }
+        else if (json_str_equals(key, "from", 4))
+        {
+            from = json_read_number(reader);
+        }
+        else if (json_str_equals(key, "to", 2))
+        {
+            to = json_read_number(reader);
+        }
+        else
+        {
+            json_skip_value(reader);
+        }
+    }
+
+    usize name_len = name.end - name.start;
+    char* resource_key = reinterpret_cast<char*>(
+        storage->alloc_bytes(name_len + 1));
+
+    json_str_copy(animation.name, &name, 32);
+    json_str_copy(resource_key, &name);
+
+    animation.start_frame = from;
+    animation.end_frame = to + 1; // store half-open
+
+    resource->animations.add(resource_key, animation);
+}
+
+// frames and tag names get copied into storage as they're read. The frames
+// all come out of one json array, so they end up next to each other.
+static void
+parse_anim_info(mem::Arena* scratch_arena, mem::Arena* storage, const char* text, usize length, AnimationResource* resource)
+{
+    JsonReader reader;
+    json_reader_init(&reader, scratch_arena, text, length);
+    json_read_object_begin(&reader);
+
+    JsonString key;
+    while (json_next_key(&reader, &key))
+    {
+        if (json_str_equals(key, "frames", 6))
+        {
+            json_read_array_begin(&reader);
+            while (json_next_element(&reader))
+            {
+                auto new_frame = storage->alloc_simple<Frame>();
+                if (!resource->frames)
+                {
+                    resource->frames = new_frame;
+                }
+                resource->n_frames++;
+                read_anim_frame(&reader, new_frame);
+            }
+        }
+        else if (json_str_equals(key, "meta", 4))
+        {
+            json_read_object_begin(&reader);
+            while (json_next_key(&reader, &key))
+            {
+                if (!json_str_equals(key, "frameTags", 9))
+                {
+                    json_skip_value(&reader);
+                    continue;
+                }
+
+                json_read_array_begin(&reader);
+                while (json_next_element(&reader))
+                {
+                    read_anim_tag(&reader, storage, resource);
+                }
+            }
+        }
+        else
+        {
+            json_skip_value(&reader);
+        }
+    }
+    assert(!reader.error && "couldn't parse animation info");
+}
+
 // TODO: This isn't really an animation resource anymore, it's a collection
 // of animations in a single sprite sheet.
+// From the asset cache if it's there, otherwise parsed and added to it
+static void
+fill_anim_resource(mem::Arena* scratch_arena, mem::Arena* storage, const char* text, usize length, AnimationResource* resource)
+{
+    u64 source_hash = asset_cache_hash(text, length);
+    if (!asset_cache_map_anim(source_hash, resource))
+    {
+        parse_anim_info(scratch_arena, storage, text, length, resource);
+        asset_cache_store_anim(scratch_arena, source_hash, resource);
+    }
+}
+
 AnimationResource* load_anim_resource(mem::Arena* scratch_arena, const char* file_path)
 {
-    assert(resource_lookup->next_free_anim_id < MAX_ANIM_RESOURCES && "Tried to alloc too many animations");
+    // the text is only needed to hash or parse, so it goes in scratch rather
+    // than being kept as a text resource
+    usize length = 0;
+    const char* text = reinterpret_cast<const char*>(slurp_into_mem(scratch_arena, file_path, &length));
+    assert(text && "couldn't read animation info");
+
+    ResourceId id = resource_lookup->anims.add(copy_resource_key(file_path));
+    AnimationResource* resource = resource_lookup->anims.get(id);
+    resource->id = id;
+    fill_anim_resource(scratch_arena, &resource_lookup->frame_storage, text, length, resource);
+    resource->state = ResourceState_Ready;
+
+    return resource;
+}
+
+AnimationResource* get_or_load_anim_resource(mem::Arena* scratch_arena, const char* file_path)
+{
+    AnimationResource* check = get_anim_resource(file_path);
+    if (check)
+    {
+        if (check->state == ResourceState_Loading)
+        {
+            // it was requested async, but now it's needed
+            wait_for_resource_loads();
+        }
+        return check;
+    }
+    return load_anim_resource(scratch_arena, file_path);
+}
+
+AnimationResource* get_anim_resource(ResourceId id)
+{
+    return resource_lookup->anims.get(id);
+}
+
+AnimationResource* get_anim_resource(const char* key)
+{
+    return resource_lookup->anims.get(key);
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+namespace rigel {
+
+TEST_CASE("resource registries grow and only match whole keys")
+{
+    static ubyte backing[256 * ONE_KB];
+    mem::Arena arena(backing, sizeof(backing));
 
-    TextResource info = load_text_resource(file_path);
-    auto root_v = parse_json_string(scratch_arena, info.text);
-    AnimationResource* resource = resource_lookup->anim_resources + resource_lookup->next_free_anim_id;
+    ResourceRegistry<TextResource> registry;
+    registry.init(&arena, 1000);
+    CHECK(registry.find("anything") == RESOURCE_ID_NONE);
 
-    resource->id = resource_lookup->next_free_anim_id;
-    resource_lookup->next_free_anim_id++;
+    ResourceId shader = registry.add("shader.vert");
+    ResourceId prefix = registry.add("shader");
+    CHECK(registry.find("shader.vert") == shader);
+    CHECK(registry.find("shader") == prefix);
+    CHECK(registry.find("shader.ver") == RESOURCE_ID_NONE);
+    CHECK(registry.find("shader.vert.bak") == RESOURCE_ID_NONE);
 
-    auto root = root_v->object;
+    registry.get(shader)->length = 42;
+    TextResource* first = registry.get(shader);
 
-    auto frames = jsonobj_get(root, "frames", 6);
-    auto head_frame = frames->obj_array;
-    u32 count = 0;
-    while (head_frame)
+    // well past the first index, and a few rehashes
+    static char keys[900][16];
+    for (u32 i = 0; i < 900; i++)
     {
-        count++;
-        head_frame = head_frame->next;
+        snprintf(keys[i], sizeof(keys[i]), "level_%u.tmj", i);
+        CHECK(registry.add(keys[i]) == (ResourceId)i + 2);
     }
-    auto frame_store = resource_lookup->frame_storage.alloc_array<Frame>(count);
-    resource->frames = frame_store;
-    resource->n_frames = count;
+    CHECK(registry.count == 902);
+    CHECK(registry.n_index_slots >= 902 * 4 / 3);
+
+    b32 all_found = true;
+    for (u32 i = 0; i < 900; i++)
+    {
+        all_found &= registry.find(keys[i]) == (ResourceId)i + 2;
+    }
+    CHECK(all_found);
+
+    // resources don't move when the registry grows
+    CHECK(registry.get(shader) == first);
+    CHECK(registry.get("shader.vert")->length == 42);
+    CHECK(registry.get(prefix)->length == 0);
+}
 
-    u32 frame_i = 0;
-    for (head_frame = frames->obj_array;
-        head_frame;
-        head_frame = head_frame->next)
+TEST_CASE("string keyed maps only match whole keys")
+{
+    StringKeyedMap<i32, 8> map = {};
+    map.add("run", 1);
+    map.add("run_fast", 2);
+    map.add("run", 3);
+
+    CHECK(map.count == 2);
+    REQUIRE(map.get("run"));
+    CHECK(*map.get("run") == 3);
+    REQUIRE(map.get("run_fast"));
+    CHECK(*map.get("run_fast") == 2);
+    CHECK_FALSE(map.get("ru"));
+    CHECK_FALSE(map.get("run_"));
+}
+
+TEST_CASE("spsc queues stay in order as they wrap")
+{
+    static SpscQueue<u32, 8> queue;
+    queue.init();
+
+    u32 next_in = 0;
+    u32 next_out = 0;
+    for (u32 round = 0; round < 5; round++)
     {
-        auto obj = head_frame->obj;
-        auto new_frame = frame_store + frame_i;
+        while (queue.push(next_in))
+        {
+            next_in++;
+        }
+        CHECK(next_in - next_out == 8);
+
+        // drain part way so the next round wraps around the end
+        u32 item;
+        for (u32 i = 0; i < 5; i++)
+        {
+            REQUIRE(queue.pop(&item));
+            CHECK(item == next_out++);
+        }
+    }
 
-        auto frame_obj = jsonobj_get(obj, "frame", 5)->object;
-        new_frame->spritesheet_min.x = jsonobj_get(frame_obj, "x", 1)->number->value;
-        new_frame->spritesheet_min.y = jsonobj_get(frame_obj, "y", 1)->number->value;
-        new_frame->spritesheet_max.x = new_frame->spritesheet_min.x + jsonobj_get(frame_obj, "w", 1)->number->value;
-        new_frame->spritesheet_max.y = new_frame->spritesheet_min.y + jsonobj_get(frame_obj, "h", 1)->number->value;
-        
-        new_frame->duration_ms = jsonobj_get(obj, "duration", 8)->number->value;
-        frame_i++;
+    u32 item;
+    while (queue.pop(&item))
+    {
+        CHECK(item == next_out++);
     }
+    CHECK(next_out == next_in);
+    CHECK_FALSE(queue.pop(&item));
+}
+
+TEST_CASE("async loads come back through the resource thread")
+{
+    mem::Arena arena = mem::make_reserved_arena(ONE_GB, 0);
+    resource_initialize(arena);
 
-    auto meta_obj = jsonobj_get(root, "meta", 4)->object;
-    auto animations = jsonobj_get(meta_obj, "frameTags", 9);
+    const char* path = "/tmp/rigel_async_text_test.txt";
+    const char* contents = "loaded off the main thread";
+    REQUIRE(dump_to_file(path, contents, strlen(contents)));
 
-    auto head = animations->obj_array;
-    while (head)
+    ResourceId id = request_text_resource(path);
+    CHECK(request_text_resource(path) == id);
+    ResourceId missing = request_text_resource("/tmp/rigel_async_no_such_file");
+
+    // more than fit in the queues at once
+    char missing_path[64];
+    for (u32 i = 0; i < RESOURCE_LOAD_QUEUE_SIZE + 8; i++)
     {
-        Animation animation;
+        snprintf(missing_path, sizeof(missing_path), "/tmp/rigel_async_missing_%u", i);
+        request_text_resource(missing_path);
+    }
 
-        auto name = jsonobj_get(head->obj, "name", 4);
-        char* resource_key = reinterpret_cast<char*>(
-            resource_lookup->text_storage.alloc_bytes(name->string->end - name->string->start));
+    wait_for_resource_loads();
+    CHECK(poll_resource_loads() == 0);
 
-        json_str_copy(animation.name, name->string, 32);
-        json_str_copy(resource_key, name->string);
+    TextResource text = get_text_resource(id);
+    CHECK(text.state == ResourceState_Ready);
+    CHECK(text.length == strlen(contents));
+    CHECK(strcmp(text.text, contents) == 0);
+    CHECK(get_text_resource(missing).state == ResourceState_Failed);
+    CHECK(get_text_resource(missing_path).state == ResourceState_Failed);
 
-        animation.start_frame = jsonobj_get(head->obj, "from", 4)->number->value;
-        animation.end_frame = jsonobj_get(head->obj, "to", 2)->number->value + 1; // store half-open
+    // a blocking load of something already requested waits for it instead
+    // of loading it again
+    const char* waited_path = "/tmp/rigel_async_text_test_waited.txt";
+    REQUIRE(dump_to_file(waited_path, contents, strlen(contents)));
+    ResourceId waited_id = request_text_resource(waited_path);
+    TextResource waited = load_text_resource(waited_path);
+    CHECK(waited.resource_id == waited_id);
+    CHECK(waited.state == ResourceState_Ready);
+    CHECK(strcmp(waited.text, contents) == 0);
+    CHECK(load_text_resource(waited_path).resource_id == waited_id);
+
+    // animations get parsed over there too
+    const char* anim_path = "/tmp/rigel_async_anim_test.json";
+    const char* anim_json =
+        "{\"frames\": [{\"frame\": {\"x\": 0, \"y\": 0, \"w\": 16, \"h\": 16}, \"duration\": 100},"
+        " {\"frame\": {\"x\": 16, \"y\": 0, \"w\": 16, \"h\": 16}, \"duration\": 150}],"
+        " \"meta\": {\"frameTags\": [{\"name\": \"idle\", \"from\": 0, \"to\": 0},"
+        " {\"name\": \"run\", \"from\": 0, \"to\": 1}]}}";
+    REQUIRE(dump_to_file(anim_path, anim_json, strlen(anim_json)));
+
+    ResourceId anim_id = request_anim_resource(anim_path);
+    CHECK(request_anim_resource(anim_path) == anim_id);
+    CHECK(get_anim_resource(anim_id)->state == ResourceState_Loading);
+    ResourceId missing_anim = request_anim_resource("/tmp/rigel_async_no_such_anim.json");
+
+    // a blocking load waits for it too
+    AnimationResource* anim = get_or_load_anim_resource(&arena, anim_path);
+    CHECK(anim == get_anim_resource(anim_id));
+    REQUIRE(anim->state == ResourceState_Ready);
+    CHECK(anim->id == anim_id);
+    REQUIRE(anim->n_frames == 2);
+    CHECK(anim->frames[1].spritesheet_min.x == 16);
+    CHECK(anim->frames[1].duration_ms == 150);
+    REQUIRE(anim->animations.get("run"));
+    CHECK(anim->animations.get("run")->start_frame == 0);
+    CHECK(anim->animations.get("run")->end_frame == 2);
+    REQUIRE(anim->animations.get("idle"));
+    CHECK(anim->animations.get("idle")->end_frame == 1);
+    CHECK(get_anim_resource(missing_anim)->state == ResourceState_Failed);
+}
 
-        resource->animations.add(resource_key, animation);
+// Big endian, the way png wants its numbers
+static ubyte*
+put_test_png_u32(ubyte* out, u32 value)
+{
+    out[0] = (ubyte)(value >> 24);
+    out[1] = (ubyte)(value >> 16);
+    out[2] = (ubyte)(value >> 8);
+    out[3] = (ubyte)value;
+    return out + 4;
+}
 
-        head = head->next;
+static u32
+test_png_crc(const ubyte* bytes, usize n_bytes)
+{
+    u32 crc = 0xFFFFFFFF;
+    for (usize i = 0; i < n_bytes; i++)
+    {
+        crc ^= bytes[i];
+        for (u32 bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
     }
+    return ~crc;
+}
 
+// Writes RGBA pixels out as a png with stored (uncompressed) deflate blocks.
+// Enough for stb_image to have to really decode something, without needing
+// an encoder. The data's split over 8KB IDAT chunks like most encoders do,
+// which makes stb_image grow its buffer as it reads them.
+// (maybe_unused since the tests are compiled out of the game)
+[[maybe_unused]] static b32
+write_test_png(mem::Arena* arena, const char* path, const ubyte* pixels, u32 width, u32 height)
+{
+    usize row_bytes = (usize)width * 4 + 1;
+    usize raw_bytes = row_bytes * height;
+    usize n_blocks = (raw_bytes + 0xFFFF - 1) / 0xFFFF;
+    usize zlib_bytes = 2 + n_blocks * 5 + raw_bytes + 4;
+    const usize idat_chunk_bytes = 8 * ONE_KB;
+    usize n_idat_chunks = (zlib_bytes + idat_chunk_bytes - 1) / idat_chunk_bytes;
 
-    usize key_len = strlen(file_path) + 1;
-    char* resource_key = reinterpret_cast<char*>(resource_lookup->text_storage.alloc_bytes(key_len));
-    usize k;
-    for (k = 0; k < key_len; k++)
+    auto checkpoint = arena->checkpoint();
+    ubyte* raw = arena->alloc_array<ubyte>(raw_bytes);
+    for (u32 y = 0; y < height; y++)
     {
-        resource_key[k] = file_path[k];
+        raw[y * row_bytes] = 0; // no filter
+        memcpy(raw + y * row_bytes + 1, pixels + (usize)y * width * 4, (usize)width * 4);
     }
-    resource_key[k] = '\0';
-    resource_lookup->anim_resource_map.add(resource_key, resource->id);
 
-    return resource;
+    ubyte* zlib = arena->alloc_array<ubyte>(zlib_bytes);
+    ubyte* out = zlib;
+    *out++ = 0x78;
+    *out++ = 0x01;
+    u32 adler_a = 1;
+    u32 adler_b = 0;
+    for (usize done = 0; done < raw_bytes;)
+    {
+        u16 block_bytes = (u16)(raw_bytes - done < 0xFFFF ? raw_bytes - done : 0xFFFF);
+        *out++ = done + block_bytes == raw_bytes ? 1 : 0;
+        *out++ = (ubyte)block_bytes;
+        *out++ = (ubyte)(block_bytes >> 8);
+        *out++ = (ubyte)~block_bytes;
+        *out++ = (ubyte)(~block_bytes >> 8);
+        memcpy(out, raw + done, block_bytes);
+        for (u32 i = 0; i < block_bytes; i++)
+        {
+            adler_a = (adler_a + out[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+        out += block_bytes;
+        done += block_bytes;
+    }
+    put_test_png_u32(out, (adler_b << 16) | adler_a);
+
+    ubyte* png = arena->alloc_array<ubyte>(8 + 25 + n_idat_chunks * 12 + zlib_bytes + 12);
+    out = png;
+    const ubyte signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    memcpy(out, signature, 8);
+    out += 8;
+
+    ubyte* chunk = out;
+    out = put_test_png_u32(out, 13);
+    memcpy(out, "IHDR", 4);
+    out += 4;
+    out = put_test_png_u32(out, width);
+    out = put_test_png_u32(out, height);
+    const ubyte ihdr_rest[5] = { 8, 6, 0, 0, 0 }; // 8 bit RGBA
+    memcpy(out, ihdr_rest, 5);
+    out += 5;
+    out = put_test_png_u32(out, test_png_crc(chunk + 4, out - chunk - 4));
+
+    for (usize done = 0; done < zlib_bytes; done += idat_chunk_bytes)
+    {
+        usize chunk_bytes = zlib_bytes - done < idat_chunk_bytes ? zlib_bytes - done : idat_chunk_bytes;
+        chunk = out;
+        out = put_test_png_u32(out, chunk_bytes);
+        memcpy(out, "IDAT", 4);
+        out += 4;
+        memcpy(out, zlib + done, chunk_bytes);
+        out += chunk_bytes;
+        out = put_test_png_u32(out, test_png_crc(chunk + 4, out - chunk - 4));
+    }
+
+    chunk = out;
+    out = put_test_png_u32(out, 0);
+    memcpy(out, "IEND", 4);
+    out += 4;
+    out = put_test_png_u32(out, test_png_crc(chunk + 4, 4));
+
+    b32 ok = dump_to_file(path, png, out - png);
+    arena->restore(checkpoint);
+    return ok;
 }
 
-AnimationResource* get_or_load_anim_resource(mem::Arena* scratch_arena, const char* file_path)
+// so what's decoded in a test isn't a hit from an earlier run
+[[maybe_unused]] static void
+use_empty_asset_cache(const char* dir)
 {
-    AnimationResource* check = get_anim_resource(file_path);
-    if (check)
+    asset_cache_set_dir(dir);
+    fs::Directory d = fs::open_dir(dir);
+    if (!d.d)
     {
-        return check;
+        return;
     }
-    return load_anim_resource(scratch_arena, file_path);
+
+    char path[512];
+    fs::for_each_file(d, [&](const char* name)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        unlink(path);
+    });
+    closedir(d.d);
 }
 
-AnimationResource* get_anim_resource(ResourceId id)
+TEST_CASE("images too big to copy into decode scratch still decode and get cached")
 {
-    assert(id < resource_lookup->next_free_anim_id && "Tried to load oob animation");
-    return resource_lookup->anim_resources + id;
+    mem::Arena arena = mem::make_reserved_arena(ONE_GB, 0);
+    resource_initialize(arena);
+    use_empty_asset_cache("/tmp/rigel_resource_png_test");
+
+    // 16MB of pixels, half the decode scratch. The zlib stream has to sit
+    // in there alongside them, so there's no room for another copy.
+    u32 width = 2048;
+    u32 height = 2048;
+    static_assert(2048 * 2048 * 4 > IMAGE_DECODE_SCRATCH_BYTES / 3);
+    mem::Arena test_arena = mem::make_reserved_arena(ONE_GB, 0);
+    ubyte* pixels = test_arena.alloc_array<ubyte>(width * height * 4);
+    for (u32 i = 0; i < width * height * 4; i++)
+    {
+        pixels[i] = (ubyte)(i * 7 + (i >> 13));
+    }
+
+    const char* path = "/tmp/rigel_resource_big_test.png";
+    REQUIRE(write_test_png(&test_arena, path, pixels, width, height));
+
+    ImageResource image = load_image_resource(path);
+    REQUIRE(image.state == ResourceState_Ready);
+    CHECK(image.width == width);
+    CHECK(image.height == height);
+    CHECK(memcmp(image.data, pixels, (usize)width * height * 4) == 0);
+
+    MappedFile png;
+    REQUIRE(map_file(path, &png));
+    CachedImage cached;
+    REQUIRE(asset_cache_map_image(asset_cache_hash(png.data, png.size), &cached));
+    CHECK(cached.width == width);
+    CHECK(memcmp(cached.pixels, pixels, (usize)width * height * 4) == 0);
+    unmap_file(&png);
+
+    asset_cache_set_dir(ASSET_CACHE_DIR);
 }
 
-AnimationResource* get_anim_resource(const char* key)
+TEST_CASE("decoding through the stb scratch arena matches a plain stb decode")
 {
-    auto id = resource_lookup->anim_resource_map.get(key);
-    if (id)
+    mem::Arena arena = mem::make_reserved_arena(ONE_GB, 0);
+    resource_initialize(arena);
+    use_empty_asset_cache("/tmp/rigel_resource_png_test");
+    mem::Arena test_arena = mem::make_reserved_arena(ONE_GB, 0);
+
+    // the first batch fits in scratch, the second gets scratch too small
+    // for even one image so stb_image falls back to malloc
+    const u32 n_batches = 2;
+    const u32 n_images = 3;
+    u32 sizes[n_images][2] = { { 5, 3 }, { 64, 64 }, { 33, 17 } };
+    char paths[n_batches][n_images][64];
+    ImageLoadRequest requests[n_batches][n_images];
+    for (u32 b = 0; b < n_batches; b++)
     {
-        return resource_lookup->anim_resources + *id;
+        for (u32 i = 0; i < n_images; i++)
+        {
+            u32 n_bytes = sizes[i][0] * sizes[i][1] * 4;
+            ubyte* pixels = test_arena.alloc_array<ubyte>(n_bytes);
+            for (u32 p = 0; p < n_bytes; p++)
+            {
+                pixels[p] = (ubyte)(p * 13 + i * 31 + b * 101);
+            }
+            snprintf(paths[b][i], sizeof(paths[b][i]), "/tmp/rigel_resource_decode_test_%u_%u.png", b, i);
+            REQUIRE(write_test_png(&test_arena, paths[b][i], pixels, sizes[i][0], sizes[i][1]));
+            requests[b][i] = ImageLoadRequest { paths[b][i], 1 };
+        }
     }
-    return nullptr;
+
+    load_image_resources(requests[0], n_images);
+
+    static ubyte tiny_backing[IMAGE_DECODE_MAX_THREADS][12 * ONE_KB];
+    for (u32 t = 0; t < IMAGE_DECODE_MAX_THREADS; t++)
+    {
+        resource_lookup->image_decode_storage[t] = mem::Arena(tiny_backing[t], sizeof(tiny_backing[t]));
+    }
+    load_image_resources(requests[1], n_images);
+
+    for (u32 b = 0; b < n_batches; b++)
+    {
+        for (u32 i = 0; i < n_images; i++)
+        {
+            MappedFile png;
+            REQUIRE(map_file(paths[b][i], &png));
+            int w, h, c;
+            ubyte* expected = stbi_load_from_memory(png.data, png.size, &w, &h, &c, 4);
+            REQUIRE(expected);
+
+            ImageResource image = get_image_resource(paths[b][i]);
+            REQUIRE(image.state == ResourceState_Ready);
+            CHECK(image.width == (usize)w);
+            CHECK(image.height == (usize)h);
+            CHECK(memcmp(image.data, expected, (usize)w * h * 4) == 0);
+
+            stbi_image_free(expected);
+            unmap_file(&png);
+        }
+    }
+
+    asset_cache_set_dir(ASSET_CACHE_DIR);
 }
 
 } // namespace rigel
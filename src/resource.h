@@ -4,6 +4,7 @@
 #include "rigel.h"
 #include "mem.h"
 #include "rigelmath.h"
+#include "spsc_queue.h"
 
 #include <cstring>
 
@@ -12,11 +13,28 @@ typedef i32 SpriteResourceId;
 typedef i32 ResourceId;
 constexpr static i32 RESOURCE_ID_NONE = -1;
 
-#define MAX_TEXT_RESOURCES 128
-#define MAX_IMAGE_RESOURCES 128
-#define MAX_ANIM_RESOURCES 128
+// Per kind of resource. It's only address space, the registries commit
+// pages as they fill up, so it can be generous.
+#define MAX_RESOURCES_PER_KIND (16 * 1024)
 #define MAX_ANIMATIONS 8
 
+// images decode on at most this many threads, each with this much of the
+// resource arena reserved as scratch for stb_image
+#define IMAGE_DECODE_MAX_THREADS 4
+#define IMAGE_DECODE_SCRATCH_BYTES (32 * ONE_MB)
+
+// how many async loads can be in flight at once
+#define RESOURCE_LOAD_QUEUE_SIZE 64
+
+enum ResourceState
+{
+    ResourceState_None,
+    // requested, the resource thread hasn't published it yet
+    ResourceState_Loading,
+    ResourceState_Ready,
+    ResourceState_Failed,
+};
+
 template<typename T, usize max>
 struct StringKeyedMap
 {
@@ -28,8 +46,16 @@ struct StringKeyedMap
     usize count;
     MapEntry map[max];
 
+    // adding a key that's already there replaces its value
     void add(const char* key, T value)
     {
+        T* existing = get(key);
+        if (existing)
+        {
+            *existing = value;
+            return;
+        }
+
         count++;
         // keep one free so linear probing always terminates
         assert(count < max - 1 && "Overflowed map");
@@ -59,7 +85,7 @@ struct StringKeyedMap
 
         while (map[idx].key)
         {
-            if (strncmp(map[idx].key, key, key_len) == 0)
+            if (strcmp(map[idx].key, key) == 0)
             {
                 return &map[idx].value;
             }
@@ -74,12 +100,147 @@ struct StringKeyedMap
     }
 };
 
+// Every resource of one kind, looked up by id or by key.
+//
+// The resources sit one after another in their own reserved sub-arena. An
+// id is just an index, pointers to resources stay put as the table grows,
+// and growing only commits more pages. The key index is open addressed and
+// checks the full hash and then the whole key. Once it's 3/4 full it gets
+// rehashed into one twice the size. Old indexes are left behind in
+// index_storage, which all together is less than the current one.
+template<typename T>
+struct ResourceRegistry
+{
+    struct IndexSlot
+    {
+        u64 hash;
+        const char* key;
+        ResourceId id;
+    };
+
+    constexpr static u32 INITIAL_INDEX_SLOTS = 64;
+
+    mem::Arena item_storage;
+    mem::Arena index_storage;
+    T* items;
+    i32 count;
+    i32 max_count;
+
+    IndexSlot* index;
+    u32 n_index_slots;
+
+    void init(mem::Arena* arena, i32 max_items)
+    {
+        // the arenas want a little slack past the last allocation
+        item_storage = arena->reserve_sub_arena((max_items + 1) * sizeof(T));
+        index_storage = arena->reserve_sub_arena(4 * max_items * sizeof(IndexSlot) + ONE_PAGE);
+        items = reinterpret_cast<T*>(item_storage.mem_begin);
+        count = 0;
+        max_count = max_items;
+        index = nullptr;
+        n_index_slots = 0;
+    }
+
+    static u64 hash_key(const char* key)
+    {
+        u64 hash = m::dbj2(key, strlen(key));
+        // dbj2 is weak in the low bits, which are the ones the index uses
+        return hash ^ (hash >> 29);
+    }
+
+    ResourceId find(const char* key)
+    {
+        if (!index)
+        {
+            return RESOURCE_ID_NONE;
+        }
+
+        u64 hash = hash_key(key);
+        u32 mask = n_index_slots - 1;
+        for (u32 idx = hash & mask; index[idx].key; idx = (idx + 1) & mask)
+        {
+            if (index[idx].hash == hash && strcmp(index[idx].key, key) == 0)
+            {
+                return index[idx].id;
+            }
+        }
+        return RESOURCE_ID_NONE;
+    }
+
+    T* get(ResourceId id)
+    {
+        assert(id >= 0 && id < count && "OOB resource access");
+        return items + id;
+    }
+
+    T* get(const char* key)
+    {
+        ResourceId id = find(key);
+        return id == RESOURCE_ID_NONE ? nullptr : items + id;
+    }
+
+    // Makes a zeroed resource and returns its id. key isn't copied, so it
+    // has to live as long as the registry does.
+    ResourceId add(const char* key)
+    {
+        assert(find(key) == RESOURCE_ID_NONE && "Resource added twice");
+        assert(count < max_count && "Tried to load too many resources");
+
+        if ((u32)(count + 1) * 4 > n_index_slots * 3)
+        {
+            grow_index();
+        }
+
+        T* item = item_storage.alloc_simple<T>();
+        assert(item == items + count);
+        memset(item, 0, sizeof(T));
+
+        ResourceId id = count;
+        insert(hash_key(key), key, id);
+        count++;
+        return id;
+    }
+
+    void insert(u64 hash, const char* key, ResourceId id)
+    {
+        u32 mask = n_index_slots - 1;
+        u32 idx = hash & mask;
+        while (index[idx].key)
+        {
+            idx = (idx + 1) & mask;
+        }
+        index[idx] = IndexSlot { hash, key, id };
+    }
+
+    void grow_index()
+    {
+        IndexSlot* old_index = index;
+        u32 n_old_slots = n_index_slots;
+
+        n_index_slots = n_old_slots ? n_old_slots * 2 : INITIAL_INDEX_SLOTS;
+        index = index_storage.alloc_array<IndexSlot>(n_index_slots);
+        memset(index, 0, n_index_slots * sizeof(IndexSlot));
+
+        for (u32 i = 0; i < n_old_slots; i++)
+        {
+            if (old_index[i].key)
+            {
+                insert(old_index[i].hash, old_index[i].key, old_index[i].id);
+            }
+        }
+    }
+};
+
+// text points into the resource arena and is null terminated, but length
+// doesn't count the terminator
 struct TextResource {
     ResourceId resource_id;
     usize length;
     const char* text;
+    ResourceState state;
 };
 
+// data is always 4 channels
 struct ImageResource {
     ResourceId resource_id;
     m::Vec2 atlas_coords;
@@ -89,6 +250,7 @@ struct ImageResource {
     usize n_frames;
 
     ubyte* data;
+    ResourceState state;
 };
 
 struct Frame
@@ -109,6 +271,7 @@ struct Animation
 struct AnimationResource
 {
     ResourceId id;
+    ResourceState state;
 
     u32 n_frames;
     Frame *frames;
@@ -117,37 +280,97 @@ struct AnimationResource
     StringKeyedMap<Animation, MAX_ANIMATIONS> animations;
 };
 
-// TODO: This needs to be a proper hash map now
-struct ResourceLookup {
-    i32 next_free_text_id;
-    StringKeyedMap<ResourceId, MAX_TEXT_RESOURCES> text_resource_map;
-    TextResource text_resources[MAX_TEXT_RESOURCES];
+enum ResourceLoadKind
+{
+    ResourceLoadKind_Text,
+    ResourceLoadKind_Image,
+    ResourceLoadKind_Anim,
+};
 
-    i32 next_free_image_id;
-    StringKeyedMap<ResourceId, MAX_IMAGE_RESOURCES> image_resource_map;
-    ImageResource image_resources[MAX_IMAGE_RESOURCES];
+// main thread -> resource thread
+struct ResourceLoadRequest
+{
+    ResourceLoadKind kind;
+    ResourceId id;
+    const char* file_path;
+};
 
-    i32 next_free_anim_id;
-    StringKeyedMap<ResourceId, MAX_ANIM_RESOURCES> anim_resource_map;
-    AnimationResource anim_resources[MAX_ANIM_RESOURCES];
+// resource thread -> main thread
+struct ResourceLoadResult
+{
+    ResourceLoadKind kind;
+    ResourceId id;
+    b32 ok;
+    ubyte* data;
+    usize length;
+    u32 width;
+    u32 height;
+    // parsed into async_storage, publishing copies it over the registry's
+    AnimationResource* anim;
+};
+
+struct ResourceLookup {
+    ResourceRegistry<TextResource> texts;
+    ResourceRegistry<ImageResource> images;
+    ResourceRegistry<AnimationResource> anims;
 
     mem::Arena text_storage;
     mem::Arena image_storage;
     mem::Arena frame_storage;
+    mem::Arena image_decode_storage[IMAGE_DECODE_MAX_THREADS];
+
+    // Async loads. Only the resource thread allocates from async_storage
+    // and async_decode_storage; only the main thread touches the tables
+    // above. They talk through the two queues.
+    SpscQueue<ResourceLoadRequest, RESOURCE_LOAD_QUEUE_SIZE> load_requests;
+    SpscQueue<ResourceLoadResult, RESOURCE_LOAD_QUEUE_SIZE> load_results;
+    u32 n_loads_in_flight;
+    b32 load_thread_started;
+    mem::Arena async_storage;
+    mem::Arena async_decode_storage;
 };
 
 void resource_initialize(mem::Arena& resource_arena);
 
+// Loads and blocks. If the path's already loaded that's what comes back,
+// and if it's still loading async this waits for it.
 TextResource load_text_resource(const char* file_path);
 TextResource get_text_resource(ResourceId id);
 TextResource get_text_resource(const char* key);
 
+struct ImageLoadRequest
+{
+    const char* file_path;
+    usize n_frames;
+};
+
+// Loads whichever of the images aren't loaded yet. Images that are in the
+// asset cache get mapped from there, the rest decode on a few threads
+// straight into the resource arena and get added to the cache. Only call it
+// from one thread at a time, the decoders share image_decode_storage.
+void load_image_resources(const ImageLoadRequest* requests, usize n_requests);
+
 // TODO: load n_frames from a file
 ImageResource load_image_resource(const char* file_path, usize n_frames = 1);
 ImageResource get_or_load_image_resource(const char* file_path, usize n_frames = 1);
 ImageResource get_image_resource(ResourceId id);
 ImageResource get_image_resource(const char* key);
 
+// Async loads: these register the resource and hand back its id straight
+// away, and the file is read (and decoded or parsed) on the resource thread. Until
+// poll_resource_loads publishes it the resource's state is
+// ResourceState_Loading and it has no data. Asking for something that's
+// already loaded or loading gives back the id it already has.
+ResourceId request_text_resource(const char* file_path);
+ResourceId request_image_resource(const char* file_path, usize n_frames = 1);
+ResourceId request_anim_resource(const char* file_path);
+
+// Publishes whatever the resource thread has finished and returns how many
+// loads that was. Call it from the main thread, once a frame is plenty.
+u32 poll_resource_loads();
+// Blocks until every requested load has been published.
+void wait_for_resource_loads();
+
 AnimationResource* load_anim_resource(mem::Arena* scratch_arena, const char* file_path);
 AnimationResource* get_or_load_anim_resource(mem::Arena* scratch_arena, const char* file_path);
 AnimationResource* get_anim_resource(ResourceId id);
@@ -34,16 +34,38 @@ typedef double f64;
 #define ONE_PAGE 4096
 #define ONE_KB (1 << 10)
 #define ONE_MB (1 << 20)
+#define ONE_GB (1 << 30)
 
 constexpr static f32 PLAYER_XACCEL = 200.0f;
 constexpr static f32 GRAVITY       = -800.0f;
 constexpr static f32 PLAYER_JUMP   = 200.0f;
 constexpr static f32 MAX_XSPEED    = 200.0f;
 
-typedef int32_t EntityId;
-constexpr static EntityId ENTITY_ID_NONE = -1;
-// TODO: is this a good idea?
-constexpr static EntityId PLAYER_ENTITY_ID = 0;
+// Entity handles pack the entity's slot index in the low bits and the
+// generation of that slot in the high bits. Despawning bumps the generation,
+// so stale handles stop resolving once the slot gets reused.
+typedef u32 EntityId;
+constexpr static u32 ENTITY_INDEX_BITS = 16;
+constexpr static u32 ENTITY_INDEX_MASK = (1 << ENTITY_INDEX_BITS) - 1;
+constexpr static EntityId ENTITY_ID_NONE = 0xFFFFFFFF;
+
+inline EntityId
+make_entity_id(u32 index, u32 generation)
+{
+    return (generation << ENTITY_INDEX_BITS) | (index & ENTITY_INDEX_MASK);
+}
+
+inline u32
+entity_id_index(EntityId id)
+{
+    return id & ENTITY_INDEX_MASK;
+}
+
+inline u32
+entity_id_generation(EntityId id)
+{
+    return id >> ENTITY_INDEX_BITS;
+}
 
 constexpr static i64 UPDATE_TIME_NS = 16680567;//8333333;
 constexpr static i64 RENDER_TIME_NS = 16680567;
@@ -0,0 +1,229 @@
+#include "spatial_grid.h"
+#include "world.h"
+
+#include <cmath>
+
+namespace rigel {
+
+struct CellRange
+{
+    i32 min_x;
+    i32 min_y;
+    i32 max_x;
+    i32 max_y;
+};
+
+static i32
+clamp_cell(f32 pixel, i32 n_cells)
+{
+    i32 cell = (i32)std::floor(pixel / SPATIAL_GRID_CELL_PIXELS);
+    if (cell < 0)
+    {
+        return 0;
+    }
+    if (cell >= n_cells)
+    {
+        return n_cells - 1;
+    }
+    return cell;
+}
+
+static CellRange
+cells_for_aabb(AABB aabb)
+{
+    m::Vec3 min = aabb.center - aabb.extents;
+    m::Vec3 max = aabb.center + aabb.extents;
+
+    CellRange result;
+    result.min_x = clamp_cell(min.x, SPATIAL_GRID_WIDTH);
+    result.min_y = clamp_cell(min.y, SPATIAL_GRID_HEIGHT);
+    result.max_x = clamp_cell(max.x, SPATIAL_GRID_WIDTH);
+    result.max_y = clamp_cell(max.y, SPATIAL_GRID_HEIGHT);
+    return result;
+}
+
+static bool
+aabbs_touch(AABB left, AABB right)
+{
+    auto result = simple_AABB_overlap(left, right);
+    return !(result.x == -1 && result.y == -1);
+}
+
+SpatialGrid*
+build_spatial_grid(WorldChunk* chunk, mem::Arena* temp_arena)
+{
+    SpatialGrid* grid = temp_arena->alloc_simple<SpatialGrid>();
+
+    usize max_items = chunk->components.count + MAX_ZONE_TRIGGERS;
+    grid->items = temp_arena->alloc_array<SpatialItem>(max_items);
+    grid->n_items = 0;
+    grid->query_stamp = 0;
+
+    for (usize i = 0; i < chunk->components.count; i++)
+    {
+        Entity* entity = chunk->entities + chunk->live_entities[i];
+
+        SpatialItem* item = grid->items + grid->n_items++;
+        item->type = SpatialItem_Entity;
+        item->index = i;
+        item->aabb = entity->colliders->aabbs[0];
+        item->aabb.center = chunk->components.position[i] + item->aabb.extents;
+    }
+
+    for (usize i = 0; i < MAX_ZONE_TRIGGERS; i++)
+    {
+        ZoneTriggerData* trigger = chunk->zone_triggers + i;
+        if (trigger->id <= 0)
+        {
+            continue;
+        }
+
+        SpatialItem* item = grid->items + grid->n_items++;
+        item->type = SpatialItem_ZoneTrigger;
+        item->index = i;
+        item->aabb = aabb_from_rect(trigger->rect);
+    }
+
+    grid->item_stamps = temp_arena->alloc_array<u32>(grid->n_items);
+
+    // count how many items land in each cell...
+    for (usize c = 0; c <= SPATIAL_GRID_N_CELLS; c++)
+    {
+        grid->cell_start[c] = 0;
+    }
+    for (usize i = 0; i < grid->n_items; i++)
+    {
+        grid->item_stamps[i] = 0;
+
+        CellRange range = cells_for_aabb(grid->items[i].aabb);
+        for (i32 y = range.min_y; y <= range.max_y; y++)
+        {
+            for (i32 x = range.min_x; x <= range.max_x; x++)
+            {
+                grid->cell_start[(y * SPATIAL_GRID_WIDTH) + x]++;
+            }
+        }
+    }
+
+    // ...turn the counts into the offset of the end of each cell...
+    for (usize c = 1; c <= SPATIAL_GRID_N_CELLS; c++)
+    {
+        grid->cell_start[c] += grid->cell_start[c - 1];
+    }
+
+    // ...and scatter back to front, which walks each offset back to the
+    // start of its cell.
+    grid->cell_items = temp_arena->alloc_array<u32>(grid->cell_start[SPATIAL_GRID_N_CELLS]);
+    for (usize i = 0; i < grid->n_items; i++)
+    {
+        CellRange range = cells_for_aabb(grid->items[i].aabb);
+        for (i32 y = range.min_y; y <= range.max_y; y++)
+        {
+            for (i32 x = range.min_x; x <= range.max_x; x++)
+            {
+                i32 cell = (y * SPATIAL_GRID_WIDTH) + x;
+                grid->cell_start[cell]--;
+                grid->cell_items[grid->cell_start[cell]] = i;
+            }
+        }
+    }
+
+    return grid;
+}
+
+usize
+spatial_grid_query(SpatialGrid* grid, AABB aabb, u32 type_mask, SpatialItem** out, usize max_out)
+{
+    grid->query_stamp++;
+
+    usize n_found = 0;
+    CellRange range = cells_for_aabb(aabb);
+    for (i32 y = range.min_y; y <= range.max_y; y++)
+    {
+        for (i32 x = range.min_x; x <= range.max_x; x++)
+        {
+            i32 cell = (y * SPATIAL_GRID_WIDTH) + x;
+            for (u32 c = grid->cell_start[cell]; c < grid->cell_start[cell + 1]; c++)
+            {
+                u32 item_idx = grid->cell_items[c];
+                if (grid->item_stamps[item_idx] == grid->query_stamp)
+                {
+                    continue;
+                }
+                grid->item_stamps[item_idx] = grid->query_stamp;
+
+                SpatialItem* item = grid->items + item_idx;
+                if (!(type_mask & SPATIAL_ITEM_MASK(item->type)) || !aabbs_touch(aabb, item->aabb))
+                {
+                    continue;
+                }
+
+                if (n_found == max_out)
+                {
+                    return n_found;
+                }
+                out[n_found++] = item;
+            }
+        }
+    }
+
+    return n_found;
+}
+
+} // namespace rigel
+
+#include "doctest.h"
+
+TEST_CASE("spatial grid finds what overlaps a box and reports each item once")
+{
+    using namespace rigel;
+
+    static ubyte backing[64 * ONE_KB];
+    mem::Arena arena(backing, 64 * ONE_KB);
+
+    static WorldChunk chunk;
+    chunk.components = make_entity_components(&arena, 3);
+
+    AABB collider = aabb_from_rect(Rectangle { 0, 0, 8, 16 });
+    ColliderSet colliders { 1, &collider };
+    m::Vec3 positions[] = { {10, 10, 0}, {40, 40, 0}, {300, 100, 0} };
+    for (u16 i = 0; i < 3; i++)
+    {
+        usize ci = entity_components_push(&chunk.components);
+        chunk.components.position[ci] = positions[i];
+        chunk.entities[i].colliders = &colliders;
+        chunk.live_entities[i] = i;
+    }
+    chunk.n_live_entities = 3;
+
+    // big enough to span a bunch of cells
+    chunk.zone_triggers[2].id = 1;
+    chunk.zone_triggers[2].rect = Rectangle { 0, 0, 200, 100 };
+
+    SpatialGrid* grid = build_spatial_grid(&chunk, &arena);
+
+    SpatialItem* hits[8];
+    AABB query = aabb_from_rect(Rectangle { 44, 50, 8, 8 });
+    usize n_hits = spatial_grid_query(grid, query, SPATIAL_ITEM_MASK_ALL, hits, 8);
+
+    bool found_entity = false;
+    bool found_trigger = false;
+    for (usize h = 0; h < n_hits; h++)
+    {
+        found_entity |= hits[h]->type == SpatialItem_Entity && hits[h]->index == 1;
+        found_trigger |= hits[h]->type == SpatialItem_ZoneTrigger && hits[h]->index == 2;
+    }
+    CHECK(n_hits == 2);
+    CHECK(found_entity);
+    CHECK(found_trigger);
+
+    // filtering by type happens before max_out, so what's filtered out
+    // can't crowd out what isn't
+    query = aabb_from_rect(Rectangle { 44, 50, 8, 8 });
+    REQUIRE(spatial_grid_query(grid, query, SPATIAL_ITEM_MASK(SpatialItem_ZoneTrigger), hits, 1) == 1);
+    CHECK(hits[0]->type == SpatialItem_ZoneTrigger);
+    CHECK(hits[0]->index == 2);
+
+    query = aabb_from_rect(Rectangle { 290, 170, 4, 4 });
+    CHECK(spatial_grid_query(grid, query, SPATIAL_ITEM_MASK_ALL, hits, 8) == 0);
+}
@@ -0,0 +1,69 @@
+#ifndef RIGEL_SPATIAL_GRID_H
+#define RIGEL_SPATIAL_GRID_H
+
+#include "rigel.h"
+#include "mem.h"
+#include "collider.h"
+#include "tilemap.h"
+
+namespace rigel {
+
+struct WorldChunk;
+
+// Uniform grid broadphase over a world chunk. It's rebuilt from scratch every
+// tick into a temp arena: count the items in each cell, prefix sum the counts,
+// then scatter the items so each cell's items sit next to each other. Anything
+// hanging off the edge of the chunk gets clamped into the border cells.
+#define SPATIAL_GRID_CELL_PIXELS 32
+#define SPATIAL_GRID_WIDTH \
+    ((WORLD_WIDTH_TILES * TILE_WIDTH_PIXELS + SPATIAL_GRID_CELL_PIXELS - 1) / SPATIAL_GRID_CELL_PIXELS)
+#define SPATIAL_GRID_HEIGHT \
+    ((WORLD_HEIGHT_TILES * TILE_HEIGHT_PIXELS + SPATIAL_GRID_CELL_PIXELS - 1) / SPATIAL_GRID_CELL_PIXELS)
+#define SPATIAL_GRID_N_CELLS (SPATIAL_GRID_WIDTH * SPATIAL_GRID_HEIGHT)
+
+enum SpatialItemType
+{
+    SpatialItem_Entity,
+    SpatialItem_ZoneTrigger,
+};
+
+// for picking which types a query returns
+#define SPATIAL_ITEM_MASK(type) (1u << (type))
+#define SPATIAL_ITEM_MASK_ALL 0xFFFFFFFFu
+
+struct SpatialItem
+{
+    SpatialItemType type;
+    // component index for entities, index into zone_triggers for triggers
+    u32 index;
+    AABB aabb;
+};
+
+struct SpatialGrid
+{
+    usize n_items;
+    SpatialItem* items;
+
+    // cell c holds cell_items[cell_start[c]] up to cell_items[cell_start[c + 1]]
+    u32 cell_start[SPATIAL_GRID_N_CELLS + 1];
+    u32* cell_items;
+
+    // the last query that returned each item, so items that span several
+    // cells only come back once per query
+    u32* item_stamps;
+    u32 query_stamp;
+};
+
+// Only good until temp_arena is reset.
+SpatialGrid*
+build_spatial_grid(WorldChunk* chunk, mem::Arena* temp_arena);
+
+// Fills out with the items overlapping aabb (touching counts, same as the
+// zone trigger test) and returns how many there were, up to max_out. Only
+// items whose type is in type_mask come back or count towards max_out.
+usize
+spatial_grid_query(SpatialGrid* grid, AABB aabb, u32 type_mask, SpatialItem** out, usize max_out);
+
+} // namespace rigel
+
+#endif // RIGEL_SPATIAL_GRID_H
@@ -0,0 +1,76 @@
+#ifndef RIGEL_SPSC_QUEUE_H
+#define RIGEL_SPSC_QUEUE_H
+
+#include "rigel.h"
+
+#include <atomic>
+
+namespace rigel {
+
+// Fixed-size, lock-free queue between exactly one producer thread and one
+// consumer thread. push and pop never block. A consumer with nothing to do
+// can sleep in wait_for_items until the producer pushes.
+//
+// head and tail only ever count up and wrap at 2^32, so capacity has to be
+// a power of two for tail - head to still be the number of items.
+template<typename T, u32 capacity>
+struct SpscQueue
+{
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    // on their own cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<u32> head;  // written by the consumer
+    alignas(64) std::atomic<u32> tail;  // written by the producer
+    T items[capacity];
+
+    void init()
+    {
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // producer side. false if the queue is full.
+    b32 push(const T& item)
+    {
+        u32 t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity)
+        {
+            return false;
+        }
+
+        items[t & (capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+        return true;
+    }
+
+    // consumer side. false if the queue is empty.
+    b32 pop(T* out)
+    {
+        u32 h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        *out = items[h & (capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. Returns once there's something to pop.
+    void wait_for_items()
+    {
+        u32 h = head.load(std::memory_order_relaxed);
+        u32 t = tail.load(std::memory_order_acquire);
+        while (t == h)
+        {
+            tail.wait(t, std::memory_order_acquire);
+            t = tail.load(std::memory_order_acquire);
+        }
+    }
+};
+
+} // namespace rigel
+
+#endif // RIGEL_SPSC_QUEUE_H
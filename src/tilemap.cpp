@@ -21,27 +21,28 @@ operator<<(std::ostream& os, const TileType& tt) -> std::ostream&
     return os;
 }
 
-void
-fill_tilemap_from_array(TileMap* map, f32* array, usize n_elems)
+usize
+fill_tiles_from_ids(TileType* tiles, u16* tile_sprites, const u32* ids, usize n_elems)
 {
     assert(n_elems == (WORLD_WIDTH_TILES * WORLD_HEIGHT_TILES) && "Unexpected number of tiles");
 
     usize n_nonempty = 0;
     for (usize tile_i = 0; tile_i < n_elems; tile_i++)
     {
-        if (array[tile_i] == 0)
+        if (ids[tile_i] == 0)
         {
-            map->tiles[tile_i] = TileType::EMPTY;
+            tiles[tile_i] = TileType::EMPTY;
         }
         else
         {
-            const auto id = array[tile_i] == VERTICAL_ONEWAY_ID ? TileType::VERTICAL_ONEWAY : TileType::WALL;
-            map->tiles[tile_i] = id;
+            const auto id = ids[tile_i] == VERTICAL_ONEWAY_ID ? TileType::VERTICAL_ONEWAY : TileType::WALL;
+            tiles[tile_i] = id;
             n_nonempty++;
         }
-        map->tile_sprites[tile_i] = array[tile_i];
+        assert(ids[tile_i] <= 0xFFFF && "tile id doesn't fit in a tile sprite");
+        tile_sprites[tile_i] = (u16)ids[tile_i];
     }
-    map->n_nonempty_tiles = n_nonempty;
+    return n_nonempty;
 }
 
 void
@@ -98,7 +99,13 @@ tilemap_set_up_and_buffer(TileMap* map, mem::Arena* temp_arena)
         }
     }
 
-    render::buffer_rectangles(&map->vert_buffer, tile_rects.items, tile_rects.length, temp_arena);
+    render::buffer_rectangles(&map->vert_buffer, tile_rects.items, tile_rects.length);
+}
+
+void
+tilemap_release_buffer(TileMap* map)
+{
+    render::release_vertex_buffer(&map->vert_buffer);
 }
 
 } // namespace rigel
@@ -16,8 +16,9 @@ namespace rigel {
 
 // for now...
 #define VERTICAL_ONEWAY_ID 8312
+#define TILE_SHEET_PATH "resource/image/tiles_merged.png"
 
-enum class TileType
+enum class TileType : ubyte
 {
     EMPTY, WALL, VERTICAL_ONEWAY
 };
@@ -27,8 +28,10 @@ struct TileMap
     usize n_nonempty_tiles;
     
     // TODO(spencer): why are these different?
-    TileType tiles[WORLD_SIZE_TILES];
-    u16 tile_sprites[WORLD_SIZE_TILES];
+    // WORLD_SIZE_TILES each. They live in the chunk's arena, or in the mapped
+    // file when the level was baked.
+    TileType* tiles;
+    u16* tile_sprites;
 
     ResourceId tile_sheet;
     render::VertexBuffer vert_buffer;
@@ -84,11 +87,15 @@ tiles_to_world(m::Vec2 tile_coord)
 
 }
 
-void
-fill_tilemap_from_array(TileMap* map, f32* array, usize n_elems);
+// Turns Tiled tile ids into tile types and sprite ids. Returns how many
+// tiles aren't empty.
+usize
+fill_tiles_from_ids(TileType* tiles, u16* tile_sprites, const u32* ids, usize n_elems);
 
 void
 tilemap_set_up_and_buffer(TileMap* map, mem::Arena* temp_arena);
+void
+tilemap_release_buffer(TileMap* map);
 
 }
 
@@ -1,5 +1,5 @@
 #include "world.h"
-#include "json.h"
+#include "level_file.h"
 #include "rigelmath.h"
 #include "tilemap.h"
 
@@ -26,210 +26,95 @@ parse_color_str(const char* str)
     return result;
 }
 
-WorldChunk*
-load_world_chunk(mem::GameMem& mem, const char* file_path)
+// a chunk with nothing in it yet
+static WorldChunk*
+alloc_world_chunk(mem::Arena* chunk_arena)
 {
-    WorldChunk* result = mem.game_state_arena.alloc_simple<WorldChunk>();
+    WorldChunk* result = chunk_arena->alloc_simple<WorldChunk>();
 
     for (int i = 0; i < MAX_ENTITIES; i++) {
-        result->entity_hash[i].id = ENTITY_ID_NONE;
-        result->entities[i].id = ENTITY_ID_NONE;
-        result->entities[i].state = STATE_DELETED;
+        result->entities[i].id = make_entity_id(i, 0);
     }
+    result->components = make_entity_components(chunk_arena, MAX_ENTITIES);
     result->player_id = ENTITY_ID_NONE;
+    result->collider_pool = mem::make_pool<EntityColliders>(MAX_ENTITIES, chunk_arena);
+    result->level_file = MappedFile { nullptr, 0 };
 
-    // TODO: this should be something that can hold lots of them I think
-    mem::Arena tilemap_arena = mem.stage_arena.alloc_sub_arena(18 * ONE_KB);
-
-    TextResource world_data = load_text_resource(file_path);
-    auto root_obj_v = parse_json_string(&mem.frame_temp_arena, world_data.text);
-    assert(root_obj_v->type == JSON_OBJECT && "expect an object at root");
-    auto root = root_obj_v->object;
-
-    TileMap* tile_map = tilemap_arena.alloc_simple<TileMap>();
-    TileMap* decoration = tilemap_arena.alloc_simple<TileMap>();
-    TileMap* background = tilemap_arena.alloc_simple<TileMap>();
+    return result;
+}
 
-    ImageResource tilesheet = get_or_load_image_resource("resource/image/tiles_merged.png");
-    tile_map->tile_sheet = tilesheet.resource_id;
-    decoration->tile_sheet = tilesheet.resource_id;
-    background->tile_sheet = tilesheet.resource_id;
+WorldChunk*
+load_world_chunk(mem::GameMem& mem, mem::Arena* chunk_arena, const char* file_path)
+{
+    WorldChunk* result = alloc_world_chunk(chunk_arena);
+
+    // Use the baked level when it's up to date, it maps straight in. Otherwise
+    // read the json: chunks can get reloaded when streaming, so that's read
+    // out of scratch memory rather than kept around as a resource, and only
+    // the tile layers end up in the chunk's arena.
+    LevelDesc level;
+    b32 loaded = false;
+    char baked_path[256];
+    if (baked_level_path(file_path, baked_path, sizeof(baked_path))
+        && file_mtime_ns(baked_path) >= file_mtime_ns(file_path))
+    {
+        loaded = map_level_file(baked_path, &result->level_file, &level);
+    }
+    if (!loaded)
+    {
+        loaded = read_level_json(chunk_arena, &mem.frame_temp_arena, file_path, &level);
+    }
+    assert(loaded && "couldn't load level");
+
+    TileMap* tile_map = chunk_arena->alloc_simple<TileMap>();
+    TileMap* background = chunk_arena->alloc_simple<TileMap>();
+    TileMap* decoration = chunk_arena->alloc_simple<TileMap>();
+    TileMap* layer_maps[RlvlTileLayer_N] = { tile_map, background, decoration };
+
+    ImageResource tilesheet = get_or_load_image_resource(TILE_SHEET_PATH);
+    for (u32 layer = 0; layer < RlvlTileLayer_N; layer++) {
+        TileMap* map = layer_maps[layer];
+        map->tiles = level.tiles[layer];
+        map->tile_sprites = level.tile_sprites[layer];
+        map->n_nonempty_tiles = level.n_nonempty_tiles[layer];
+        map->tile_sheet = tilesheet.resource_id;
+    }
 
     tile_map->background = background;
     tile_map->decoration = decoration;
     result->active_map = tile_map;
 
-    auto width = jsonobj_get(root, "width", 5);
-    assert(width->type == JSON_NUMBER && "width is not a number");
-    auto height = jsonobj_get(root, "height", 6);
-    assert(height->type == JSON_NUMBER && "height is not a number");
-
-    assert(width->number->value == WORLD_WIDTH_TILES && "ERR: width is wrong");
-    assert(height->number->value == WORLD_HEIGHT_TILES &&
-           "ERR: height is wrong");
-
-    auto layers_v = jsonobj_get(root, "layers", 6);
-    assert(layers_v->type == JSON_OBJECT_ARRAY && "expect object array");
-    auto head = layers_v->obj_array;
-
-    bool fg = false;
-    bool bg = false;
-    bool dec = false;
-    bool entities = true;
-    bool lights = true;
-
-    while (head) {
-        auto obj = head->obj;
-        auto name_v = jsonobj_get(obj, "name", 4);
-        assert(name_v->type == JSON_STRING && "name is not a string");
-        auto name = name_v->string;
-
-        if (json_str_equals(*name, "fg", 2)) {
-            auto data_v = jsonobj_get(obj, "data", 4);
-            assert(data_v->type == JSON_NUMBER_ARRAY &&
-                   "data is not a numeric array");
-            auto data = data_v->number_array;
-
-            // TODO: the cast kind of sucks. Should re-think how jsonarray
-            // works..
-            fill_tilemap_from_array(
-              tile_map, reinterpret_cast<f32*>(data->arr), data->n);
-            fg = true;
-        } else if (json_str_equals(*name, "bg", 2)) {
-            auto data_v = jsonobj_get(obj, "data", 4);
-            assert(data_v->type == JSON_NUMBER_ARRAY &&
-                   "data is not a numeric array");
-            auto data = data_v->number_array;
-
-            // TODO: the cast kind of sucks. Should re-think how jsonarray
-            // works..
-            fill_tilemap_from_array(
-              background, reinterpret_cast<f32*>(data->arr), data->n);
-            bg = true;
-        } else if (json_str_equals(*name, "decoration", 10)) {
-            auto data_v = jsonobj_get(obj, "data", 4);
-            assert(data_v->type == JSON_NUMBER_ARRAY &&
-                   "data is not a numeric array");
-            auto data = data_v->number_array;
-
-            // TODO: the cast kind of sucks. Should re-think how jsonarray
-            // works..
-            fill_tilemap_from_array(
-              decoration, reinterpret_cast<f32*>(data->arr), data->n);
-            dec = true;
-        } else if (json_str_equals(*name, "entities", 8)) {
-            auto objects_v = jsonobj_get(obj, "objects", 7);
-            // TODO: I need a better way to detect empty arrays
-            if (objects_v->type != JSON_OBJECT_ARRAY) {
-                head = head->next;
-                continue;
-            }
-            auto objects = objects_v->obj_array;
-
-            while (objects) {
-                auto obj = objects->obj;
-                auto props = jsonobj_get(obj, "properties", 10)->obj_array;
-
-                EntityType type = EntityType_NumberOfTypes;
-
-                while (props) {
-                    auto prop = props->obj;
-
-                    auto name = jsonobj_get(prop, "name", 4)->string;
-                    if (json_str_equals(*name, "Type", 4)) {
-                        // TODO: jsonstrings reeeeeeally suck
-                        char buf[64];
-                        auto type_s = jsonobj_get(prop, "value", 5)->string;
-                        json_str_copy(buf, type_s);
-                        type = get_entity_type_for_str(buf);
-                    }
-
-                    props = props->next;
-                }
-                f32 x_pos = jsonobj_get(obj, "x", 1)->number->value;
-                f32 y_pos = jsonobj_get(obj, "y", 1)->number->value;
-                y_pos = (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS) - y_pos;
-
-                if (type != EntityType_NumberOfTypes) {
-                    EntityId id =
-                      result->add_entity(mem, type, m::Vec3{ x_pos, y_pos });
-
-                    if (type == EntityType_Player) {
-                        result->player_id = id;
-                    }
-                }
-                objects = objects->next;
-            }
-
-            entities = true;
-        } else if (json_str_equals(*name, "lights", 6)) {
-            auto objects_v = jsonobj_get(obj, "objects", 7);
-            if (objects_v->type != JSON_OBJECT_ARRAY) {
-                head = head->next;
-                continue;
-            }
-            auto objects = objects_v->obj_array;
+    // entities, lights and triggers are live state, so they get copied in
+    // rather than pointing into the level
+    for (u32 i = 0; i < level.n_entities; i++) {
+        const RlvlEntity& entity = level.entities[i];
+        assert(entity.type < EntityType_NumberOfTypes && "bad entity type");
 
-            while(objects)
-            {
-                auto obj = objects->obj;
-                auto props = jsonobj_get(obj, "properties", 10)->obj_array;
-
-                LightType light_type = LightType_NLightTypes;
-                m::Vec3 color{0, 0, 0};
-                float intensity = -1;
-
-                while (props)
-                {
-                    auto prop = props->obj;
-
-                    auto name = jsonobj_get(prop, "name", 4)->string;
-                    if (json_str_equals(*name, "LightType", 9))
-                    {
-                        char buf[64];
-                        auto type_s = jsonobj_get(prop, "value", 5)->string;
-                        json_str_copy(buf, type_s);
-                        light_type = get_light_type_for_str(buf);
-                    }
-                    else if (json_str_equals(*name, "Color", 5))
-                    {
-                        char buf[32];
-                        auto color_s = jsonobj_get(prop, "value", 5)->string;
-                        json_str_copy(buf, color_s);
-                        color = parse_color_str(buf);
-                    }
-                    else if (json_str_equals(*name, "Intensity", 9))
-                    {
-                        intensity = jsonobj_get(prop, "value", 5)->number->value;
-                    }
-                    props = props->next;
-                }
-                f32 x_pos = jsonobj_get(obj, "x", 1)->number->value;
-                f32 y_pos = jsonobj_get(obj, "y", 1)->number->value;
-                y_pos = (WORLD_HEIGHT_TILES * TILE_WIDTH_PIXELS) - y_pos;
-
-                if(light_type != LightType_NLightTypes
-                            && color != m::Vec3{0, 0, 0}
-                            && intensity > 0)
-                {
-                    color = color * intensity;
-                    result->add_light(light_type, m::Vec3{x_pos, y_pos, 0}, color);
-                }
-                else
-                {
-                    std::cout << "skipping light with not enough props..." << std::endl;
-                }
-                objects = objects->next;
-            }
-            lights = true;
-        } else {
-            assert(false && "Found an unexpected layer");
+        EntityId id =
+          result->add_entity(mem, (EntityType)entity.type, m::Vec3{ entity.x, entity.y });
+        if (entity.type == EntityType_Player) {
+            result->player_id = id;
         }
+    }
+
+    for (u32 i = 0; i < level.n_lights; i++) {
+        const RlvlLight& light = level.lights[i];
+        assert(light.type < LightType_NLightTypes && "bad light type");
 
-        head = head->next;
+        result->add_light((LightType)light.type,
+                          m::Vec3{ light.x, light.y, 0 },
+                          m::Vec3{ light.r, light.g, light.b });
     }
 
-    assert((fg && bg && dec && entities && lights) && "missing a layer");
+    for (u32 i = 0; i < level.n_zone_triggers; i++) {
+        const RlvlZoneTrigger& trigger = level.zone_triggers[i];
+        ZoneTriggerData* zone = result->zone_triggers + i;
+        zone->id = i + 1;
+        zone->target_effect = (EffectId)trigger.target_effect;
+        zone->target_id = trigger.target_id;
+        zone->effect_data = nullptr;
+        zone->rect = Rectangle{ trigger.x, trigger.y, trigger.width, trigger.height };
+    }
 
     return result;
 }
@@ -237,7 +122,7 @@ load_world_chunk(mem::GameMem& mem, const char* file_path)
 u32 WorldChunk::add_light(LightType type, m::Vec3 position, m::Vec3 color)
 {
     auto idx = next_free_light_idx;
-    assert(idx < 24 && "too many lights!");
+    assert(idx < MAX_LIGHTS && "too many lights!");
     next_free_light_idx++;
 
     auto light = lights + idx;
@@ -248,37 +133,258 @@ u32 WorldChunk::add_light(LightType type, m::Vec3 position, m::Vec3 color)
     return idx;
 }
 
+void
+release_world_chunk(WorldChunk* chunk)
+{
+    tilemap_release_buffer(chunk->active_map);
+    tilemap_release_buffer(chunk->active_map->background);
+    tilemap_release_buffer(chunk->active_map->decoration);
+    unmap_file(&chunk->level_file);
+}
+
 EntityId
 WorldChunk::add_entity(mem::GameMem& mem,
                        EntityType type,
                        m::Vec3 initial_position)
 {
-    // TODO: allocating these is likely more tricky
-    EntityId entity_id = next_free_entity_idx;
+    static_assert(MAX_ENTITIES <= ENTITY_INDEX_MASK, "entity slots won't fit in a handle");
 
-    usize hash = entity_id & (MAX_ENTITIES - 1);
-    entity_hash[hash].id = entity_id;
-    entity_hash[hash].index = next_free_entity_idx;
-    next_free_entity_idx++;
+    u32 slot;
+    if (n_free_entity_slots > 0)
+    {
+        n_free_entity_slots--;
+        slot = free_entity_slots[n_free_entity_slots];
+    }
+    else
+    {
+        assert(next_free_entity_idx < MAX_ENTITIES && "too many entities!");
+        slot = next_free_entity_idx;
+        next_free_entity_idx++;
+    }
+
+    Entity* new_entity = &entities[slot];
+    // the generation was already bumped when the slot was freed
+    EntityId entity_id = new_entity->id;
+
+    // everything spawns in the air and lands on the first tick
+    usize component_idx = entity_components_push(&components);
+    assert(component_idx == n_live_entities && "entity components out of sync");
+
+    live_entity_pos[slot] = n_live_entities;
+    live_entities[n_live_entities] = slot;
+    n_live_entities++;
 
     EntityPrototype proto = entity_prototypes[type];
 
-    Entity* new_entity = &entities[entity_id];
+    *new_entity = {};
     new_entity->id = entity_id;
     new_entity->type = type;
     new_entity->sprite_id = proto.spritesheet.resource_id;
-    new_entity->position = initial_position;
     new_entity->animations_id = proto.animation_id;
-    entity_set_animation(new_entity, "idle");
+    components.position[component_idx] = initial_position;
+    entity_set_animation(new_entity, components.animation + component_idx, "idle");
 
-    // TODO: This is a thorn in my side
-    auto colliders = mem.colliders_arena.alloc_simple<ColliderSet>();
-    colliders->n_aabbs = 1;
-    colliders->aabbs = mem.colliders_arena.alloc_array<AABB>(1);
+    auto colliders = mem::pool_alloc(&collider_pool);
+    assert(colliders && "Out of entity colliders");
+    colliders->set.n_aabbs = 1;
+    colliders->set.aabbs = colliders->aabbs;
     colliders->aabbs[0] = aabb_from_rect(proto.collider_dims);
-    new_entity->colliders = colliders;
+    new_entity->colliders = &colliders->set;
 
     return entity_id;
 }
 
+void
+WorldChunk::remove_entity(EntityId id)
+{
+    Entity* entity = get_entity(id);
+    if (!entity)
+    {
+        // already removed, or a stale handle
+        return;
+    }
+
+    u32 slot = entity_id_index(id);
+
+    // set is the first member, so this is the pointer we handed out
+    mem::pool_free(&collider_pool, reinterpret_cast<EntityColliders*>(entity->colliders));
+    entity->colliders = nullptr;
+    entity->id = make_entity_id(slot, entity_id_generation(id) + 1);
+
+    u32 pos = live_entity_pos[slot];
+    u16 last_slot = live_entities[n_live_entities - 1];
+    live_entities[pos] = last_slot;
+    live_entity_pos[last_slot] = pos;
+    n_live_entities--;
+    entity_components_swap_remove(&components, pos);
+
+    free_entity_slots[n_free_entity_slots] = slot;
+    n_free_entity_slots++;
+
+    if (player_id == id)
+    {
+        player_id = ENTITY_ID_NONE;
+    }
+}
+
+}
+
+#include "doctest.h"
+
+namespace rigel {
+
+// An empty chunk whose player prototype has an idle animation, which is all
+// add_entity needs. Everything comes out of arena. Null if the animation
+// couldn't be written out.
+[[maybe_unused]] static WorldChunk*
+make_test_chunk(mem::Arena* arena)
+{
+    resource_initialize(*arena);
+
+    const char* anim_path = "/tmp/rigel_world_test_anim.json";
+    const char* anim_json =
+        "{\"frames\": [{\"frame\": {\"x\": 0, \"y\": 0, \"w\": 16, \"h\": 16}, \"duration\": 100}],"
+        " \"meta\": {\"frameTags\": [{\"name\": \"idle\", \"from\": 0, \"to\": 0}]}}";
+    if (!dump_to_file(anim_path, anim_json, strlen(anim_json)))
+    {
+        return nullptr;
+    }
+
+    mem::Arena scratch = arena->reserve_sub_arena(ONE_MB);
+    AnimationResource* anim = load_anim_resource(&scratch, anim_path);
+    entity_prototypes[EntityType_Player].animation_id = anim->id;
+    entity_prototypes[EntityType_Player].collider_dims = Rectangle { 0, 0, 8, 16 };
+
+    return alloc_world_chunk(arena);
+}
+
+} // namespace rigel
+
+TEST_CASE("pools hand freed slots back out before touching new ones")
+{
+    using namespace rigel;
+
+    static ubyte backing[ONE_PAGE];
+    mem::Arena arena(backing, ONE_PAGE);
+    auto pool = mem::make_pool<EntityColliders>(2, &arena);
+
+    auto a = mem::pool_alloc(&pool);
+    auto b = mem::pool_alloc(&pool);
+    CHECK(a != nullptr);
+    CHECK(b != nullptr);
+    CHECK(mem::pool_alloc(&pool) == nullptr);
+
+    mem::pool_free(&pool, a);
+    CHECK(pool.n_allocated == 1);
+    CHECK(mem::pool_alloc(&pool) == a);
+    CHECK(pool.next_untouched_idx == 2);
+}
+
+TEST_CASE("entity handles go stale when their slot is freed and reused")
+{
+    using namespace rigel;
+
+    mem::Arena arena = mem::make_reserved_arena(ONE_GB, 0);
+    WorldChunk* chunk = make_test_chunk(&arena);
+    REQUIRE(chunk != nullptr);
+    mem::GameMem game_mem = {};
+
+    EntityId ids[5];
+    for (u32 i = 0; i < 5; i++)
+    {
+        ids[i] = chunk->add_entity(game_mem, EntityType_Player, m::Vec3 { (f32)i, 0, 0 });
+        CHECK(chunk->get_entity(ids[i]) != nullptr);
+    }
+
+    chunk->remove_entity(ids[1]);
+    CHECK(chunk->get_entity(ids[1]) == nullptr);
+    CHECK(chunk->collider_pool.n_allocated == 4);
+
+    // removing again, or through a stale handle, does nothing
+    chunk->remove_entity(ids[1]);
+    CHECK(chunk->n_live_entities == 4);
+    CHECK(chunk->n_free_entity_slots == 1);
+    CHECK(chunk->collider_pool.n_allocated == 4);
+
+    EntityId reused = chunk->add_entity(game_mem, EntityType_Player, m::Vec3 { 10, 0, 0 });
+    CHECK(entity_id_index(reused) == entity_id_index(ids[1]));
+    CHECK(entity_id_generation(reused) == entity_id_generation(ids[1]) + 1);
+    CHECK(chunk->get_entity(reused) != nullptr);
+    CHECK(chunk->get_entity(ids[1]) == nullptr);
+    CHECK(chunk->next_free_entity_idx == 5);
+
+    chunk->remove_entity(ids[1]);
+    CHECK(chunk->get_entity(reused) != nullptr);
+
+    chunk->remove_entity(ids[2]);
+    chunk->remove_entity(ids[3]);
+
+    // the iterator sees exactly what's left, once each
+    EntityId live[3] = { ids[0], reused, ids[4] };
+    b32 seen[3] = {};
+    u32 n_seen = 0;
+    EntityIterator it(chunk);
+    for (Entity* entity = it.begin(); entity != it.end(); entity = it.next())
+    {
+        n_seen++;
+        for (u32 i = 0; i < 3; i++)
+        {
+            if (entity->id == live[i])
+            {
+                CHECK(!seen[i]);
+                seen[i] = true;
+            }
+        }
+    }
+    CHECK(n_seen == 3);
+    CHECK((seen[0] && seen[1] && seen[2]));
+}
+
+TEST_CASE("removing an entity keeps every survivor's components with it")
+{
+    using namespace rigel;
+
+    mem::Arena arena = mem::make_reserved_arena(ONE_GB, 0);
+    WorldChunk* chunk = make_test_chunk(&arena);
+    REQUIRE(chunk != nullptr);
+    mem::GameMem game_mem = {};
+
+    const u32 n = 8;
+    EntityId ids[n];
+    for (u32 i = 0; i < n; i++)
+    {
+        ids[i] = chunk->add_entity(game_mem, EntityType_Player, m::Vec3 { (f32)i, 0, 0 });
+        Entity* entity = chunk->get_entity(ids[i]);
+        chunk->components.velocity[chunk->component_idx(entity)] = m::Vec3 { 0, (f32)i * 10, 0 };
+    }
+
+    u32 last_slot = entity_id_index(ids[n - 1]);
+    chunk->remove_entity(ids[3]);
+    REQUIRE(chunk->n_live_entities == n - 1);
+    CHECK(chunk->components.count == n - 1);
+
+    // the last entity moved into the removed one's place
+    CHECK(chunk->live_entity_pos[last_slot] == 3);
+    CHECK(chunk->live_entities[3] == last_slot);
+
+    for (u32 i = 0; i < n; i++)
+    {
+        if (i == 3)
+        {
+            continue;
+        }
+        Entity* entity = chunk->get_entity(ids[i]);
+        REQUIRE(entity != nullptr);
+        usize idx = chunk->component_idx(entity);
+        CHECK(idx < chunk->components.count);
+        CHECK(chunk->components.position[idx].x == (f32)i);
+        CHECK(chunk->components.velocity[idx].y == (f32)i * 10);
+    }
+
+    // iterating reads the same components
+    EntityIterator it(chunk);
+    for (Entity* entity = it.begin(); entity != it.end(); entity = it.next())
+    {
+        CHECK(it.component_idx() == chunk->component_idx(entity));
+    }
 }
@@ -9,6 +9,7 @@
 #include "resource.h"
 #include "rigelmath.h"
 #include "trigger.h"
+#include "fs_linux.h"
 
 #include <iostream>
 
@@ -19,14 +20,18 @@ namespace rigel {
 // TODO: We need to re-write basically all of this.
 // We wanna keep some of the level loading stuff tho.
 ///////////////////////////////////////////////////
-#define MAX_ENTITIES 64
+#define MAX_ENTITIES 1024
+#define MAX_ZONE_TRIGGERS 16
+#define MAX_LIGHTS 24
 
 extern EntityPrototype entity_prototypes[EntityType_NumberOfTypes];
 
-struct EntityHash
+// Everything an entity owns on the collider side. Handed out from the
+// chunk's collider_pool so despawning gives it back.
+struct EntityColliders
 {
-    EntityId id;
-    usize index;
+    ColliderSet set;
+    AABB aabbs[1];
 };
 
 enum LightType
@@ -63,72 +68,139 @@ struct WorldChunk
     i32 level_index;
     TileMap* active_map;
 
+    // Slots below next_free_entity_idx have been used at least once. Slots
+    // freed by remove_entity go on the free_entity_slots stack and get
+    // reused before we touch new ones.
     i32 next_free_entity_idx;
-    EntityHash entity_hash[MAX_ENTITIES];
     Entity entities[MAX_ENTITIES];
     EntityId player_id;
 
+    u16 free_entity_slots[MAX_ENTITIES];
+    u32 n_free_entity_slots;
+
+    // Dense list of the live slots so iterating never looks at dead ones.
+    // live_entity_pos maps a slot back to where it sits in live_entities,
+    // which is also its index into components.
+    u16 live_entities[MAX_ENTITIES];
+    u16 live_entity_pos[MAX_ENTITIES];
+    u32 n_live_entities;
+
+    EntityComponents components;
+
+    mem::Pool<EntityColliders> collider_pool;
+
     i32 next_free_light_idx;
-    Light lights[24];
+    Light lights[MAX_LIGHTS];
 
-    ZoneTriggerData zone_triggers[16];
+    ZoneTriggerData zone_triggers[MAX_ZONE_TRIGGERS];
 
     m::Vec2 overworld_coords;
 
+    // set when the chunk came from a baked level, the tilemaps point into it
+    MappedFile level_file;
+
     // REVIEW
     EntityId add_entity(mem::GameMem& mem,
                         EntityType type,
                         m::Vec3 initial_position);
 
+    // Removing swaps the last live entity into the removed one's place, so
+    // don't remove entities while iterating over them.
+    void remove_entity(EntityId id);
+
+    inline Entity* get_entity(EntityId id)
+    {
+        u32 index = entity_id_index(id);
+        if (id == ENTITY_ID_NONE || index >= MAX_ENTITIES)
+        {
+            return nullptr;
+        }
+
+        Entity* result = entities + index;
+        if (result->id != id || (i32)index >= next_free_entity_idx)
+        {
+            return nullptr;
+        }
+
+        u32 pos = live_entity_pos[index];
+        if (pos >= n_live_entities || live_entities[pos] != index)
+        {
+            return nullptr;
+        }
+        return result;
+    }
+
+    // index of the entity's hot fields in components
+    inline usize component_idx(Entity* entity)
+    {
+        return live_entity_pos[entity_id_index(entity->id)];
+    }
+
     u32 add_light(LightType type, m::Vec3 position, m::Vec3 color);
 
 };
 
+m::Vec3
+parse_color_str(const char* str);
+
+// Walks the chunk's live entities.
 struct EntityIterator
 {
     EntityIterator(WorldChunk* wc)
     {
-        first = wc->entities;
-        current = first;
-        last = wc->entities + wc->next_free_entity_idx;
+        chunk = wc;
+        live_idx = 0;
     }
 
     Entity* begin()
     {
-        return current;
+        live_idx = 0;
+        return current();
     }
 
     Entity* end()
     {
-        return last;
+        return nullptr;
     }
 
     Entity* next()
     {
-        current++;
-        while (current < last && first->state == STATE_DELETED)
+        live_idx++;
+        return current();
+    }
+
+    // index of the current entity's hot fields in chunk->components
+    usize component_idx()
+    {
+        return live_idx;
+    }
+
+    Entity* current()
+    {
+        if (live_idx >= chunk->n_live_entities)
         {
-            current++;
+            return nullptr;
         }
-        return current;
+        return chunk->entities + chunk->live_entities[live_idx];
     }
 
-    Entity* first;
-    Entity* current;
-    Entity* last;
+    WorldChunk* chunk;
+    u32 live_idx;
 };
 
+// Everything the chunk owns comes out of chunk_arena, so the chunk can be
+// dropped by releasing it and resetting the arena. file_path is the Tiled
+// json; if there's a baked .rlvl next to it that's at least as new, that gets
+// mapped instead.
 WorldChunk*
-load_world_chunk(mem::GameMem& mem, const char* file_path);
+load_world_chunk(mem::GameMem& mem, mem::Arena* chunk_arena, const char* file_path);
+void
+release_world_chunk(WorldChunk* chunk);
 
 inline Entity*
 get_player(WorldChunk* wc)
 {
-    if (wc->player_id != ENTITY_ID_NONE)
-    {
-        return wc->entities + wc->player_id;
-    }
-    return nullptr;
+    return wc->get_entity(wc->player_id);
 }
 
 
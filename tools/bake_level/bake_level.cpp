@@ -0,0 +1,61 @@
+#include "rigel.h"
+#include "mem.h"
+#include "level_file.h"
+
+#include <iostream>
+
+// Bakes Tiled levels into the binary format the game maps at load time.
+//
+// usage: rigel_bake_level <level.tmj>...
+//
+// Each level is written next to its json with an .rlvl extension. The game
+// only uses a baked level if it's at least as new as the json, so a level
+// that's been edited since it was baked falls back to the json until it's
+// baked again.
+
+using namespace rigel;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <level.tmj>..." << std::endl;
+        return 1;
+    }
+
+    mem::Arena level_arena = mem::make_reserved_arena(ONE_MB, 0);
+    mem::Arena temp_arena = mem::make_reserved_arena(64 * ONE_MB, 0);
+
+    int result = 0;
+    for (i32 arg = 1; arg < argc; arg++)
+    {
+        const char* json_path = argv[arg];
+
+        char baked_path[256];
+        if (!baked_level_path(json_path, baked_path, sizeof(baked_path)))
+        {
+            std::cerr << "path is too long: " << json_path << std::endl;
+            result = 1;
+            continue;
+        }
+
+        LevelDesc level;
+        if (!read_level_json(&level_arena, &temp_arena, json_path, &level)
+            || !write_level_file(&level, baked_path))
+        {
+            std::cerr << "couldn't bake " << json_path << std::endl;
+            result = 1;
+        }
+        else
+        {
+            std::cout << json_path << " -> " << baked_path << " ("
+                      << level.n_entities << " entities, "
+                      << level.n_lights << " lights)" << std::endl;
+        }
+
+        level_arena.reinit();
+        temp_arena.reinit();
+    }
+
+    return result;
+}